@@ -0,0 +1 @@
+#define REDISRAFT_GIT_SHA1 "9e5447b0"
@@ -127,6 +127,7 @@ RRStatus CommandSpecInit(RedisModuleCtx *ctx, RedisRaftConfig *config)
             /* RedisRaft Commands */
             { "raft",                   CMD_SPEC_DONT_INTERCEPT },
             { "raft.entry",             CMD_SPEC_DONT_INTERCEPT },
+            { "raft.entry.batch",       CMD_SPEC_DONT_INTERCEPT },
             { "raft.config",            CMD_SPEC_DONT_INTERCEPT },
             { "raft.cluster",           CMD_SPEC_DONT_INTERCEPT },
             { "raft.shardgroup",        CMD_SPEC_DONT_INTERCEPT },
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "redisraft.h"
@@ -23,12 +24,29 @@ static const char *CONF_JOIN_TIMEOUT = "join-timeout";
 static const char *CONF_RAFT_RESPONSE_TIMEOUT = "raft-response-timeout";
 static const char *CONF_PROXY_RESPONSE_TIMEOUT = "proxy-response-timeout";
 static const char *CONF_RECONNECT_INTERVAL = "reconnect-interval";
+static const char *CONF_RAFT_AE_MAX_ENTRIES = "raft-ae-max-entries";
+static const char *CONF_RAFT_AE_MAX_SIZE = "raft-ae-max-size";
+static const char *CONF_RAFT_AE_MAX_INFLIGHT = "raft-ae-max-inflight";
+static const char *CONF_PEER_PORT_OFFSET = "peer-port-offset";
+static const char *CONF_RAFT_WRITE_BATCH_SIZE = "raft-write-batch-size";
+static const char *CONF_RAFT_APPLY_LOCK_BUDGET = "raft-apply-lock-budget";
+static const char *CONF_MAX_PENDING_ENTRIES = "max-pending-entries";
+static const char *CONF_MAX_PENDING_SIZE = "max-pending-size";
+static const char *CONF_MAX_PROXY_OUTSTANDING = "max-proxy-outstanding";
+static const char *CONF_COMMIT_LATENCY_TARGET = "commit-latency-target";
 static const char *CONF_RAFT_LOG_FILENAME = "raft-log-filename";
 static const char *CONF_RAFT_LOG_MAX_CACHE_SIZE = "raft-log-max-cache-size";
+static const char *CONF_RAFT_LOG_CACHE_TAIL_SIZE = "raft-log-cache-tail-size";
 static const char *CONF_RAFT_LOG_MAX_FILE_SIZE = "raft-log-max-file-size";
+static const char *CONF_RAFT_LOG_SEGMENT_SIZE = "raft-log-segment-size";
 static const char *CONF_RAFT_LOG_FSYNC = "raft-log-fsync";
+static const char *CONF_RAFT_LOG_FSYNC_POLICY = "raft-log-fsync-policy";
+static const char *CONF_RAFT_LOG_PREALLOCATE = "raft-log-preallocate";
 static const char *CONF_FOLLOWER_PROXY = "follower-proxy";
 static const char *CONF_QUORUM_READS = "quorum-reads";
+static const char *CONF_LEASE_READS = "lease-reads";
+static const char *CONF_FOLLOWER_READS = "follower-reads";
+static const char *CONF_LEASE_MAX_DRIFT = "lease-max-drift";
 static const char *CONF_LOGLEVEL = "loglevel";
 static const char *CONF_SHARDING = "sharding";
 static const char *CONF_SLOT_CONFIG = "slot-config";
@@ -72,6 +90,30 @@ static const char *getLoglevelName(int level)
     return loglevels[level];
 }
 
+static char *fsync_policies[] = {
+    "always",
+    "everysec",
+    "never",
+    NULL
+};
+
+static int parseFsyncPolicy(const char *value)
+{
+    int i;
+    for (i = 0; fsync_policies[i] != NULL; i++) {
+        if (!strcasecmp(value, fsync_policies[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *getFsyncPolicyName(RaftLogFsyncPolicy policy)
+{
+    assert(policy >= RAFT_LOG_FSYNC_ALWAYS && policy <= RAFT_LOG_FSYNC_NEVER);
+    return fsync_policies[policy];
+}
+
 int validSlotConfig(char *slot_config) {
     int ret = 0;
     char *tmp = RedisModule_Strdup(slot_config);
@@ -111,6 +153,7 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
     /* Parameters we don't accept as config set */
     if (!on_init && (!strcmp(keyword, CONF_ID) ||
                 !strcmp(keyword, CONF_RAFT_LOG_FILENAME) ||
+                !strcmp(keyword, CONF_PEER_PORT_OFFSET) ||
                 !strcmp(keyword, CONF_SLOT_CONFIG))) {
         snprintf(errbuf, errbuflen-1, "'%s' only supported at load time", keyword);
         return RR_ERROR;
@@ -183,21 +226,101 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
         if (*errptr != '\0' || val <= 0)
             goto invalid_value;
         target->reconnect_interval = (int)val;
+    } else if (!strcmp(keyword, CONF_RAFT_AE_MAX_ENTRIES)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->raft_ae_max_entries = (int)val;
+    } else if (!strcmp(keyword, CONF_RAFT_AE_MAX_SIZE)) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK)
+            goto invalid_value;
+        target->raft_ae_max_size = val;
+    } else if (!strcmp(keyword, CONF_RAFT_AE_MAX_INFLIGHT)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val <= 0 || val > INT_MAX)
+            goto invalid_value;
+        target->raft_ae_max_inflight = (int)val;
+    } else if (!strcmp(keyword, CONF_PEER_PORT_OFFSET)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > UINT16_MAX)
+            goto invalid_value;
+        target->peer_port_offset = (int)val;
+    } else if (!strcmp(keyword, CONF_RAFT_WRITE_BATCH_SIZE)) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK)
+            goto invalid_value;
+        target->raft_write_batch_size = val;
+    } else if (!strcmp(keyword, CONF_RAFT_APPLY_LOCK_BUDGET)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->raft_apply_lock_budget = val;
+    } else if (!strcmp(keyword, CONF_MAX_PENDING_ENTRIES)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->max_pending_entries = val;
+    } else if (!strcmp(keyword, CONF_MAX_PENDING_SIZE)) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK)
+            goto invalid_value;
+        target->max_pending_size = val;
+    } else if (!strcmp(keyword, CONF_MAX_PROXY_OUTSTANDING)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->max_proxy_outstanding = val;
+    } else if (!strcmp(keyword, CONF_COMMIT_LATENCY_TARGET)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->commit_latency_target = val;
     } else if (!strcmp(keyword, CONF_RAFT_LOG_MAX_CACHE_SIZE)) {
         unsigned long val;
         if (parseMemorySize(value, &val) != RR_OK)
             goto invalid_value;
         target->raft_log_max_cache_size = (int)val;
+    } else if (!strcmp(keyword, CONF_RAFT_LOG_CACHE_TAIL_SIZE)) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK)
+            goto invalid_value;
+        target->raft_log_cache_tail_size = val;
     } else if (!strcmp(keyword, CONF_RAFT_LOG_MAX_FILE_SIZE)) {
         unsigned long val;
         if (parseMemorySize(value, &val) != RR_OK)
             goto invalid_value;
         target->raft_log_max_file_size = (int)val;
+    } else if (!strcmp(keyword, CONF_RAFT_LOG_SEGMENT_SIZE)) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK)
+            goto invalid_value;
+        target->raft_log_segment_size = val;
     } else if (!strcmp(keyword, CONF_RAFT_LOG_FSYNC)) {
         bool val;
         if (parseBool(value, &val) != RR_OK)
             goto invalid_value;
-        target->raft_log_fsync = val;
+        target->raft_log_fsync_policy = val ? RAFT_LOG_FSYNC_ALWAYS : RAFT_LOG_FSYNC_NEVER;
+    } else if (!strcmp(keyword, CONF_RAFT_LOG_FSYNC_POLICY)) {
+        int policy = parseFsyncPolicy(value);
+        if (policy < 0) {
+            snprintf(errbuf, errbuflen-1,
+                     "invalid '%s', must be 'always', 'everysec' or 'never'", keyword);
+            return RR_ERROR;
+        }
+        target->raft_log_fsync_policy = policy;
+    } else if (!strcmp(keyword, CONF_RAFT_LOG_PREALLOCATE)) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK)
+            goto invalid_value;
+        target->raft_log_preallocate = val;
     } else if (!strcmp(keyword, CONF_FOLLOWER_PROXY)) {
         bool val;
         if (parseBool(value, &val) != RR_OK)
@@ -208,6 +331,22 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
         if (parseBool(value, &val) != RR_OK)
             goto invalid_value;
         target->quorum_reads = val;
+    } else if (!strcmp(keyword, CONF_LEASE_READS)) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK)
+            goto invalid_value;
+        target->lease_reads = val;
+    } else if (!strcmp(keyword, CONF_FOLLOWER_READS)) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK)
+            goto invalid_value;
+        target->follower_reads = val;
+    } else if (!strcmp(keyword, CONF_LEASE_MAX_DRIFT)) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val > INT_MAX)
+            goto invalid_value;
+        target->lease_max_drift = (int)val;
     } else if (!strcmp(keyword, CONF_LOGLEVEL)) {
         int loglevel = parseLogLevel(value);
         if (loglevel < 0) {
@@ -272,6 +411,17 @@ void handleConfigSet(RedisRaftCtx *rr, RedisModuleCtx *ctx, RedisModuleString **
     char errbuf[256] = "ERR ";
     if (processConfigParam(keybuf, valuebuf, rr->config, false,
                 errbuf + strlen(errbuf), (int)(sizeof(errbuf) - strlen(errbuf))) == RR_OK) {
+        if (rr->log) {
+            rr->log->segment_size = rr->config->raft_log_segment_size;
+            rr->log->fsync_policy = rr->config->raft_log_fsync_policy;
+            rr->log->preallocate = rr->config->raft_log_preallocate;
+        }
+        if (rr->raft) {
+            raft_set_appendentries_limits(rr->raft, rr->config->raft_ae_max_entries,
+                                          rr->config->raft_ae_max_size);
+            raft_set_lease_maxdrift(rr->raft, rr->config->lease_max_drift +
+                                              rr->config->raft_interval);
+        }
         RedisModule_ReplyWithSimpleString(ctx, "OK");
     } else {
         RedisModule_ReplyWithError(ctx, errbuf);
@@ -360,17 +510,75 @@ void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleSt
         len++;
         replyConfigInt(ctx, CONF_RECONNECT_INTERVAL, config->reconnect_interval);
     }
+    if (stringmatch(pattern, CONF_RAFT_AE_MAX_ENTRIES, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_RAFT_AE_MAX_ENTRIES, config->raft_ae_max_entries);
+    }
+    if (stringmatch(pattern, CONF_RAFT_AE_MAX_SIZE, 1)) {
+        len++;
+        replyConfigMemSize(ctx, CONF_RAFT_AE_MAX_SIZE, config->raft_ae_max_size);
+    }
+    if (stringmatch(pattern, CONF_RAFT_AE_MAX_INFLIGHT, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_RAFT_AE_MAX_INFLIGHT, config->raft_ae_max_inflight);
+    }
+    if (stringmatch(pattern, CONF_PEER_PORT_OFFSET, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_PEER_PORT_OFFSET, config->peer_port_offset);
+    }
+    if (stringmatch(pattern, CONF_RAFT_WRITE_BATCH_SIZE, 1)) {
+        len++;
+        replyConfigMemSize(ctx, CONF_RAFT_WRITE_BATCH_SIZE, config->raft_write_batch_size);
+    }
+    if (stringmatch(pattern, CONF_RAFT_APPLY_LOCK_BUDGET, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_RAFT_APPLY_LOCK_BUDGET, (int) config->raft_apply_lock_budget);
+    }
+    if (stringmatch(pattern, CONF_MAX_PENDING_ENTRIES, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_MAX_PENDING_ENTRIES, (int) config->max_pending_entries);
+    }
+    if (stringmatch(pattern, CONF_MAX_PENDING_SIZE, 1)) {
+        len++;
+        replyConfigMemSize(ctx, CONF_MAX_PENDING_SIZE, config->max_pending_size);
+    }
+    if (stringmatch(pattern, CONF_MAX_PROXY_OUTSTANDING, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_MAX_PROXY_OUTSTANDING, (int) config->max_proxy_outstanding);
+    }
+    if (stringmatch(pattern, CONF_COMMIT_LATENCY_TARGET, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_COMMIT_LATENCY_TARGET, (int) config->commit_latency_target);
+    }
     if (stringmatch(pattern, CONF_RAFT_LOG_MAX_CACHE_SIZE, 1)) {
         len++;
         replyConfigMemSize(ctx, CONF_RAFT_LOG_MAX_CACHE_SIZE, config->raft_log_max_cache_size);
     }
+    if (stringmatch(pattern, CONF_RAFT_LOG_CACHE_TAIL_SIZE, 1)) {
+        len++;
+        replyConfigMemSize(ctx, CONF_RAFT_LOG_CACHE_TAIL_SIZE, config->raft_log_cache_tail_size);
+    }
     if (stringmatch(pattern, CONF_RAFT_LOG_MAX_FILE_SIZE, 1)) {
         len++;
         replyConfigMemSize(ctx, CONF_RAFT_LOG_MAX_FILE_SIZE, config->raft_log_max_file_size);
     }
+    if (stringmatch(pattern, CONF_RAFT_LOG_SEGMENT_SIZE, 1)) {
+        len++;
+        replyConfigMemSize(ctx, CONF_RAFT_LOG_SEGMENT_SIZE, config->raft_log_segment_size);
+    }
     if (stringmatch(pattern, CONF_RAFT_LOG_FSYNC, 1)) {
         len++;
-        replyConfigBool(ctx, CONF_RAFT_LOG_FSYNC, config->raft_log_fsync);
+        replyConfigBool(ctx, CONF_RAFT_LOG_FSYNC,
+                        config->raft_log_fsync_policy != RAFT_LOG_FSYNC_NEVER);
+    }
+    if (stringmatch(pattern, CONF_RAFT_LOG_FSYNC_POLICY, 1)) {
+        len++;
+        replyConfigStr(ctx, CONF_RAFT_LOG_FSYNC_POLICY,
+                       getFsyncPolicyName(config->raft_log_fsync_policy));
+    }
+    if (stringmatch(pattern, CONF_RAFT_LOG_PREALLOCATE, 1)) {
+        len++;
+        replyConfigBool(ctx, CONF_RAFT_LOG_PREALLOCATE, config->raft_log_preallocate);
     }
     if (stringmatch(pattern, CONF_FOLLOWER_PROXY, 1)) {
         len++;
@@ -380,6 +588,18 @@ void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleSt
         len++;
         replyConfigBool(ctx, CONF_QUORUM_READS, config->quorum_reads);
     }
+    if (stringmatch(pattern, CONF_LEASE_READS, 1)) {
+        len++;
+        replyConfigBool(ctx, CONF_LEASE_READS, config->lease_reads);
+    }
+    if (stringmatch(pattern, CONF_FOLLOWER_READS, 1)) {
+        len++;
+        replyConfigBool(ctx, CONF_FOLLOWER_READS, config->follower_reads);
+    }
+    if (stringmatch(pattern, CONF_LEASE_MAX_DRIFT, 1)) {
+        len++;
+        replyConfigInt(ctx, CONF_LEASE_MAX_DRIFT, config->lease_max_drift);
+    }
     if (stringmatch(pattern, CONF_ADDR, 1)) {
         len++;
         char buf[300];
@@ -424,10 +644,25 @@ void ConfigInit(RedisModuleCtx *ctx, RedisRaftConfig *config)
     config->reconnect_interval = REDIS_RAFT_DEFAULT_RECONNECT_INTERVAL;
     config->raft_response_timeout = REDIS_RAFT_DEFAULT_RAFT_RESPONSE_TIMEOUT;
     config->proxy_response_timeout = REDIS_RAFT_DEFAULT_PROXY_RESPONSE_TIMEOUT;
+    config->raft_ae_max_entries = REDIS_RAFT_DEFAULT_AE_MAX_ENTRIES;
+    config->raft_ae_max_size = REDIS_RAFT_DEFAULT_AE_MAX_SIZE;
+    config->raft_ae_max_inflight = REDIS_RAFT_DEFAULT_AE_MAX_INFLIGHT;
+    config->raft_write_batch_size = REDIS_RAFT_DEFAULT_WRITE_BATCH_SIZE;
+    config->raft_apply_lock_budget = REDIS_RAFT_DEFAULT_APPLY_LOCK_BUDGET;
+    config->max_pending_entries = 0;
+    config->max_pending_size = 0;
+    config->max_proxy_outstanding = 0;
+    config->commit_latency_target = 0;
     config->raft_log_max_cache_size = REDIS_RAFT_DEFAULT_LOG_MAX_CACHE_SIZE;
+    config->raft_log_cache_tail_size = REDIS_RAFT_DEFAULT_LOG_CACHE_TAIL_SIZE;
     config->raft_log_max_file_size = REDIS_RAFT_DEFAULT_LOG_MAX_FILE_SIZE;
-    config->raft_log_fsync = true;
+    config->raft_log_segment_size = REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE;
+    config->raft_log_fsync_policy = RAFT_LOG_FSYNC_ALWAYS;
+    config->raft_log_preallocate = false;
     config->quorum_reads = true;
+    config->lease_reads = false;
+    config->lease_max_drift = REDIS_RAFT_DEFAULT_LEASE_MAX_DRIFT;
+    config->follower_reads = false;
     config->sharding = false;
     config->slot_config = "0:16383",
     config->shardgroup_update_interval = REDIS_RAFT_DEFAULT_SHARDGROUP_UPDATE_INTERVAL;
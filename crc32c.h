@@ -0,0 +1,20 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020-2021 Redis Ltd.
+ *
+ * RedisRaft is licensed under the Redis Source Available License (RSAL).
+ */
+
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Computes the CRC32C (Castagnoli) checksum of buf, continuing from a
+ * previously returned crc value. Use 0 as the initial crc.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif /* _CRC32C_H_ */
@@ -112,8 +112,9 @@ typedef struct raft_entry
     /** data length */
     unsigned int data_len;
 
-    /** data */
-    char data[0];
+    /** data, stored right after the entry by raft_entry_new(). Entries
+     * created otherwise may point elsewhere, and release it in free_func. */
+    char *data;
 } raft_entry_t;
 
 /** Message sent from client to server.
@@ -313,7 +314,8 @@ typedef int (
  * @param[in] user_data User data that is passed from Raft server
  * @param[in] node The node's ID that we are sending this message to
  * @param[in] msg The appendentries message to be sent
- * @return 0 on success */
+ * @return 0 on success; otherwise the message is considered not sent, and will
+ *  be sent again later */
 typedef int (
 *func_send_appendentries_f
 )   (
@@ -603,6 +605,34 @@ typedef int (
         raft_node_t* node
     );
 
+/** Callback for being notified that raft_apply_all() is done applying
+ * entries.
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ */
+typedef void (
+*func_applylog_done_f
+)   (
+        raft_server_t* raft,
+        void *user_data
+    );
+
+/** Callback for reading a monotonic clock, in milliseconds.
+ *
+ * Implementing this callback is optional. The leader's read lease is timed
+ * with it; otherwise it uses the time reported to raft_periodic(), which
+ * falls behind if raft_periodic() is not called for a while.
+ * @param[in] raft The Raft server making this callback
+ * @param[in] user_data User data that is passed from Raft server
+ * @return the current time in milliseconds
+ */
+typedef long (
+*func_timestamp_f
+)   (
+        raft_server_t* raft,
+        void *user_data
+    );
+
 typedef struct
 {
     /** Callback for sending request vote messages */
@@ -665,6 +695,13 @@ typedef struct
 
     /** Callback for sending TimeoutNow RPC messages to nodes */
     func_send_timeoutnow_f send_timeoutnow;
+
+    /** Callback invoked after applying a run of committed entries (optional).
+     * Resources held across applying them may be released here. */
+    func_applylog_done_f applylog_done;
+
+    /** Callback for reading a monotonic clock (optional). */
+    func_timestamp_f timestamp;
 } raft_cbs_t;
 
 /** A generic notification callback used to allow Raft to notify caller
@@ -918,6 +955,32 @@ void raft_set_election_timeout(raft_server_t* me, int msec);
  * @param[in] msec Request timeout in milliseconds */
 void raft_set_request_timeout(raft_server_t* me, int msec);
 
+/** Limit the size of appendentries messages.
+ * Followers that are further behind receive their entries over several
+ * messages. A message always holds at least one entry.
+ * @param[in] max_entries Maximum number of entries, or 0 for no limit
+ * @param[in] max_size Maximum total size of entries data, or 0 for no limit */
+void raft_set_appendentries_limits(raft_server_t* me, int max_entries, raft_size_t max_size);
+
+/** Set the maximum clock drift between nodes in milliseconds.
+ * The leader's read lease lasts an election timeout minus this value from
+ * the time it sent a heartbeat acknowledged by the majority. It must also
+ * cover the interval between raft_periodic() calls, which drive the clock.
+ * @param[in] msec Maximum clock drift in milliseconds */
+void raft_set_lease_maxdrift(raft_server_t* me, int msec);
+
+/** Enable asynchronous log persistence.
+ * By default, entries are considered persisted once appended to the log.
+ * When enabled, our own log only counts towards committing entries up to the
+ * index reported by raft_set_persisted_idx().
+ * @param[in] enabled Non-zero to enable */
+void raft_set_async_persistence(raft_server_t* me, int enabled);
+
+/** Report the last log index that has been persisted.
+ * When we're the leader, this may advance the commit index.
+ * @param[in] idx Last persisted log index */
+void raft_set_persisted_idx(raft_server_t* me, raft_index_t idx);
+
 /** Process events that are dependent on time passing.
  * @param[in] msec_elapsed Time in milliseconds since the last call
  * @return
@@ -1478,8 +1541,22 @@ extern const raft_log_impl_t raft_log_internal_impl;
 
 void raft_handle_append_cfg_change(raft_server_t* me_, raft_entry_t* ety, raft_index_t idx);
 
+/** Queue a read request.
+ * The callback is invoked once our leadership is confirmed. Requests queued
+ * before the next raft_process_read_queue() call share a single round of
+ * appendentries messages. */
 void raft_queue_read_request(raft_server_t* me_, func_read_request_callback_f cb, void *cb_arg);
 
+/** Check if the leader holds a read lease.
+ * While it does, no other node can become the leader, so reads may be served
+ * locally without confirming leadership first.
+ * @return non-zero if reads can be served locally */
+int raft_has_read_lease(raft_server_t* me_);
+
+/** Get the time left until the leader's read lease expires.
+ * @return milliseconds the lease remains valid for, 0 if we hold none */
+int raft_get_read_lease_remaining(raft_server_t* me_);
+
 /** Attempt to process read queue.
  */
 void raft_process_read_queue(raft_server_t* me_);
@@ -32,6 +32,17 @@ typedef struct raft_read_request {
     struct raft_read_request *next;
 } raft_read_request_t;
 
+/* Number of appendentries rounds tracked for the leader's read lease */
+#define RAFT_LEASE_ROUNDS 16
+
+typedef struct raft_lease_round {
+    /* the first msg_id sent in the round */
+    raft_msg_id_t msg_id;
+
+    /* when the round was sent */
+    long time;
+} raft_lease_round_t;
+
 typedef struct {
     /* Persistent state: */
 
@@ -55,6 +66,13 @@ typedef struct {
     /* idx of highest log entry applied to state machine */
     raft_index_t last_applied_idx;
 
+    /* log entries are persisted asynchronously, and only count towards
+     * committing once persisted */
+    int async_persistence;
+
+    /* idx of highest log entry known to be persisted */
+    raft_index_t persisted_idx;
+
     /* follower/leader/candidate indicator */
     int state;
 
@@ -68,6 +86,10 @@ typedef struct {
     int election_timeout_rand;
     int request_timeout;
 
+    /* limits of a single appendentries message, 0 if unlimited */
+    int max_appendentries_entries;
+    raft_size_t max_appendentries_size;
+
     /* timer interval to check if we still have quorum */
     long quorum_timeout;
 
@@ -120,6 +142,25 @@ typedef struct {
     raft_read_request_t *read_queue_head;
     raft_read_request_t *read_queue_tail;
 
+    /* first msg_id of the last round sent to confirm queued reads, and
+     * whether reads were queued since */
+    raft_msg_id_t read_round_msg_id;
+    int read_round_pending;
+
+    /* milliseconds elapsed, as reported to raft_periodic() */
+    long time;
+
+    /* Read lease: rounds sent to all nodes that are not yet acknowledged by
+     * the majority, oldest first, and the send time of the latest one that
+     * was (-1 if none in this term).
+     */
+    raft_lease_round_t lease_rounds[RAFT_LEASE_ROUNDS];
+    int lease_rounds_num;
+    long lease_start;
+
+    /* time subtracted from the election timeout to get the lease duration */
+    int lease_maxdrift;
+
     raft_node_id_t node_transferring_leader_to; // the node we are targeting for leadership
     long transfer_leader_time; // how long we should wait for leadership transfer to take, before aborting
     int sent_timeout_now; // if we've already sent a leadership transfer signal
@@ -129,6 +170,9 @@ typedef struct {
 
 int raft_election_start(raft_server_t* me);
 
+/* Advances the commit index to the highest index stored by the majority */
+void raft_update_commit_idx(raft_server_t* me);
+
 int raft_become_candidate(raft_server_t* me);
 
 int raft_become_precandidate(raft_server_t* me);
@@ -190,6 +234,11 @@ raft_msg_id_t raft_get_msg_id(raft_server_t* me_);
 /* attempt to abort the leadership transfer */
 void raft_reset_transfer_leader(raft_server_t* me_, int timed_out);
 
+/* set/get the id of the first message sent to the node after its next_idx was
+ * rewound; rejections of earlier messages are stale */
+void raft_node_set_rewind_msgid(raft_node_t *me_, raft_msg_id_t msg_id);
+raft_msg_id_t raft_node_get_rewind_msgid(raft_node_t *me_);
+
 raft_size_t raft_node_get_snapshot_offset(raft_node_t *me_);
 
 void raft_node_set_snapshot_offset(raft_node_t *me_, raft_size_t snapshot_offset);
@@ -40,6 +40,9 @@ typedef struct
     raft_term_t last_acked_term;
     raft_msg_id_t last_acked_msgid;
     raft_msg_id_t max_seen_msgid;
+
+    /* first message sent after next_idx was rewound */
+    raft_msg_id_t rewind_msgid;
 } raft_node_private_t;
 
 raft_node_t* raft_node_new(void* udata, raft_node_id_t id)
@@ -226,6 +229,18 @@ raft_msg_id_t raft_node_get_max_seen_msg_id(raft_node_t *me_)
     return me->max_seen_msgid;
 }
 
+void raft_node_set_rewind_msgid(raft_node_t *me_, raft_msg_id_t msg_id)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    me->rewind_msgid = msg_id;
+}
+
+raft_msg_id_t raft_node_get_rewind_msgid(raft_node_t *me_)
+{
+    raft_node_private_t* me = (raft_node_private_t*)me_;
+    return me->rewind_msgid;
+}
+
 raft_size_t raft_node_get_snapshot_offset(raft_node_t *me_)
 {
     raft_node_private_t* me = (raft_node_private_t*)me_;
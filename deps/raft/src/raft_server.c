@@ -118,6 +118,7 @@ raft_server_t* raft_new_with_log(const raft_log_impl_t *log_impl, void *log_arg)
     me->request_timeout = 200;
     me->election_timeout = 1000;
     me->node_transferring_leader_to = RAFT_NODE_ID_NONE;
+    me->lease_start = -1;
 
     raft_update_quorum_meta((raft_server_t*)me, me->msg_id);
 
@@ -367,6 +368,9 @@ int raft_delete_entry_from_idx(raft_server_t* me_, raft_index_t idx)
     if (idx <= me->voting_cfg_change_log_idx)
         me->voting_cfg_change_log_idx = -1;
 
+    if (idx <= me->persisted_idx)
+        me->persisted_idx = idx - 1;
+
     return me->log_impl->pop(me->log, idx,
             (func_entry_notify_f) raft_handle_remove_cfg_change, me_);
 }
@@ -424,12 +428,16 @@ int raft_become_leader(raft_server_t* me_)
 
         // Commit noop immediately if this is a single node cluster
         if (raft_is_single_node_voting_cluster(me_)) {
-            raft_set_commit_idx(me_, raft_get_current_idx(me_));
+            raft_update_commit_idx(me_);
         }
     }
 
     raft_set_state(me_, RAFT_STATE_LEADER);
     raft_update_quorum_meta(me_, me->msg_id);
+    me->lease_rounds_num = 0;
+    me->lease_start = -1;
+    me->read_round_pending = 0;
+    me->read_round_msg_id = 0;
     raft_clear_incoming_snapshot(me_, 0);
     me->timeout_elapsed = 0;
 
@@ -537,6 +545,82 @@ static int msgid_cmp(const void *a, const void *b)
     return va > vb ? -1 : 1;
 }
 
+static int idx_cmp(const void *a, const void *b)
+{
+    raft_index_t va = *((raft_index_t*) a);
+    raft_index_t vb = *((raft_index_t*) b);
+
+    return va > vb ? -1 : 1;
+}
+
+/* Returns the last index of our own log that counts towards committing
+ * entries, which lags behind the current index while entries are persisted
+ * asynchronously.
+ */
+static raft_index_t raft_get_voting_idx(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*) me_;
+    raft_index_t current_idx = raft_get_current_idx(me_);
+
+    if (me->async_persistence && me->persisted_idx < current_idx)
+        return me->persisted_idx;
+
+    return current_idx;
+}
+
+/* Returns the highest log index that is stored by the majority */
+static raft_index_t quorum_idx(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*) me_;
+    raft_index_t match_idxs[me->num_nodes];
+    int num_voters = 0;
+
+    for (int i = 0; i < me->num_nodes; i++) {
+        raft_node_t* node = me->nodes[i];
+
+        if (!raft_node_is_voting(node))
+            continue;
+
+        if (me->node == node) {
+            match_idxs[num_voters++] = raft_get_voting_idx(me_);
+        } else {
+            match_idxs[num_voters++] = raft_node_get_match_idx(node);
+        }
+    }
+
+    if (num_voters == 0)
+        return 0;
+
+    qsort(match_idxs, num_voters, sizeof(raft_index_t), idx_cmp);
+
+    return match_idxs[num_voters / 2];
+}
+
+void raft_update_commit_idx(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*) me_;
+    raft_index_t point = quorum_idx(me_);
+
+    if (point <= raft_get_commit_idx(me_))
+        return;
+
+    /* Only entries from the current term are committed by counting replicas */
+    raft_entry_t* ety = raft_get_entry_from_idx(me_, point);
+    if (ety && ety->term == me->current_term)
+        raft_set_commit_idx(me_, point);
+    if (ety)
+        raft_entry_release(ety);
+}
+
+void raft_set_persisted_idx(raft_server_t* me_, raft_index_t idx)
+{
+    raft_server_private_t* me = (raft_server_private_t*) me_;
+
+    me->persisted_idx = idx;
+    if (raft_is_leader(me_))
+        raft_update_commit_idx(me_);
+}
+
 static raft_msg_id_t quorum_msg_id(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*) me_;
@@ -573,6 +657,7 @@ int raft_periodic(raft_server_t* me_, int msec_since_last_period)
     raft_server_private_t* me = (raft_server_private_t*)me_;
 
     me->timeout_elapsed += msec_since_last_period;
+    me->time += msec_since_last_period;
 
     /* Only one voting node means it's safe for us to become the leader */
     if (raft_is_single_node_voting_cluster(me_) && !raft_is_leader(me_)) {
@@ -713,10 +798,15 @@ int raft_recv_appendentries_response(raft_server_t* me_,
         if (r->current_idx < match_idx)
             return 0;
 
+        /* Messages sent before we last rewound are rejected as well -- ignore */
+        if (r->msg_id < raft_node_get_rewind_msgid(node))
+            return 0;
+
         raft_index_t next = min(r->current_idx + 1, raft_get_current_idx(me_));
         assert(0 < next);
 
         raft_node_set_next_idx(node, next);
+        raft_node_set_rewind_msgid(node, me->msg_id + 1);
 
         /* retry */
         raft_send_appendentries(me_, node);
@@ -748,39 +838,23 @@ int raft_recv_appendentries_response(raft_server_t* me_,
 
     assert(r->current_idx <= raft_get_current_idx(me_));
 
-    raft_node_set_next_idx(node, r->current_idx + 1);
+    /* next_idx may already be ahead, if more messages are in flight */
+    if (raft_node_get_next_idx(node) <= r->current_idx)
+        raft_node_set_next_idx(node, r->current_idx + 1);
     raft_node_set_match_idx(node, r->current_idx);
 
-    /* Update commit idx */
-    raft_index_t point = r->current_idx;
-    if (point)
-    {
-        raft_entry_t* ety = raft_get_entry_from_idx(me_, point);
-        if (raft_get_commit_idx(me_) < point && ety->term == me->current_term)
-        {
-            int votes = raft_node_is_voting(me->node) ? 1 : 0;
-            for (int i = 0; i < me->num_nodes; i++)
-            {
-                raft_node_t* follower = me->nodes[i];
-                if (me->node != follower &&
-                    raft_node_is_voting(follower) &&
-                    point <= raft_node_get_match_idx(follower))
-                {
-                    votes++;
-                }
-            }
+    raft_update_commit_idx(me_);
 
-            if (raft_get_num_voting_nodes(me_) / 2 < votes)
-                raft_set_commit_idx(me_, point);
-        }
-        if (ety)
-            raft_entry_release(ety);
+    /* Aggressively send remaining entries, for as long as the node accepts
+     * more messages */
+    while (raft_node_get_next_idx(node) <= raft_get_current_idx(me_))
+    {
+        raft_index_t next_idx = raft_node_get_next_idx(node);
+        if (0 != raft_send_appendentries(me_, node) ||
+            raft_node_get_next_idx(node) == next_idx)
+            break;
     }
 
-    /* Aggressively send remaining entries */
-    if (raft_node_get_next_idx(node) <= raft_get_current_idx(me_))
-        raft_send_appendentries(me_, node);
-
     /* periodic applies committed entries lazily */
 
     return 0;
@@ -1165,7 +1239,7 @@ int raft_recv_entry(raft_server_t* me_,
 
     /* if we are the only voter, commit now, as no appendentries_response will occur */
     if (raft_is_single_node_voting_cluster(me_)) {
-        raft_set_commit_idx(me_, raft_get_current_idx(me_));
+        raft_update_commit_idx(me_);
     }
 
     r->id = ety->id;
@@ -1302,6 +1376,47 @@ exit:
     return 0;
 }
 
+/* Returns entries for an appendentries message starting at idx, within the
+ * configured message limits */
+static raft_entry_t** get_appendentries_entries(raft_server_t* me_, raft_index_t idx, int* n_etys)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+
+    if (raft_get_current_idx(me_) < idx) {
+        *n_etys = 0;
+        return NULL;
+    }
+
+    raft_index_t size = raft_get_current_idx(me_) - idx + 1;
+    if (me->max_appendentries_entries > 0 && size > me->max_appendentries_entries)
+        size = me->max_appendentries_entries;
+
+    raft_entry_t **e = raft_malloc(size * sizeof(raft_entry_t*));
+    int n = me->log_impl->get_batch(me->log, idx, (int) size, e);
+
+    if (n < 1) {
+        raft_free(e);
+        *n_etys = 0;
+        return NULL;
+    }
+
+    if (me->max_appendentries_size > 0) {
+        raft_size_t total = e[0]->data_len;
+        int i;
+
+        for (i = 1; i < n; i++) {
+            total += e[i]->data_len;
+            if (total > me->max_appendentries_size)
+                break;
+        }
+        raft_entry_release_list(&e[i], n - i);
+        n = i;
+    }
+
+    *n_etys = n;
+    return e;
+}
+
 raft_entry_t** raft_get_entries_from_idx(raft_server_t* me_, raft_index_t idx, int* n_etys)
 {
     if (raft_get_current_idx(me_) < idx) {
@@ -1541,7 +1656,7 @@ int raft_send_appendentries(raft_server_t* me_, raft_node_t* node)
         .msg_id = ++me->msg_id,
     };
 
-    ae.entries = raft_get_entries_from_idx(me_, next_idx, &ae.n_entries);
+    ae.entries = get_appendentries_entries(me_, next_idx, &ae.n_entries);
     assert((!ae.entries && 0 == ae.n_entries) ||
             (ae.entries && 0 < ae.n_entries));
 
@@ -1584,12 +1699,47 @@ int raft_send_appendentries(raft_server_t* me_, raft_node_t* node)
     return res;
 }
 
+/* The read lease is timed with the timestamp callback if there is one, as
+ * the time reported to raft_periodic() may fall behind wall clock time.
+ */
+static long lease_time(raft_server_private_t* me)
+{
+    if (me->cb.timestamp)
+        return me->cb.timestamp((raft_server_t*) me, me->udata);
+    return me->time;
+}
+
+static void record_lease_round(raft_server_private_t* me)
+{
+    long now = lease_time(me);
+
+    /* Rounds sent at the same time are equivalent, keep the first one */
+    if (me->lease_rounds_num > 0 &&
+        me->lease_rounds[me->lease_rounds_num - 1].time == now)
+        return;
+
+    /* Dropping the oldest round may only delay renewing the lease */
+    if (me->lease_rounds_num == RAFT_LEASE_ROUNDS) {
+        memmove(&me->lease_rounds[0], &me->lease_rounds[1],
+                sizeof(raft_lease_round_t) * (RAFT_LEASE_ROUNDS - 1));
+        me->lease_rounds_num--;
+    }
+
+    me->lease_rounds[me->lease_rounds_num++] = (raft_lease_round_t) {
+        .msg_id = me->msg_id + 1,
+        .time = now
+    };
+}
+
 int raft_send_appendentries_all(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
     int i, e;
     int ret = 0;
 
+    if (raft_is_leader(me_))
+        record_lease_round(me);
+
     me->timeout_elapsed = 0;
     for (i = 0; i < me->num_nodes; i++)
     {
@@ -1660,17 +1810,23 @@ int raft_msg_entry_response_committed(raft_server_t* me_,
 
 int raft_apply_all(raft_server_t* me_)
 {
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    int e = 0;
+
     if (!raft_is_apply_allowed(me_))
         return 0;
 
     while (raft_get_last_applied_idx(me_) < raft_get_commit_idx(me_))
     {
-        int e = raft_apply_entry(me_);
+        e = raft_apply_entry(me_);
         if (0 != e)
-            return e;
+            break;
     }
 
-    return 0;
+    if (me->cb.applylog_done)
+        me->cb.applylog_done(me_, me->udata);
+
+    return e;
 }
 
 int raft_entry_is_voting_cfg_change(raft_entry_t* ety)
@@ -1920,6 +2076,7 @@ void *raft_get_log(raft_server_t *me_)
 raft_entry_t *raft_entry_new(unsigned int data_len)
 {
     raft_entry_t *ety = raft_calloc(1, sizeof(raft_entry_t) + data_len);
+    ety->data = (char *) (ety + 1);
     ety->data_len = data_len;
     ety->refs = 1;
 
@@ -1974,7 +2131,65 @@ void raft_queue_read_request(raft_server_t* me_, func_read_request_callback_f cb
         me->read_queue_tail->next = req;
     me->read_queue_tail = req;
 
-    raft_send_appendentries_all(me_);
+    /* Leadership is confirmed by the next round raft_process_read_queue()
+     * sends, which serves all reads queued until then.
+     */
+    me->read_round_pending = 1;
+}
+
+int raft_get_read_lease_remaining(raft_server_t* me_)
+{
+    raft_server_private_t* me = (raft_server_private_t*) me_;
+
+    /* The target of a leadership transfer does not wait for an election
+     * timeout before it takes over.
+     */
+    if (!raft_is_leader(me_) || me->node_transferring_leader_to != RAFT_NODE_ID_NONE)
+        return 0;
+
+    /* Entries committed by previous leaders must be applied first. Once an
+     * entry of our own term is applied, they all are.
+     */
+    raft_entry_t *ety = raft_get_entry_from_idx(me_, me->last_applied_idx);
+    if (!ety)
+        return 0;
+
+    raft_term_t ety_term = ety->term;
+    raft_entry_release(ety);
+
+    if (ety_term < me->current_term)
+        return 0;
+
+    if (raft_is_single_node_voting_cluster(me_))
+        return me->election_timeout - me->lease_maxdrift;
+
+    /* A majority has heard from us no earlier than the send time of the
+     * latest round it acknowledged, so none of them will vote for another
+     * candidate before an election timeout elapses from then.
+     */
+    raft_msg_id_t quorum_id = quorum_msg_id(me_);
+    int acked = 0;
+
+    while (acked < me->lease_rounds_num && me->lease_rounds[acked].msg_id <= quorum_id)
+        acked++;
+
+    if (acked > 0) {
+        me->lease_start = me->lease_rounds[acked - 1].time;
+        me->lease_rounds_num -= acked;
+        memmove(&me->lease_rounds[0], &me->lease_rounds[acked],
+                sizeof(raft_lease_round_t) * me->lease_rounds_num);
+    }
+
+    if (me->lease_start == -1)
+        return 0;
+
+    long remaining = me->lease_start + me->election_timeout - me->lease_maxdrift - lease_time(me);
+    return remaining > 0 ? (int) remaining : 0;
+}
+
+int raft_has_read_lease(raft_server_t* me_)
+{
+    return raft_get_read_lease_remaining(me_) > 0;
 }
 
 static void pop_read_queue(raft_server_private_t *me, int can_read)
@@ -2018,9 +2233,16 @@ void raft_process_read_queue(raft_server_t* me_)
     if (!raft_is_leader(me_))
         return;
 
-    /* Quickly bail if nothing to do */
-    if (!me->read_queue_head)
-        return;
+    raft_msg_id_t last_acked_msgid = quorum_msg_id(me_);
+
+    /* Only one round is in flight at a time: reads queued meanwhile wait
+     * for the next one, sent once the current round is acknowledged.
+     */
+    if (me->read_round_pending && last_acked_msgid >= me->read_round_msg_id) {
+        me->read_round_pending = 0;
+        me->read_round_msg_id = me->msg_id + 1;
+        raft_send_appendentries_all(me_);
+    }
 
     if (raft_get_num_voting_nodes(me_) > 1) {
         raft_entry_t *ety = raft_get_entry_from_idx(me_, raft_get_commit_idx(me_));
@@ -2038,7 +2260,6 @@ void raft_process_read_queue(raft_server_t* me_)
             return;
     }
 
-    raft_msg_id_t last_acked_msgid = quorum_msg_id(me_);
     raft_index_t last_applied_idx = me->last_applied_idx;
 
     /* Special case: the log's first index is 1, so we need to account
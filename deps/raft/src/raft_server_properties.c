@@ -29,6 +29,25 @@ void raft_set_request_timeout(raft_server_t* me_, int millisec)
     me->request_timeout = millisec;
 }
 
+void raft_set_appendentries_limits(raft_server_t* me_, int max_entries, raft_size_t max_size)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->max_appendentries_entries = max_entries;
+    me->max_appendentries_size = max_size;
+}
+
+void raft_set_lease_maxdrift(raft_server_t* me_, int millisec)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->lease_maxdrift = millisec;
+}
+
+void raft_set_async_persistence(raft_server_t* me_, int enabled)
+{
+    raft_server_private_t* me = (raft_server_private_t*)me_;
+    me->async_persistence = enabled;
+}
+
 raft_node_id_t raft_get_nodeid(raft_server_t* me_)
 {
     raft_server_private_t* me = (raft_server_private_t*)me_;
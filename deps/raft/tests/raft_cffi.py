@@ -22,6 +22,7 @@ ffi.set_source(
                 int sz = sizeof(raft_entry_t) + src[i]->data_len;
                 t[i] = malloc(sz);
                 memcpy(t[i], src[i], sz);
+                t[i]->data = (char *) (t[i] + 1);
             }
             return t;
         }
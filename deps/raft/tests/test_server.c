@@ -457,6 +457,30 @@ void TestRaft_server_apply_entry_increments_last_applied_idx(CuTest* tc)
     CuAssertTrue(tc, 1 == raft_get_last_applied_idx(r));
 }
 
+static void __raft_applylog_done(raft_server_t* raft, void *udata)
+{
+    (*(int *) udata)++;
+}
+
+void TestRaft_server_apply_all_notifies_done(CuTest* tc)
+{
+    raft_cbs_t funcs = {
+        .applylog = __raft_applylog,
+        .applylog_done = __raft_applylog_done,
+    };
+    int done = 0;
+
+    void *r = raft_new();
+    raft_set_callbacks(r, &funcs, &done);
+    raft_set_current_term(r, 1);
+
+    __RAFT_APPEND_ENTRIES_SEQ_ID(r, 3, 1, 1, "aaa");
+    raft_set_commit_idx(r, 3);
+    raft_apply_all(r);
+    CuAssertIntEquals(tc, 3, raft_get_last_applied_idx(r));
+    CuAssertIntEquals(tc, 1, done);
+}
+
 void TestRaft_server_periodic_elapses_election_timeout(CuTest * tc)
 {
     void *r = raft_new();
@@ -569,6 +593,28 @@ void TestRaft_server_recv_entry_auto_commits_if_we_are_the_only_node(CuTest * tc
     CuAssertTrue(tc, 1 == raft_get_commit_idx(r));
 }
 
+void TestRaft_server_recv_entry_commits_once_persisted_if_async_persistence(CuTest * tc)
+{
+    void *r = raft_new();
+    raft_add_node(r, NULL, 1, 1);
+    raft_set_election_timeout(r, 1000);
+    raft_set_async_persistence(r, 1);
+    raft_become_leader(r);
+    CuAssertTrue(tc, 0 == raft_get_commit_idx(r));
+
+    /* entry message */
+    msg_entry_t *ety = __MAKE_ENTRY(1, 1, "entry");
+
+    /* receive entry, which is not committed until persisted */
+    msg_entry_response_t cr;
+    raft_recv_entry(r, ety, &cr);
+    CuAssertTrue(tc, 1 == raft_get_log_count(r));
+    CuAssertTrue(tc, 0 == raft_get_commit_idx(r));
+
+    raft_set_persisted_idx(r, 1);
+    CuAssertTrue(tc, 1 == raft_get_commit_idx(r));
+}
+
 void TestRaft_server_recv_entry_fails_if_there_is_already_a_voting_change(CuTest * tc)
 {
     void *r = raft_new();
@@ -3398,6 +3444,111 @@ void TestRaft_leader_recv_entry_does_not_send_new_appendentries_to_slow_nodes(Cu
     CuAssertTrue(tc, NULL == ae);
 }
 
+void TestRaft_leader_send_appendentries_within_limits(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .persist_term = __raft_persist_term,
+        .send_appendentries          = sender_appendentries,
+    };
+
+    void *sender = sender_new(NULL);
+    void *r = raft_new();
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_set_callbacks(r, &funcs, sender);
+
+    raft_set_state(r, RAFT_STATE_LEADER);
+    raft_set_current_term(r, 10);
+    raft_set_commit_idx(r, 0);
+    __RAFT_APPEND_ENTRIES_SEQ_ID_TERM(r, 10, 1, 1, "aaaa");
+
+    raft_node_t* node = raft_get_node(r, 2);
+    raft_node_set_next_idx(node, 1);
+    msg_appendentries_t* ae;
+
+    /* limited by number of entries */
+    raft_set_appendentries_limits(r, 3, 0);
+    raft_send_appendentries(r, node);
+    CuAssertPtrNotNull(tc, (ae = sender_poll_msg_data(sender)));
+    CuAssertIntEquals(tc, 3, ae->n_entries);
+    CuAssertIntEquals(tc, 4, raft_node_get_next_idx(node));
+
+    /* limited by size of entries */
+    raft_set_appendentries_limits(r, 0, 8);
+    raft_send_appendentries(r, node);
+    CuAssertPtrNotNull(tc, (ae = sender_poll_msg_data(sender)));
+    CuAssertIntEquals(tc, 2, ae->n_entries);
+    CuAssertIntEquals(tc, 6, raft_node_get_next_idx(node));
+
+    /* a response for the first message does not rewind next_idx, and the
+     * remaining entries are sent over several messages */
+    msg_appendentries_response_t aer = {
+        .term = 10, .success = 1, .current_idx = 3
+    };
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, node, &aer));
+    CuAssertIntEquals(tc, 3, raft_node_get_match_idx(node));
+    CuAssertIntEquals(tc, 11, raft_node_get_next_idx(node));
+
+    CuAssertPtrNotNull(tc, (ae = sender_poll_msg_data(sender)));
+    CuAssertIntEquals(tc, 5, ae->prev_log_idx);
+    CuAssertIntEquals(tc, 2, ae->n_entries);
+    CuAssertPtrNotNull(tc, (ae = sender_poll_msg_data(sender)));
+    CuAssertIntEquals(tc, 2, ae->n_entries);
+    CuAssertPtrNotNull(tc, (ae = sender_poll_msg_data(sender)));
+    CuAssertIntEquals(tc, 1, ae->n_entries);
+    CuAssertTrue(tc, NULL == sender_poll_msg_data(sender));
+}
+
+void TestRaft_leader_ignores_rejections_sent_before_rewind(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .persist_term = __raft_persist_term,
+        .send_appendentries          = sender_appendentries,
+    };
+
+    void *sender = sender_new(NULL);
+    void *r = raft_new();
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_set_callbacks(r, &funcs, sender);
+
+    raft_set_state(r, RAFT_STATE_LEADER);
+    raft_set_current_term(r, 5);
+    raft_set_commit_idx(r, 0);
+    __RAFT_APPEND_ENTRIES_SEQ_ID_TERM(r, 5, 1, 1, "aaaa");
+    raft_set_appendentries_limits(r, 1, 0);
+
+    raft_node_t* node = raft_get_node(r, 2);
+    raft_node_set_next_idx(node, 2);
+
+    /* send three messages ahead */
+    raft_msg_id_t msg_ids[3];
+    int i;
+    for (i = 0; i < 3; i++) {
+        raft_send_appendentries(r, node);
+        msg_appendentries_t* ae = sender_poll_msg_data(sender);
+        CuAssertPtrNotNull(tc, ae);
+        msg_ids[i] = ae->msg_id;
+    }
+    CuAssertIntEquals(tc, 5, raft_node_get_next_idx(node));
+
+    /* the first rejection rewinds next_idx */
+    msg_appendentries_response_t aer = {
+        .term = 5, .success = 0, .current_idx = 0, .msg_id = msg_ids[0]
+    };
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, node, &aer));
+    CuAssertPtrNotNull(tc, sender_poll_msg_data(sender));
+    CuAssertIntEquals(tc, 2, raft_node_get_next_idx(node));
+
+    /* rejections of the other messages are stale */
+    aer.msg_id = msg_ids[1];
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, node, &aer));
+    aer.msg_id = msg_ids[2];
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, node, &aer));
+    CuAssertTrue(tc, NULL == sender_poll_msg_data(sender));
+    CuAssertIntEquals(tc, 2, raft_node_get_next_idx(node));
+}
+
 void TestRaft_leader_recv_appendentries_response_failure_does_not_set_node_nextid_to_0(
     CuTest * tc)
 {
@@ -3928,6 +4079,66 @@ void TestRaft_read_action_callback(
     CuAssertIntEquals(tc, 0, ra.last_cb_safe);
 }
 
+void TestRaft_leader_read_requests_share_heartbeat_round(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .send_appendentries = sender_appendentries,
+    };
+
+    void *sender = sender_new(NULL);
+    void *r = raft_new();
+    struct read_request_arg ra = { 0 };
+    int i;
+
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_set_callbacks(r, &funcs, sender);
+
+    raft_set_current_term(r, 1);
+    raft_set_election_timeout(r, 1000);
+    raft_set_request_timeout(r, 10000);
+    raft_become_leader(r);
+    while (sender_poll_msg_data(sender))
+        ;
+
+    __RAFT_APPEND_ENTRY(r, 1, 1, "aaa");
+    raft_set_commit_idx(r, 1);
+    raft_set_last_applied_idx(r, 1);
+
+    /* reads queued together are confirmed by a single round */
+    for (i = 0; i < 3; i++)
+        raft_queue_read_request(r, __read_request_callback, &ra);
+    CuAssertTrue(tc, NULL == sender_poll_msg_data(sender));
+
+    raft_process_read_queue(r);
+    msg_appendentries_t* ae = sender_poll_msg_data(sender);
+    CuAssertPtrNotNull(tc, ae);
+    raft_msg_id_t round = ae->msg_id;
+    CuAssertTrue(tc, NULL == sender_poll_msg_data(sender));
+
+    /* a read queued while the round is in flight waits for the next one */
+    raft_queue_read_request(r, __read_request_callback, &ra);
+    raft_process_read_queue(r);
+    CuAssertTrue(tc, NULL == sender_poll_msg_data(sender));
+    CuAssertIntEquals(tc, 0, ra.calls);
+
+    /* acknowledging the round serves the first reads and starts the next */
+    msg_appendentries_response_t aer = {
+        .term = 1, .success = 1, .current_idx = 1, .msg_id = round
+    };
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, raft_get_node(r, 2), &aer));
+    raft_process_read_queue(r);
+    CuAssertIntEquals(tc, 3, ra.calls);
+    ae = sender_poll_msg_data(sender);
+    CuAssertPtrNotNull(tc, ae);
+
+    aer.msg_id = ae->msg_id;
+    CuAssertIntEquals(tc, 0, raft_recv_appendentries_response(r, raft_get_node(r, 2), &aer));
+    raft_process_read_queue(r);
+    CuAssertIntEquals(tc, 4, ra.calls);
+    CuAssertIntEquals(tc, 1, ra.last_cb_safe);
+}
+
 void single_node_commits_noop_cb(void* arg, int can_read)
 {
     (void) can_read;
@@ -4078,6 +4289,134 @@ void TestRaft_quorum_msg_id_correctness(CuTest * tc)
     CuAssertIntEquals(tc, 1, val);
 }
 
+void TestRaft_leader_read_lease(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .send_appendentries = __raft_send_appendentries,
+    };
+
+    void *r = raft_new();
+    raft_set_callbacks(r, &funcs, NULL);
+    raft_server_private_t *me = (raft_server_private_t *) r;
+
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_add_node(r, NULL, 3, 0);
+    raft_set_current_term(r, 1);
+    raft_set_election_timeout(r, 1000);
+    raft_set_request_timeout(r, 100);
+    raft_set_lease_maxdrift(r, 100);
+    raft_become_leader(r);
+
+    __RAFT_APPEND_ENTRY(r, 1, 1, "aaa");
+    raft_set_commit_idx(r, 1);
+    raft_set_last_applied_idx(r, 1);
+
+    /* no heartbeat acknowledged yet */
+    CuAssertTrue(tc, !raft_has_read_lease(r));
+
+    /* heartbeat sent at 100 is acknowledged by node 2 */
+    raft_periodic(r, 100);
+    raft_node_set_last_ack(raft_get_node(r, 2), me->msg_id, 1);
+    CuAssertTrue(tc, raft_has_read_lease(r));
+
+    /* lease lasts election timeout minus drift from the send time */
+    raft_periodic(r, 850);
+    CuAssertTrue(tc, raft_has_read_lease(r));
+    CuAssertIntEquals(tc, 50, raft_get_read_lease_remaining(r));
+    raft_periodic(r, 100);
+    CuAssertTrue(tc, !raft_has_read_lease(r));
+    CuAssertIntEquals(tc, 0, raft_get_read_lease_remaining(r));
+
+    /* acknowledging the latest heartbeat renews it */
+    raft_node_set_last_ack(raft_get_node(r, 3), me->msg_id, 1);
+    CuAssertTrue(tc, raft_has_read_lease(r));
+
+    /* a leadership transfer voids the lease */
+    CuAssertIntEquals(tc, 0, raft_transfer_leader(r, 2, 0));
+    CuAssertTrue(tc, !raft_has_read_lease(r));
+}
+
+static long __lease_clock = 0;
+
+static long __raft_timestamp(raft_server_t* raft, void *udata)
+{
+    return __lease_clock;
+}
+
+void TestRaft_leader_read_lease_expires_while_stalled(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .send_appendentries = __raft_send_appendentries,
+        .timestamp = __raft_timestamp,
+    };
+
+    void *r = raft_new();
+    raft_set_callbacks(r, &funcs, NULL);
+    raft_server_private_t *me = (raft_server_private_t *) r;
+
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_add_node(r, NULL, 3, 0);
+    raft_set_current_term(r, 1);
+    raft_set_election_timeout(r, 1000);
+    raft_set_request_timeout(r, 100);
+    raft_set_lease_maxdrift(r, 100);
+    raft_become_leader(r);
+
+    __RAFT_APPEND_ENTRY(r, 1, 1, "aaa");
+    raft_set_commit_idx(r, 1);
+    raft_set_last_applied_idx(r, 1);
+
+    /* heartbeat sent at 100 is acknowledged by node 2 */
+    __lease_clock = 100;
+    raft_periodic(r, 100);
+    raft_node_set_last_ack(raft_get_node(r, 2), me->msg_id, 1);
+    CuAssertIntEquals(tc, 900, raft_get_read_lease_remaining(r));
+
+    /* stalled for longer than the election timeout: raft_periodic() isn't
+     * called, but the lease is timed with the clock */
+    __lease_clock += 1500;
+    CuAssertTrue(tc, !raft_has_read_lease(r));
+
+    /* a heartbeat sent once we resume renews it */
+    raft_periodic(r, 100);
+    raft_node_set_last_ack(raft_get_node(r, 2), me->msg_id, 1);
+    CuAssertIntEquals(tc, 900, raft_get_read_lease_remaining(r));
+}
+
+void TestRaft_leader_read_lease_requires_applied_entry_of_current_term(CuTest * tc)
+{
+    raft_cbs_t funcs = {
+        .send_appendentries = __raft_send_appendentries,
+    };
+
+    void *r = raft_new();
+    raft_set_callbacks(r, &funcs, NULL);
+    raft_server_private_t *me = (raft_server_private_t *) r;
+
+    raft_add_node(r, NULL, 1, 1);
+    raft_add_node(r, NULL, 2, 0);
+    raft_set_current_term(r, 1);
+    __RAFT_APPEND_ENTRY(r, 1, 1, "aaa");
+    raft_set_commit_idx(r, 1);
+    raft_set_last_applied_idx(r, 1);
+
+    raft_set_current_term(r, 2);
+    raft_set_election_timeout(r, 1000);
+    raft_set_request_timeout(r, 100);
+    raft_become_leader(r);
+
+    raft_periodic(r, 100);
+    raft_node_set_last_ack(raft_get_node(r, 2), me->msg_id, 2);
+    CuAssertTrue(tc, !raft_has_read_lease(r));
+
+    /* NO_OP of the new term applied */
+    raft_set_commit_idx(r, 2);
+    raft_set_last_applied_idx(r, 2);
+    CuAssertTrue(tc, raft_has_read_lease(r));
+}
+
 int timeoutnow_sent = 0;
 
 int __fake_timeoutnow(raft_server_t* raft, raft_node_t* node)
@@ -4568,6 +4907,7 @@ int main(void)
     SUITE_ADD_TEST(suite, TestRaft_server_increment_lastApplied_when_lastApplied_lt_commitidx);
     SUITE_ADD_TEST(suite, TestRaft_user_applylog_error_propogates_to_periodic);
     SUITE_ADD_TEST(suite, TestRaft_server_apply_entry_increments_last_applied_idx);
+    SUITE_ADD_TEST(suite, TestRaft_server_apply_all_notifies_done);
     SUITE_ADD_TEST(suite, TestRaft_server_periodic_elapses_election_timeout);
     SUITE_ADD_TEST(suite, TestRaft_server_election_timeout_does_not_promote_us_to_leader_if_there_is_are_more_than_1_nodes);
     SUITE_ADD_TEST(suite, TestRaft_server_election_timeout_does_not_promote_us_to_leader_if_we_are_not_voting_node);
@@ -4575,6 +4915,7 @@ int main(void)
     SUITE_ADD_TEST(suite, TestRaft_server_election_timeout_does_promote_us_to_leader_if_there_is_only_1_node);
     SUITE_ADD_TEST(suite, TestRaft_server_election_timeout_does_promote_us_to_leader_if_there_is_only_1_voting_node);
     SUITE_ADD_TEST(suite, TestRaft_server_recv_entry_auto_commits_if_we_are_the_only_node);
+    SUITE_ADD_TEST(suite, TestRaft_server_recv_entry_commits_once_persisted_if_async_persistence);
     SUITE_ADD_TEST(suite, TestRaft_server_recv_entry_fails_if_there_is_already_a_voting_change);
     SUITE_ADD_TEST(suite, TestRaft_server_cfg_sets_num_nodes);
     SUITE_ADD_TEST(suite, TestRaft_server_cant_get_node_we_dont_have);
@@ -4654,6 +4995,8 @@ int main(void)
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_entry_is_committed_returns_neg_1_if_invalidated);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_entry_fails_if_prevlogidx_less_than_commit);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_entry_does_not_send_new_appendentries_to_slow_nodes);
+    SUITE_ADD_TEST(suite, TestRaft_leader_send_appendentries_within_limits);
+    SUITE_ADD_TEST(suite, TestRaft_leader_ignores_rejections_sent_before_rewind);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_appendentries_response_failure_does_not_set_node_nextid_to_0);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_appendentries_response_increment_idx_of_node);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_appendentries_response_drop_message_if_term_is_old);
@@ -4664,8 +5007,12 @@ int main(void)
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_requestvote_responds_without_granting);
     SUITE_ADD_TEST(suite, TestRaft_leader_recv_appendentries_response_set_has_sufficient_logs_after_voting_committed);
     SUITE_ADD_TEST(suite, TestRaft_read_action_callback);
+    SUITE_ADD_TEST(suite, TestRaft_leader_read_requests_share_heartbeat_round);
     SUITE_ADD_TEST(suite, TestRaft_single_node_commits_noop);
     SUITE_ADD_TEST(suite, TestRaft_quorum_msg_id_correctness);
+    SUITE_ADD_TEST(suite, TestRaft_leader_read_lease);
+    SUITE_ADD_TEST(suite, TestRaft_leader_read_lease_expires_while_stalled);
+    SUITE_ADD_TEST(suite, TestRaft_leader_read_lease_requires_applied_entry_of_current_term);
     SUITE_ADD_TEST(suite, TestRaft_leader_steps_down_if_there_is_no_quorum);
     SUITE_ADD_TEST(suite, TestRaft_vote_for_unknown_node);
     SUITE_ADD_TEST(suite, TestRaft_recv_appendreq_from_unknown_node);
@@ -10,13 +10,20 @@
 #include <string.h>
 #include <strings.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <libgen.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <assert.h>
 
 #include "redisraft.h"
+#include "crc32c.h"
 
 #define ENTRY_CACHE_INIT_SIZE 512
+#define SEGMENT_INDEX_INIT_SIZE 1024
+#define LOG_READ_AHEAD_SIZE (1024 * 1024)
 
 #ifdef RAFT_LOG_TRACE
 #  define TRACE_LOG_OP(fmt, ...) LOG_DEBUG("Log>>" fmt, ##__VA_ARGS__)
@@ -165,11 +172,17 @@ long EntryCacheDeleteTail(EntryCache *cache, raft_index_t index)
     return deleted;
 }
 
-long EntryCacheCompact(EntryCache *cache, size_t max_memory)
+/* Evicts entries from the head of the cache. Entries from keep_idx onwards
+ * are evicted only if the cache uses more than max_memory, and entries before
+ * it (which are no longer needed) once it uses more than tail_memory.
+ */
+long EntryCacheCompact(EntryCache *cache, size_t max_memory, size_t tail_memory, raft_index_t keep_idx)
 {
     long deleted = 0;
 
-    while (cache->len > 0 && cache->entries_memsize > max_memory) {
+    while (cache->len > 0 &&
+           (cache->entries_memsize > max_memory ||
+            (cache->start_idx < keep_idx && cache->entries_memsize > tail_memory))) {
         raft_entry_t *ety = cache->ptrs[cache->start];
         cache->entries_memsize -= sizeof(raft_entry_t) + ety->data_len;
         raft_entry_release(ety);
@@ -191,15 +204,96 @@ long EntryCacheCompact(EntryCache *cache, size_t max_memory)
     return deleted;
 }
 
+/* Returns the number of entries in the range [idx, idx + n) held in the cache */
+unsigned long EntryCacheCountRange(EntryCache *cache, raft_index_t idx, unsigned long n)
+{
+    raft_index_t start = idx > cache->start_idx ? idx : cache->start_idx;
+    raft_index_t end = idx + n;
+
+    if (end > cache->start_idx + cache->len) {
+        end = cache->start_idx + cache->len;
+    }
+
+    return (!cache->len || end <= start) ? 0 : end - start;
+}
+
+/*
+ * Raft Log.
+ *
+ * The log is stored in a metadata file and a set of segment files:
+ *
+ * - The metadata file (raft-log-filename) holds the log header (dbid, node id,
+ *   snapshot term/index, current term and vote), followed by a manifest that
+ *   lists the first index of every segment. It is always rewritten as a whole
+ *   and atomically replaced.
+ *
+ * - Every segment file (<filename>.<first index>) holds a contiguous range
+ *   of entries, and has an index file (<segment>.idx) mapping entries to file
+ *   offsets.
+ *
+ * Entries are appended to the last (active) segment, and a new segment is
+ * started once it grows beyond the configured segment size. Compacting the
+ * log after a snapshot only updates the metadata file and unlinks head
+ * segments, so no entries are copied. The first segment may therefore still
+ * hold entries that are included in the snapshot; these are skipped.
+ */
+
+static void closeSegment(RaftLogSegment *seg)
+{
+    if (seg->file) {
+        fclose(seg->file);
+    }
+    if (seg->index) {
+        munmap(seg->index, seg->index_size * sizeof(off_t));
+    }
+    if (seg->idxfd != -1) {
+        close(seg->idxfd);
+    }
+    RedisModule_Free(seg->filename);
+    RedisModule_Free(seg);
+}
+
+static char *getIndexFilename(const char *filename)
+{
+    int idx_filename_len = strlen(filename) + 10;
+    char *idx_filename = RedisModule_Alloc(idx_filename_len);
+    snprintf(idx_filename, idx_filename_len - 1, "%s.idx", filename);
+    return idx_filename;
+}
+
+static char *getSegmentFilename(const char *filename, raft_index_t first_idx)
+{
+    int seg_filename_len = strlen(filename) + 30;
+    char *seg_filename = RedisModule_Alloc(seg_filename_len);
+    snprintf(seg_filename, seg_filename_len - 1, "%s.%lu", filename, first_idx);
+    return seg_filename;
+}
+
+/* Unlinks a segment's files and releases it */
+static void removeSegment(RaftLogSegment *seg)
+{
+    char *idx_filename = getIndexFilename(seg->filename);
+
+    LOG_DEBUG("Removing Raft Log segment: %s", seg->filename);
+    unlink(seg->filename);
+    unlink(idx_filename);
+
+    RedisModule_Free(idx_filename);
+    closeSegment(seg);
+}
+
 void RaftLogClose(RaftLog *log)
 {
-    if (log->file) {
-        fclose(log->file);
-        log->file = NULL;
+    int i;
+
+    for (i = 0; i < log->num_segments; i++) {
+        closeSegment(log->segments[i]);
     }
-    if (log->idxfile) {
-        fclose(log->idxfile);
-        log->idxfile = NULL;
+    if (log->segments) {
+        RedisModule_Free(log->segments);
+    }
+    if (log->sealed_fd != -1) {
+        close(log->sealed_fd);
     }
     RedisModule_Free(log);
 }
@@ -219,6 +313,37 @@ static int writeBegin(FILE *logfile, int length)
     return n;
 }
 
+/* Makes written data durable. File metadata is only synced when needed to
+ * read the data back, e.g. a changed file size.
+ */
+static int syncFile(int fd)
+{
+#ifdef __linux__
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+/* Makes creating, renaming and unlinking files next to the specified one
+ * durable, by syncing the directory that holds them.
+ */
+static int syncDir(const char *filename)
+{
+    size_t path_len = strlen(filename) + 1;
+    char path[path_len];
+    memcpy(path, filename, path_len);
+
+    int fd = open(dirname(path), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
 static int writeEnd(FILE *logfile, bool use_fsync)
 {
     if (fflush(logfile) < 0) {
@@ -227,7 +352,7 @@ static int writeEnd(FILE *logfile, bool use_fsync)
     if (!use_fsync) {
         return 0;
     }
-    if (fsync(fileno(logfile)) < 0) {
+    if (syncFile(fileno(logfile)) < 0) {
         return -1;
     }
 
@@ -297,12 +422,42 @@ typedef struct RawLogEntry {
     RawElement elements[];
 } RawLogEntry;
 
-static int readEncodedLength(RaftLog *log, char type, unsigned long *length)
+/* Starting with version 2, log entries are stored in binary form as a fixed
+ * size header followed by the entry data. The checksum covers both the header
+ * (with crc set to zero) and the data, so a torn write at the tail of the log
+ * can be detected and truncated on load.
+ *
+ * Fields are stored in host byte order.
+ */
+#define RAFTLOG_ENTRY_MAGIC 0x45524c52  /* "RLRE" */
+
+typedef struct EntryHeader {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t term;
+    int32_t id;
+    int32_t type;
+    uint64_t len;
+} EntryHeader;
+
+static uint32_t entryChecksum(EntryHeader *hdr, const void *data)
+{
+    uint32_t saved = hdr->crc;
+    hdr->crc = 0;
+
+    uint32_t crc = crc32c(0, hdr, sizeof(*hdr));
+    crc = crc32c(crc, data, hdr->len);
+
+    hdr->crc = saved;
+    return crc;
+}
+
+static int readEncodedLength(FILE *file, char type, unsigned long *length)
 {
     char buf[128];
     char *eptr;
 
-    if (!fgets(buf, sizeof(buf), log->file)) {
+    if (!fgets(buf, sizeof(buf), file)) {
         return -1;
     }
 
@@ -336,12 +491,12 @@ static void freeRawLogEntry(RawLogEntry *entry)
     RedisModule_Free(entry);
 }
 
-static int readRawLogEntry(RaftLog *log, RawLogEntry **entry)
+static int readRawLogEntry(FILE *file, RawLogEntry **entry)
 {
     unsigned long num_elements;
     int i;
 
-    if (readEncodedLength(log, '*', &num_elements) < 0) {
+    if (readEncodedLength(file, '*', &num_elements) < 0) {
         return -1;
     }
 
@@ -351,14 +506,14 @@ static int readRawLogEntry(RaftLog *log, RawLogEntry **entry)
         unsigned long len;
         char *ptr;
 
-        if (readEncodedLength(log, '$', &len) < 0) {
+        if (readEncodedLength(file, '$', &len) < 0) {
             goto error;
         }
         (*entry)->elements[i].len = len;
         (*entry)->elements[i].ptr = ptr = RedisModule_Alloc(len + 2);
 
         /* Read extra CRLF */
-        if (fread(ptr, 1, len + 2, log->file) != len + 2) {
+        if (fread(ptr, 1, len + 2, file) != len + 2) {
             goto error;
         }
         ptr[len] = '\0';
@@ -373,170 +528,366 @@ error:
     return -1;
 }
 
-static int updateIndex(RaftLog *log, raft_index_t index, off_t offset)
+static int writeEntry(FILE *logfile, raft_entry_t *entry)
+{
+    EntryHeader hdr = {
+        .magic = RAFTLOG_ENTRY_MAGIC,
+        .term = entry->term,
+        .id = entry->id,
+        .type = entry->type,
+        .len = entry->data_len
+    };
+    hdr.crc = entryChecksum(&hdr, entry->data);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, logfile) != 1 ||
+        fwrite(entry->data, 1, entry->data_len, logfile) != entry->data_len) {
+        return -1;
+    }
+
+    return sizeof(hdr) + entry->data_len;
+}
+
+/* Reads the entry the file is positioned at, which is expected to be at the
+ * specified offset of a file of the specified size.
+ *
+ * Returns 1 if an entry was read, or 0 if the end of the file has been reached
+ * or the entry is truncated or corrupt (e.g. a torn write).
+ */
+static int readEntry(FILE *file, off_t offset, size_t size, raft_entry_t **entry)
+{
+    EntryHeader hdr;
+
+    *entry = NULL;
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+        hdr.magic != RAFTLOG_ENTRY_MAGIC ||
+        (off_t) hdr.len > (off_t) size - offset - (off_t) sizeof(hdr)) {
+        return 0;
+    }
+
+    raft_entry_t *e = raft_entry_new(hdr.len);
+    if (fread(e->data, 1, hdr.len, file) != hdr.len ||
+        entryChecksum(&hdr, e->data) != hdr.crc) {
+        raft_entry_release(e);
+        return 0;
+    }
+
+    e->term = hdr.term;
+    e->id = hdr.id;
+    e->type = hdr.type;
+
+    *entry = e;
+    return 1;
+}
+
+/* Maps the segment's index file, growing it to hold at least the specified
+ * number of entries. The file size is always a multiple of the mapped size,
+ * so slots beyond the last entry simply remain unused.
+ */
+static int mapIndex(RaftLogSegment *seg, size_t entries)
 {
-    long relidx = index - log->snapshot_last_idx;
+    size_t new_size = seg->index_size ? seg->index_size : SEGMENT_INDEX_INIT_SIZE;
+    while (new_size < entries) {
+        new_size *= 2;
+    }
+
+    if (new_size != seg->index_size &&
+        ftruncate(seg->idxfd, new_size * sizeof(off_t)) < 0) {
+        LOG_ERROR("Raft Log: failed to resize index: %s", strerror(errno));
+        return -1;
+    }
 
-    if (fseek(log->idxfile, sizeof(off_t) * relidx, SEEK_SET) < 0 ||
-            fwrite(&offset, sizeof(off_t), 1, log->idxfile) != 1) {
+    off_t *index = mmap(NULL, new_size * sizeof(off_t), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, seg->idxfd, 0);
+    if (index == MAP_FAILED) {
+        LOG_ERROR("Raft Log: failed to map index: %s", strerror(errno));
         return -1;
     }
 
+    if (seg->index) {
+        munmap(seg->index, seg->index_size * sizeof(off_t));
+    }
+    seg->index = index;
+    seg->index_size = new_size;
+
     return 0;
 }
 
-static char *getIndexFilename(const char *filename)
+static int updateIndex(RaftLogSegment *seg, raft_index_t index, off_t offset)
 {
-    int idx_filename_len = strlen(filename) + 10;
-    char *idx_filename = RedisModule_Alloc(idx_filename_len);
-    snprintf(idx_filename, idx_filename_len - 1, "%s.idx", filename);
-    return idx_filename;
+    size_t relidx = index - seg->first_idx;
+
+    if (relidx >= seg->index_size && mapIndex(seg, relidx + 1) < 0) {
+        return -1;
+    }
+
+    seg->index[relidx] = offset;
+    return 0;
 }
 
-static RaftLog *prepareLog(const char *filename, RedisRaftConfig *config, int flags)
+static off_t readIndex(RaftLogSegment *seg, raft_index_t index)
 {
-    FILE *file = fopen(filename, "a+");
-    if (!file) {
-        LOG_ERROR("Raft Log: %s: %s", filename, strerror(errno));
-        return NULL;
+    size_t relidx = index - seg->first_idx;
+
+    if (index < seg->first_idx || relidx >= seg->index_size) {
+        return -1;
     }
 
-    /* Index file */
-    char *idx_filename = getIndexFilename(filename);
-    FILE *idxfile = fopen(idx_filename, (flags & RAFTLOG_KEEP_INDEX) ? "r+" : "w+");
-    if (!idxfile) {
+    return seg->index[relidx];
+}
+
+/* Allocates disk space for the rest of the segment up front, so appending
+ * entries does not have to allocate blocks and update the file size on every
+ * write. Preallocated space is zero filled, which marks the end of the
+ * segment when loading it.
+ */
+static void preallocateSegment(RaftLog *log, RaftLogSegment *seg)
+{
+#ifdef __linux__
+    if (!log->preallocate || seg->size >= log->segment_size) {
+        return;
+    }
+
+    if (fallocate(fileno(seg->file), 0, seg->size, log->segment_size - seg->size) < 0) {
+        LOG_VERBOSE("Raft Log: %s: failed to preallocate: %s", seg->filename, strerror(errno));
+    }
+#else
+    UNUSED(log);
+    UNUSED(seg);
+#endif
+}
+
+/* Returns true if the segment's data ends at the specified offset, and it is
+ * followed by zero filled, preallocated space.
+ */
+static bool isPreallocated(RaftLogSegment *seg, off_t offset)
+{
+    uint32_t magic;
+
+    return pread(fileno(seg->file), &magic, sizeof(magic), offset) == sizeof(magic) &&
+           magic == 0;
+}
+
+static RaftLogSegment *openSegment(RaftLog *log, raft_index_t first_idx, bool create, int flags)
+{
+    RaftLogSegment *seg = RedisModule_Calloc(1, sizeof(RaftLogSegment));
+    seg->first_idx = first_idx;
+    seg->idxfd = -1;
+    seg->filename = getSegmentFilename(log->filename, first_idx);
+
+    /* Segments listed in the manifest must exist */
+    if (!create && access(seg->filename, F_OK) < 0) {
+        LOG_ERROR("Raft Log: %s: %s", seg->filename, strerror(errno));
+        goto error;
+    }
+
+    /* Not opened in append mode, as the file may extend beyond the last
+     * entry when preallocated.
+     */
+    int fd = open(seg->filename, O_RDWR | O_CREAT | (create ? O_TRUNC : 0), 0666);
+    if (fd < 0 || !(seg->file = fdopen(fd, "r+"))) {
+        LOG_ERROR("Raft Log: %s: %s", seg->filename, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        goto error;
+    }
+
+    char *idx_filename = getIndexFilename(seg->filename);
+    seg->index_kept = !create && (flags & RAFTLOG_KEEP_INDEX);
+    seg->idxfd = open(idx_filename, O_RDWR | O_CREAT | (seg->index_kept ? 0 : O_TRUNC), 0666);
+    if (seg->idxfd < 0) {
         LOG_ERROR("Raft Log: %s: %s", idx_filename, strerror(errno));
         RedisModule_Free(idx_filename);
-        fclose(file);
-        return NULL;
+        goto error;
     }
     RedisModule_Free(idx_filename);
 
-    /* Initialize struct */
-    RaftLog *log = RedisModule_Calloc(1, sizeof(RaftLog));
-    log->file = file;
-    log->idxfile = idxfile;
-    log->filename = filename;
+    /* Map an existing index as is, as long as it is whole */
+    struct stat st;
+    size_t index_size = 0;
+    if (fstat(seg->idxfd, &st) == 0 && st.st_size % sizeof(off_t) == 0) {
+        index_size = st.st_size / sizeof(off_t);
+    }
+    seg->index_size = index_size;
+    if (!index_size) {
+        seg->index_kept = false;
+    }
+    if (mapIndex(seg, index_size) < 0) {
+        goto error;
+    }
 
-    /* Config */
-    if (config) {
-        log->fsync = config->raft_log_fsync;
-    } else {
-        log->fsync = true;
+    if (fseek(seg->file, 0L, SEEK_END) < 0) {
+        goto error;
     }
+    seg->size = ftell(seg->file);
 
-    return log;
+    if (create) {
+        preallocateSegment(log, seg);
+    }
+
+    return seg;
+
+error:
+    closeSegment(seg);
+    return NULL;
 }
 
-int writeLogHeader(FILE *logfile, RaftLog *log)
+static void addSegment(RaftLog *log, RaftLogSegment *seg)
 {
-    if (writeBegin(logfile, 8) < 0 ||
-        writeBuffer(logfile, "RAFTLOG", 7) < 0 ||
-        writeUnsignedInteger(logfile, RAFTLOG_VERSION, 4) < 0 ||
-        writeBuffer(logfile, log->dbid, strlen(log->dbid)) < 0 ||
-        writeUnsignedInteger(logfile, log->node_id, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->snapshot_last_term, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->snapshot_last_idx, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->term, 20) < 0 ||
-        writeInteger(logfile, log->vote, 11) < 0 ||
-        writeEnd(logfile, log->fsync) < 0) {
-            return -1;
-    }
-
-    return 0;
+    log->segments = RedisModule_Realloc(log->segments,
+            sizeof(RaftLogSegment *) * (log->num_segments + 1));
+    log->segments[log->num_segments++] = seg;
 }
 
-int updateLogHeader(RaftLog *log)
+static RaftLogSegment *activeSegment(RaftLog *log)
 {
-    int ret;
+    return log->segments[log->num_segments - 1];
+}
 
-    /* Avoid same file open twice */
-    fclose(log->file);
-    log->file = NULL;
+/* Returns the segment that holds the specified index, or NULL */
+static RaftLogSegment *findSegment(RaftLog *log, raft_index_t idx)
+{
+    int lo = 0;
+    int hi = log->num_segments - 1;
 
-    FILE *file = fopen(log->filename, "r+");
-    if (!file) {
-        PANIC("Failed to update log header: %s: %s",
-                log->filename, strerror(errno));
+    if (!log->num_segments || idx < log->segments[0]->first_idx) {
+        return NULL;
     }
 
-    ret = writeLogHeader(file, log);
-    fclose(file);
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (log->segments[mid]->first_idx <= idx) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
 
-    /* Reopen */
-    log->file = fopen(log->filename, "a+");
-    if (!log->file) {
-        PANIC("Failed to reopen log file: %s: %s",
-                log->filename, strerror(errno));
+    RaftLogSegment *seg = log->segments[lo];
+    if (idx >= seg->first_idx + seg->num_entries) {
+        return NULL;
     }
 
-    return ret;
+    return seg;
 }
 
-RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term,
-        raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config)
+/* Updates file_size to reflect the size of all segments, excluding compacted
+ * entries that remain at the head of the first segment.
+ */
+static void updateFileSize(RaftLog *log)
 {
-    RaftLog *log = prepareLog(filename, config, 0);
-    if (!log) {
-        return NULL;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < log->num_segments; i++) {
+        size += log->segments[i]->size;
     }
 
-    log->index = log->snapshot_last_idx = snapshot_index;
-    log->snapshot_last_term = snapshot_term;
-    log->term = current_term;
-    log->vote = last_vote;
+    if (log->num_segments) {
+        RaftLogSegment *first = log->segments[0];
+        raft_index_t live_idx = log->snapshot_last_idx + 1;
 
-    memcpy(log->dbid, dbid, RAFT_DBID_LEN);
-    log->dbid[RAFT_DBID_LEN] = '\0';
-    log->node_id = config->id;
+        if (live_idx >= first->first_idx + first->num_entries) {
+            size -= first->size;
+        } else if (live_idx > first->first_idx) {
+            off_t offset = readIndex(first, live_idx);
+            if (offset > 0) {
+                size -= offset;
+            }
+        }
+    }
 
-    /* Truncate */
-    ftruncate(fileno(log->file), 0);
-    ftruncate(fileno(log->idxfile), 0);
+    log->file_size = size;
+}
 
-    /* Write log start */
-    if (writeLogHeader(log->file, log) < 0) {
-        LOG_ERROR("Failed to create Raft log: %s: %s", filename, strerror(errno));
-        RaftLogClose(log);
-        log = NULL;
+static int writeLogHeader(FILE *logfile, RaftLog *log)
+{
+    if (writeBegin(logfile, 8) < 0 ||
+        writeBuffer(logfile, "RAFTLOG", 7) < 0 ||
+        writeUnsignedInteger(logfile, log->version, 4) < 0 ||
+        writeBuffer(logfile, log->dbid, strlen(log->dbid)) < 0 ||
+        writeUnsignedInteger(logfile, log->node_id, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->snapshot_last_term, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->snapshot_last_idx, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->term, 20) < 0 ||
+        writeInteger(logfile, log->vote, 11) < 0) {
+            return -1;
     }
 
-    return log;
+    return 0;
 }
 
-static raft_entry_t *parseRaftLogEntry(RawLogEntry *re)
+static int writeManifest(FILE *logfile, RaftLog *log, int first_segment)
 {
-    char *eptr;
-    raft_entry_t *e;
+    int i;
 
-    if (re->num_elements != 5) {
-        LOG_ERROR("Log entry: invalid number of arguments: %d", re->num_elements);
-        return NULL;
+    if (writeBegin(logfile, log->num_segments - first_segment + 1) < 0 ||
+        writeBuffer(logfile, "SEGMENTS", 8) < 0) {
+        return -1;
     }
 
-    e = raft_entry_new(re->elements[4].len);
-    memcpy(e->data, re->elements[4].ptr, re->elements[4].len);
+    for (i = first_segment; i < log->num_segments; i++) {
+        if (writeUnsignedInteger(logfile, log->segments[i]->first_idx, 0) < 0) {
+            return -1;
+        }
+    }
 
-    e->term = strtoul(re->elements[1].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    return 0;
+}
+
+/* Atomically rewrites the metadata file with the current header, and with a
+ * manifest that lists the segments starting at first_segment. Syncing the
+ * directory after the rename also makes segment files created since the
+ * last update durable.
+ */
+static int writeMetadata(RaftLog *log, int first_segment)
+{
+    size_t tmp_filename_len = strlen(log->filename) + 10;
+    char tmp_filename[tmp_filename_len];
+    snprintf(tmp_filename, tmp_filename_len - 1, "%s.tmp", log->filename);
+
+    FILE *file = fopen(tmp_filename, "w");
+    if (!file) {
+        LOG_ERROR("Raft Log: %s: %s", tmp_filename, strerror(errno));
+        return -1;
     }
 
-    e->id = strtoul(re->elements[2].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    if (writeLogHeader(file, log) < 0 ||
+        writeManifest(file, log, first_segment) < 0 ||
+        writeEnd(file, log->fsync_policy != RAFT_LOG_FSYNC_NEVER) < 0) {
+        LOG_ERROR("Raft Log: failed to write %s: %s", tmp_filename, strerror(errno));
+        fclose(file);
+        unlink(tmp_filename);
+        return -1;
     }
 
-    e->type = strtoul(re->elements[3].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    if (fclose(file) < 0 || rename(tmp_filename, log->filename) < 0) {
+        LOG_ERROR("Raft Log: failed to update %s: %s", log->filename, strerror(errno));
+        unlink(tmp_filename);
+        return -1;
     }
 
-    return e;
+    if (log->fsync_policy != RAFT_LOG_FSYNC_NEVER && syncDir(log->filename) < 0) {
+        LOG_ERROR("Raft Log: failed to sync directory of %s: %s", log->filename, strerror(errno));
+        return -1;
+    }
 
-error:
-    raft_entry_release(e);
-    return NULL;
+    return 0;
+}
+
+static int updateLogHeader(RaftLog *log)
+{
+    return writeMetadata(log, 0);
+}
+
+/* Makes unlinking segments durable. The manifest no longer lists them, so
+ * should this fail they are merely left behind.
+ */
+static void syncRemovedSegments(RaftLog *log)
+{
+    if (log->fsync_policy != RAFT_LOG_FSYNC_NEVER && syncDir(log->filename) < 0) {
+        LOG_ERROR("Raft Log: failed to sync directory of %s: %s", log->filename, strerror(errno));
+    }
 }
 
 static int handleHeader(RaftLog *log, RawLogEntry *re)
@@ -549,10 +900,11 @@ static int handleHeader(RaftLog *log, RawLogEntry *re)
 
     char *eptr;
     unsigned long ver = strtoul(re->elements[1].ptr, &eptr, 10);
-    if (*eptr != '\0' || ver != RAFTLOG_VERSION) {
+    if (*eptr != '\0' || ver < 1 || ver > RAFTLOG_VERSION) {
         LOG_ERROR("Invalid Raft header version: %lu", ver);
         return -1;
     }
+    log->version = ver;
 
     if (strlen(re->elements[2].ptr) > RAFT_DBID_LEN) {
         LOG_ERROR("Invalid Raft log dbid: %s", (char *) re->elements[2].ptr);
@@ -593,211 +945,954 @@ static int handleHeader(RaftLog *log, RawLogEntry *re)
     return 0;
 }
 
-RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config, int flags)
+static int handleManifest(RaftLog *log, RawLogEntry *re, int flags)
 {
-    RaftLog *log = prepareLog(filename, config, flags);
-    RawLogEntry *e = NULL;
+    int i;
 
-    if (!log) {
-        return NULL;
+    if (re->num_elements < 1 || strcmp(re->elements[0].ptr, "SEGMENTS")) {
+        LOG_ERROR("Invalid Raft log manifest.");
+        return -1;
+    }
+
+    for (i = 1; i < re->num_elements; i++) {
+        char *eptr;
+        raft_index_t first_idx = strtoul(re->elements[i].ptr, &eptr, 10);
+        if (*eptr != '\0' || !first_idx) {
+            LOG_ERROR("Invalid Raft log segment: %s", (char *) re->elements[i].ptr);
+            return -1;
+        }
+
+        RaftLogSegment *seg = openSegment(log, first_idx, false, flags);
+        if (!seg) {
+            return -1;
+        }
+        addSegment(log, seg);
+    }
+
+    return 0;
+}
+
+static RaftLog *allocLog(const char *filename, RedisRaftConfig *config)
+{
+    RaftLog *log = RedisModule_Calloc(1, sizeof(RaftLog));
+    log->filename = filename;
+    log->sealed_fd = -1;
+
+    /* Config */
+    if (config) {
+        log->fsync_policy = config->raft_log_fsync_policy;
+        log->preallocate = config->raft_log_preallocate;
+        log->segment_size = config->raft_log_segment_size;
+    } else {
+        log->fsync_policy = RAFT_LOG_FSYNC_ALWAYS;
+        log->segment_size = REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE;
+    }
+
+    return log;
+}
+
+static RaftLog *createLog(const char *filename, const char *dbid, raft_term_t snapshot_term,
+        raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote,
+        raft_node_id_t node_id, RedisRaftConfig *config)
+{
+    /* Drop any previous log */
+    RaftLogRemoveFiles(filename);
+
+    RaftLog *log = allocLog(filename, config);
+
+    log->version = RAFTLOG_VERSION;
+    log->index = log->snapshot_last_idx = snapshot_index;
+    log->snapshot_last_term = snapshot_term;
+    log->term = current_term;
+    log->vote = last_vote;
+
+    memcpy(log->dbid, dbid, RAFT_DBID_LEN);
+    log->dbid[RAFT_DBID_LEN] = '\0';
+    log->node_id = node_id;
+
+    RaftLogSegment *seg = openSegment(log, snapshot_index + 1, true, 0);
+    if (!seg) {
+        goto error;
+    }
+    addSegment(log, seg);
+
+    if (writeMetadata(log, 0) < 0) {
+        goto error;
+    }
+
+    return log;
+
+error:
+    LOG_ERROR("Failed to create Raft log: %s: %s", filename, strerror(errno));
+    RaftLogClose(log);
+    return NULL;
+}
+
+RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term,
+        raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config)
+{
+    return createLog(filename, dbid, snapshot_term, snapshot_index, current_term,
+                     last_vote, config->id, config);
+}
+
+static raft_entry_t *parseRaftLogEntry(RawLogEntry *re)
+{
+    char *eptr;
+    raft_entry_t *e;
+
+    if (re->num_elements != 5) {
+        LOG_ERROR("Log entry: invalid number of arguments: %d", re->num_elements);
+        return NULL;
+    }
+
+    e = raft_entry_new(re->elements[4].len);
+    memcpy(e->data, re->elements[4].ptr, re->elements[4].len);
+
+    e->term = strtoul(re->elements[1].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    e->id = strtoul(re->elements[2].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    e->type = strtoul(re->elements[3].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    return e;
+
+error:
+    raft_entry_release(e);
+    return NULL;
+}
+
+/* Reads an entry from a version 1 or 2 log file, which holds the header and
+ * all entries in a single file. Returns 1 if an entry was read, 0 at the end
+ * of the file and -1 if the entry is invalid.
+ */
+static int readLegacyEntry(uint32_t version, FILE *file, off_t offset, size_t size, raft_entry_t **entry)
+{
+    RawLogEntry *re;
+
+    if (version > 1) {
+        return readEntry(file, offset, size, entry);
+    }
+
+    *entry = NULL;
+    if (readRawLogEntry(file, &re) < 0) {
+        return 0;
+    }
+
+    if (!re->num_elements || strcasecmp(re->elements[0].ptr, "ENTRY") != 0) {
+        LOG_ERROR("Invalid log entry: %s",
+                  re->num_elements ? (char *) re->elements[0].ptr : "");
+        freeRawLogEntry(re);
+        return -1;
+    }
+
+    *entry = parseRaftLogEntry(re);
+    freeRawLogEntry(re);
+
+    return *entry ? 1 : -1;
+}
+
+/* Converts a version 1 or 2 log, which was renamed to legacy_filename, to
+ * the current segmented format. If the process fails before completing, the
+ * conversion is restarted the next time the log is opened.
+ */
+static RaftLog *convertLegacyLog(const char *filename, const char *legacy_filename, RedisRaftConfig *config)
+{
+    RaftLog *log = NULL;
+    RawLogEntry *re = NULL;
+    RaftLog hdr = { 0 };
+    unsigned long num_entries = 0;
+
+    FILE *file = fopen(legacy_filename, "r");
+    if (!file) {
+        LOG_ERROR("Raft Log: %s: %s", legacy_filename, strerror(errno));
+        return NULL;
+    }
+
+    if (readRawLogEntry(file, &re) < 0 || handleHeader(&hdr, re) < 0) {
+        LOG_ERROR("Failed to read Raft log: %s", legacy_filename);
+        goto exit;
+    }
+
+    log = createLog(filename, hdr.dbid, hdr.snapshot_last_term, hdr.snapshot_last_idx,
+                    hdr.term, hdr.vote, hdr.node_id, config);
+    if (!log) {
+        goto exit;
+    }
+
+    off_t entries_offset = ftell(file);
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, entries_offset, SEEK_SET);
+
+    while (1) {
+        raft_entry_t *e;
+        int ret = readLegacyEntry(hdr.version, file, ftell(file), size, &e);
+
+        if (!ret) {
+            break;
+        }
+        if (ret < 0 || RaftLogAppend(log, e) != RR_OK) {
+            if (e) {
+                raft_entry_release(e);
+            }
+            LOG_ERROR("Failed to convert Raft log: %s", legacy_filename);
+            RaftLogClose(log);
+            log = NULL;
+            goto exit;
+        }
+
+        raft_entry_release(e);
+        num_entries++;
+    }
+
+    if (RaftLogSync(log) != RR_OK) {
+        RaftLogClose(log);
+        log = NULL;
+        goto exit;
+    }
+
+    LOG_INFO("Raft Log: converted version %u log with %lu entries", hdr.version, num_entries);
+
+    char *idx_filename = getIndexFilename(filename);
+    unlink(legacy_filename);
+    unlink(idx_filename);
+    RedisModule_Free(idx_filename);
+
+exit:
+    freeRawLogEntry(re);
+    fclose(file);
+    return log;
+}
+
+RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config, int flags)
+{
+    RawLogEntry *e = NULL;
+    RaftLog *log = NULL;
+
+    size_t legacy_filename_len = strlen(filename) + 10;
+    char legacy_filename[legacy_filename_len];
+    snprintf(legacy_filename, legacy_filename_len - 1, "%s.legacy", filename);
+
+    /* Resume an interrupted conversion */
+    if (access(legacy_filename, F_OK) == 0) {
+        return convertLegacyLog(filename, legacy_filename, config);
+    }
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return NULL;
     }
 
     /* Gracefully skip an empty file */
-    fseek(log->file, 0L, SEEK_END);
-    if (!ftell(log->file)) {
+    fseek(file, 0L, SEEK_END);
+    if (!ftell(file)) {
         goto error;
     }
 
     /* Read start */
-    fseek(log->file, 0L, SEEK_SET);
+    fseek(file, 0L, SEEK_SET);
 
-    if (readRawLogEntry(log, &e) < 0) {
+    log = allocLog(filename, config);
+    if (readRawLogEntry(file, &e) < 0) {
         LOG_ERROR("Failed to read Raft log: %s", errno ? strerror(errno) : "invalid data");
         goto error;
     }
 
-    if (handleHeader(log, e) < 0) {
-        goto error;
+    if (handleHeader(log, e) < 0) {
+        goto error;
+    }
+    freeRawLogEntry(e);
+    e = NULL;
+
+    if (log->version < 3) {
+        fclose(file);
+        RaftLogClose(log);
+
+        if (rename(filename, legacy_filename) < 0) {
+            LOG_ERROR("Failed to rename Raft log %s to %s: %s",
+                      filename, legacy_filename, strerror(errno));
+            return NULL;
+        }
+        return convertLegacyLog(filename, legacy_filename, config);
+    }
+
+    if (readRawLogEntry(file, &e) < 0 || handleManifest(log, e, flags) < 0) {
+        LOG_ERROR("Failed to read Raft log manifest: %s", filename);
+        goto error;
+    }
+    freeRawLogEntry(e);
+    fclose(file);
+
+    /* A log may have no segments if it was interrupted while being reset */
+    if (!log->num_segments) {
+        RaftLogSegment *seg = openSegment(log, log->snapshot_last_idx + 1, true, 0);
+        if (!seg) {
+            RaftLogClose(log);
+            return NULL;
+        }
+        addSegment(log, seg);
+        if (writeMetadata(log, 0) < 0) {
+            RaftLogClose(log);
+            return NULL;
+        }
+    }
+
+    return log;
+
+error:
+    if (e != NULL) {
+        freeRawLogEntry(e);
+    }
+    if (log) {
+        RaftLogClose(log);
+    }
+    fclose(file);
+    return NULL;
+}
+
+RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term)
+{
+    int i;
+
+    /* The log is rewritten from scratch, so it can use the latest format */
+    log->version = RAFTLOG_VERSION;
+    log->index = log->snapshot_last_idx = index;
+    log->snapshot_last_term = term;
+    if (log->term > term) {
+        log->term = term;
+        log->vote = -1;
+    }
+    log->num_entries = 0;
+    log->unsynced_entries = 0;
+
+    /* Record that no segments exist before removing them, then start over
+     * with a single empty segment.
+     */
+    if (writeMetadata(log, log->num_segments) < 0) {
+        return RR_ERROR;
+    }
+
+    for (i = 0; i < log->num_segments; i++) {
+        removeSegment(log->segments[i]);
+    }
+    log->num_segments = 0;
+
+    RaftLogSegment *seg = openSegment(log, index + 1, true, 0);
+    if (!seg) {
+        return RR_ERROR;
+    }
+    addSegment(log, seg);
+
+    if (writeMetadata(log, 0) < 0) {
+        return RR_ERROR;
+    }
+
+    updateFileSize(log);
+    return RR_OK;
+}
+
+/* Parses the header of the entry at the specified offset of a mapped segment
+ * of the specified size.
+ *
+ * Returns the total size of the entry, or 0 if no complete entry is found.
+ */
+static size_t parseEntryHeader(const char *map, size_t size, off_t offset, EntryHeader *hdr)
+{
+    if ((size_t) offset + sizeof(*hdr) > size) {
+        return 0;
+    }
+
+    memcpy(hdr, map + offset, sizeof(*hdr));
+    if (hdr->magic != RAFTLOG_ENTRY_MAGIC || hdr->len > size - offset - sizeof(*hdr)) {
+        return 0;
+    }
+
+    return sizeof(*hdr) + hdr->len;
+}
+
+/* Returns true if a valid entry starts anywhere after the specified offset,
+ * which means the data there is not just a partially written tail.
+ */
+static bool hasValidEntryAfter(const char *map, size_t size, off_t offset)
+{
+    uint32_t magic = RAFTLOG_ENTRY_MAGIC;
+    const char *p = map + offset + 1;
+    const char *end = map + size;
+
+    while (p < end && (p = memmem(p, end - p, &magic, sizeof(magic))) != NULL) {
+        EntryHeader hdr;
+
+        if (parseEntryHeader(map, size, p - map, &hdr) &&
+            entryChecksum(&hdr, p + sizeof(hdr)) == hdr.crc) {
+            return true;
+        }
+        p++;
+    }
+
+    return false;
+}
+
+/* Loads a segment in a single pass over its memory mapped file, calling the
+ * callback for entries not included in the snapshot.
+ *
+ * A kept index is used as long as it matches the entries found. As segments
+ * are synced and trimmed before a new one is started, entries of a matching
+ * earlier segment are not checksummed again. Otherwise, offsets are collected
+ * and written to the index at once when done.
+ *
+ * Returns the number of entries loaded, or a negative value on error.
+ */
+static int loadSegment(RaftLog *log, RaftLogSegment *seg, bool last,
+                       int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg)
+{
+    bool verify = last || !seg->index_kept;
+    off_t *offsets = NULL;
+    size_t offsets_len = 0;
+    size_t offsets_size = 0;
+    size_t rebuild_from = 0;
+    raft_entry_t *e = NULL;
+    unsigned int e_size = 0;
+    raft_index_t idx = seg->first_idx - 1;
+    off_t offset = 0;
+    char *map = NULL;
+    int ret = 0;
+
+    seg->num_entries = 0;
+    if (seg->size > 0) {
+        map = mmap(NULL, seg->size, PROT_READ, MAP_PRIVATE, fileno(seg->file), 0);
+        if (map == MAP_FAILED) {
+            LOG_ERROR("Raft Log: %s: failed to map: %s", seg->filename, strerror(errno));
+            return -1;
+        }
+        madvise(map, seg->size, MADV_SEQUENTIAL);
+    }
+
+    while ((size_t) offset < seg->size) {
+        EntryHeader hdr;
+        size_t len = parseEntryHeader(map, seg->size, offset, &hdr);
+
+        if (!verify && (!len || seg->num_entries >= seg->index_size ||
+                        seg->index[seg->num_entries] != offset)) {
+            verify = true;
+        }
+
+        if (verify) {
+            if (!len || entryChecksum(&hdr, map + offset + sizeof(hdr)) != hdr.crc) {
+                /* Drop a torn or partially written tail, so new entries are
+                 * appended right after the last valid one. Earlier segments
+                 * are synced and trimmed before a new one is started, so this
+                 * is only expected at the end of the log. Invalid data that
+                 * is followed by a valid entry is corruption rather than a
+                 * tail, and dropping it would lose entries.
+                 *
+                 * Preallocated space is dropped as well and allocated again,
+                 * so no stale data may follow new entries.
+                 */
+                if (!last || hasValidEntryAfter(map, seg->size, offset)) {
+                    LOG_ERROR("Raft Log: %s: invalid data at offset %lu",
+                              seg->filename, (unsigned long) offset);
+                    ret = -1;
+                    goto exit;
+                }
+
+                if (!isPreallocated(seg, offset)) {
+                    LOG_INFO("Raft Log: truncating %lu bytes of incomplete data at offset %lu",
+                             (unsigned long) (seg->size - offset), (unsigned long) offset);
+                }
+                munmap(map, seg->size);
+                map = NULL;
+
+                if (ftruncate(fileno(seg->file), offset) < 0) {
+                    LOG_ERROR("Raft Log: failed to truncate: %s", strerror(errno));
+                    ret = -1;
+                    goto exit;
+                }
+                seg->size = offset;
+                preallocateSegment(log, seg);
+                break;
+            }
+
+            if (!offsets_len) {
+                rebuild_from = seg->num_entries;
+            }
+            if (offsets_len == offsets_size) {
+                offsets_size = offsets_size ? offsets_size * 2 : SEGMENT_INDEX_INIT_SIZE;
+                offsets = RedisModule_Realloc(offsets, offsets_size * sizeof(off_t));
+            }
+            offsets[offsets_len++] = offset;
+        }
+
+        idx++;
+        seg->num_entries++;
+
+        /* Skip entries already included in the snapshot */
+        if (idx > log->snapshot_last_idx) {
+            log->index = idx;
+            ret++;
+
+            if (callback) {
+                /* The entry is reused unless the callback holds on to it */
+                if (!e || e->refs > 1 || e_size < hdr.len) {
+                    if (e) {
+                        raft_entry_release(e);
+                    }
+                    e = raft_entry_new(hdr.len);
+                    e_size = hdr.len;
+                }
+                e->term = hdr.term;
+                e->id = hdr.id;
+                e->type = hdr.type;
+                e->data_len = hdr.len;
+                memcpy(e->data, map + offset + sizeof(hdr), hdr.len);
+
+                int cb_ret = callback(callback_arg, e, idx);
+                if (cb_ret < 0) {
+                    ret = cb_ret;
+                    goto exit;
+                }
+            }
+        }
+
+        offset += len;
+    }
+
+    if (offsets_len) {
+        if (seg->index_size < seg->num_entries && mapIndex(seg, seg->num_entries) < 0) {
+            ret = -1;
+            goto exit;
+        }
+        memcpy(seg->index + rebuild_from, offsets, offsets_len * sizeof(off_t));
+        log->index_rebuilds++;
+    }
+
+exit:
+    if (map) {
+        munmap(map, seg->size);
+    }
+    if (e) {
+        raft_entry_release(e);
+    }
+    if (offsets) {
+        RedisModule_Free(offsets);
+    }
+
+    return ret;
+}
+
+int RaftLogLoadEntries(RaftLog *log, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg)
+{
+    raft_index_t next_idx = log->segments[0]->first_idx;
+    int ret = 0;
+    int i;
+
+    log->index = log->snapshot_last_idx;
+
+    if (next_idx > log->snapshot_last_idx + 1) {
+        LOG_ERROR("Raft Log: first segment starts at %lu, expected up to %lu",
+                  log->segments[0]->first_idx, log->snapshot_last_idx + 1);
+        return -1;
+    }
+
+    for (i = 0; i < log->num_segments; i++) {
+        RaftLogSegment *seg = log->segments[i];
+
+        if (seg->first_idx != next_idx) {
+            LOG_ERROR("Raft Log: segment %s does not start at index %lu",
+                      seg->filename, next_idx);
+            return -1;
+        }
+
+        int n = loadSegment(log, seg, i == log->num_segments - 1, callback, callback_arg);
+        if (n < 0) {
+            return n;
+        }
+
+        ret += n;
+        next_idx = seg->first_idx + seg->num_entries;
+    }
+
+    log->num_entries = ret;
+    updateFileSize(log);
+
+    return ret;
+}
+
+/* Syncs the previous segment left behind by startSegment(), if any */
+static int syncSealedSegment(RaftLog *log)
+{
+    if (log->sealed_fd == -1) {
+        return 0;
+    }
+
+    int ret = syncFile(log->sealed_fd);
+    close(log->sealed_fd);
+    log->sealed_fd = -1;
+    if (ret < 0) {
+        return -1;
+    }
+
+    log->fsync_count++;
+    return 0;
+}
+
+/* Starts a new active segment for entries following the current index */
+static RRStatus startSegment(RaftLog *log)
+{
+    /* Entries in the current segment must be durable before those of the new
+     * one are acknowledged. Rather than syncing it here, a duplicate of its
+     * fd is kept and synced along with the new segment, by RaftLogSync() or
+     * the log writer thread. A segment sealed earlier that was not handed
+     * over yet is synced right away, which only happens when segments fill
+     * up faster than the log is synced.
+     *
+     * Unused preallocated space is trimmed, as only the last segment may end
+     * with it.
+     */
+    RaftLogSegment *prev = activeSegment(log);
+    if (fflush(prev->file) < 0 ||
+        ftruncate(fileno(prev->file), prev->size) < 0) {
+        return RR_ERROR;
+    }
+    if (log->fsync_policy != RAFT_LOG_FSYNC_NEVER) {
+        if (syncSealedSegment(log) < 0 ||
+            (log->sealed_fd = dup(fileno(prev->file))) < 0) {
+            return RR_ERROR;
+        }
+    }
+
+    RaftLogSegment *seg = openSegment(log, log->index + 1, true, 0);
+    if (!seg) {
+        return RR_ERROR;
+    }
+    addSegment(log, seg);
+
+    if (writeMetadata(log, 0) < 0) {
+        log->num_segments--;
+        removeSegment(seg);
+        return RR_ERROR;
+    }
+
+    return RR_OK;
+}
+
+/* Flushes the log and, unless the fsync policy is 'never', makes all entries
+ * written since the last sync durable with a single fsync() call, or two if
+ * a new segment was started meanwhile.
+ */
+RRStatus RaftLogSync(RaftLog *log)
+{
+    RaftLogSegment *seg = activeSegment(log);
+    bool use_fsync = log->fsync_policy != RAFT_LOG_FSYNC_NEVER && log->unsynced_entries > 0;
+
+    if (syncSealedSegment(log) < 0 || writeEnd(seg->file, use_fsync) < 0) {
+        return RR_ERROR;
+    }
+    if (use_fsync) {
+        log->fsync_count++;
+    }
+    log->unsynced_entries = 0;
+    return RR_OK;
+}
+
+/*
+ * Log writer thread.
+ *
+ * Syncing the log may stall for a long time on a busy disk, so it is done by
+ * a dedicated thread rather than the Raft thread. The Raft thread writes and
+ * flushes entries, and then asks the writer to sync them. Meanwhile it keeps
+ * sending AppendEntries and heartbeats, and handling requests. Once a sync
+ * completes, the writer calls the notify callback and the Raft thread picks up
+ * the new synced index.
+ *
+ * The writer syncs a duplicate of the active segment's file descriptor, so it
+ * is not affected by segments being closed in the meantime. When a new
+ * segment was started since the last sync, the previous one is synced first,
+ * so together they cover all entries.
+ */
+
+static void logWriterThread(void *arg)
+{
+    RaftLogWriter *w = (RaftLogWriter *) arg;
+
+    uv_mutex_lock(&w->mutex);
+    while (1) {
+        while (w->pending_fd == -1 && !w->exit) {
+            uv_cond_wait(&w->cond, &w->mutex);
+        }
+        if (w->exit) {
+            break;
+        }
+
+        int fd = w->pending_fd;
+        int sealed_fd = w->pending_sealed_fd;
+        w->pending_fd = -1;
+        w->pending_sealed_fd = -1;
+        w->inflight_idx = w->pending_idx;
+        uv_mutex_unlock(&w->mutex);
+
+        if ((sealed_fd != -1 && syncFile(sealed_fd) < 0) || syncFile(fd) < 0) {
+            PANIC("Failed to sync Raft log: %s", strerror(errno));
+        }
+        if (sealed_fd != -1) {
+            close(sealed_fd);
+        }
+        close(fd);
+
+        uv_mutex_lock(&w->mutex);
+        if (w->inflight_idx > w->synced_idx) {
+            w->synced_idx = w->inflight_idx;
+        }
+        w->inflight_idx = 0;
+        w->fsync_count += sealed_fd != -1 ? 2 : 1;
+        uv_mutex_unlock(&w->mutex);
+
+        w->notify(w->notify_arg);
+
+        uv_mutex_lock(&w->mutex);
+    }
+    uv_mutex_unlock(&w->mutex);
+}
+
+RaftLogWriter *RaftLogWriterNew(void (*notify)(void *arg), void *notify_arg)
+{
+    RaftLogWriter *w = RedisModule_Calloc(1, sizeof(RaftLogWriter));
+    w->pending_fd = -1;
+    w->pending_sealed_fd = -1;
+    w->notify = notify;
+    w->notify_arg = notify_arg;
+
+    uv_mutex_init(&w->mutex);
+    uv_cond_init(&w->cond);
+    if (uv_thread_create(&w->thread, logWriterThread, w) < 0) {
+        PANIC("Failed to start Raft log writer thread");
     }
 
-    freeRawLogEntry(e);
-    return log;
+    return w;
+}
 
-error:
-    if (e != NULL) {
-        freeRawLogEntry(e);
+/* Stops the writer thread, waiting for a sync in progress to complete. Syncs
+ * queued afterwards are not performed, but the writer remains safe to use.
+ */
+void RaftLogWriterStop(RaftLogWriter *w)
+{
+    uv_mutex_lock(&w->mutex);
+    if (w->exit) {
+        uv_mutex_unlock(&w->mutex);
+        return;
     }
-    RaftLogClose(log);
-    return NULL;
+    w->exit = true;
+    uv_cond_signal(&w->cond);
+    uv_mutex_unlock(&w->mutex);
+
+    uv_thread_join(&w->thread);
 }
 
-RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term)
+void RaftLogWriterFree(RaftLogWriter *w)
 {
-    log->index = log->snapshot_last_idx = index;
-    log->snapshot_last_term = term;
-    if (log->term > term) {
-        log->term = term;
-        log->vote = -1;
+    RaftLogWriterStop(w);
+    if (w->pending_fd != -1) {
+        close(w->pending_fd);
+    }
+    if (w->pending_sealed_fd != -1) {
+        close(w->pending_sealed_fd);
     }
 
-    if (ftruncate(fileno(log->file), 0) < 0 ||
-        ftruncate(fileno(log->idxfile), 0) < 0 ||
-        writeLogHeader(log->file, log) < 0) {
+    uv_cond_destroy(&w->cond);
+    uv_mutex_destroy(&w->mutex);
+    RedisModule_Free(w);
+}
+
+/* Hands the entries appended since the last sync over to the writer thread,
+ * superseding a sync that has not started yet. A sealed segment is handed
+ * over as well; should the pending sync still hold an earlier one, that one
+ * is synced here instead.
+ */
+static RRStatus queueSync(RaftLogWriter *w, RaftLog *log)
+{
+    RaftLogSegment *seg = activeSegment(log);
+    int fd;
 
+    if (fflush(seg->file) < 0 || (fd = dup(fileno(seg->file))) < 0) {
         return RR_ERROR;
     }
 
+    uv_mutex_lock(&w->mutex);
+    if (log->sealed_fd != -1) {
+        if (w->pending_sealed_fd != -1) {
+            if (syncFile(w->pending_sealed_fd) < 0) {
+                uv_mutex_unlock(&w->mutex);
+                close(fd);
+                return RR_ERROR;
+            }
+            close(w->pending_sealed_fd);
+            log->fsync_count++;
+        }
+        w->pending_sealed_fd = log->sealed_fd;
+        log->sealed_fd = -1;
+    }
+    if (w->pending_fd != -1) {
+        close(w->pending_fd);
+    }
+    w->pending_fd = fd;
+    w->pending_idx = log->index;
+    uv_cond_signal(&w->cond);
+    uv_mutex_unlock(&w->mutex);
+
+    log->unsynced_entries = 0;
     return RR_OK;
 }
 
-int RaftLogLoadEntries(RaftLog *log, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg)
+/* Syncs entries appended since the last call according to the fsync policy.
+ * With 'always', they are handed over to the writer thread and acknowledged
+ * once synced. Otherwise they are acknowledged once flushed; 'everysec'
+ * leaves syncing them to RaftLogWriterFlush(), and 'never' to the OS.
+ */
+RRStatus RaftLogWriterSync(RaftLogWriter *w, RaftLog *log)
 {
-    int ret = 0;
+    RaftLogSegment *seg = activeSegment(log);
 
-    if (fseek(log->file, 0, SEEK_SET) < 0) {
-        return -1;
+    if (!log->unsynced_entries) {
+        return RR_OK;
     }
 
-    log->term = 1;
-    log->index = 0;
-
-    /* Read Header */
-    RawLogEntry *re = NULL;
-    if (readRawLogEntry(log, &re) < 0 || handleHeader(log, re) < 0)  {
-        freeRawLogEntry(re);
-        LOG_INFO("Failed to read Raft log header");
-        return -1;
+    if (log->fsync_policy == RAFT_LOG_FSYNC_ALWAYS) {
+        return queueSync(w, log);
     }
-    freeRawLogEntry(re);
 
-    /* Read Entries */
-    do {
-        raft_entry_t *e = NULL;
+    if (fflush(seg->file) < 0) {
+        return RR_ERROR;
+    }
 
-        long offset = ftell(log->file);
-        if (readRawLogEntry(log, &re) < 0 || !re->num_elements) {
-            break;
-        }
+    uv_mutex_lock(&w->mutex);
+    if (log->index > w->synced_idx) {
+        w->synced_idx = log->index;
+    }
+    uv_mutex_unlock(&w->mutex);
 
-        if (!strcasecmp(re->elements[0].ptr, "ENTRY")) {
-            e = parseRaftLogEntry(re);
-            if (!e) {
-                freeRawLogEntry(re);
-                ret = -1;
-                break;
-            }
-            log->index++;
-            ret++;
+    if (log->fsync_policy == RAFT_LOG_FSYNC_NEVER) {
+        log->unsynced_entries = 0;
+    }
+    return RR_OK;
+}
 
-            updateIndex(log, log->index, offset);
-        } else {
-            LOG_ERROR("Invalid log entry: %s", (char *) re->elements[0].ptr);
-            freeRawLogEntry(re);
+/* Called periodically to sync entries that were acknowledged without being
+ * synced, when using the 'everysec' policy.
+ */
+RRStatus RaftLogWriterFlush(RaftLogWriter *w, RaftLog *log)
+{
+    if (log->fsync_policy != RAFT_LOG_FSYNC_EVERYSEC || !log->unsynced_entries) {
+        return RR_OK;
+    }
 
-            ret = -1;
-            break;
-        }
+    return queueSync(w, log);
+}
 
-        int cb_ret = 0;
-        if (callback) {
-            callback(callback_arg, e, log->index);
-        }
+raft_index_t RaftLogWriterSyncedIdx(RaftLogWriter *w)
+{
+    uv_mutex_lock(&w->mutex);
+    raft_index_t idx = w->synced_idx;
+    uv_mutex_unlock(&w->mutex);
 
-        freeRawLogEntry(re);
-        raft_entry_release(e);
+    return idx;
+}
 
-        if (cb_ret < 0) {
-            ret = cb_ret;
-            break;
-        }
-    } while(1);
+unsigned long long RaftLogWriterFsyncCount(RaftLogWriter *w)
+{
+    uv_mutex_lock(&w->mutex);
+    unsigned long long count = w->fsync_count;
+    uv_mutex_unlock(&w->mutex);
 
-    if (ret > 0) {
-        log->num_entries = ret;
-    }
-    return ret;
+    return count;
 }
 
-RRStatus RaftLogWriteEntry(RaftLog *log, raft_entry_t *entry)
+/* Entries beyond the specified index were removed from the log, so syncs
+ * that are pending or in progress no longer cover them.
+ */
+void RaftLogWriterTruncate(RaftLogWriter *w, raft_index_t idx)
 {
-    size_t written = 0;
-    int n;
-
-    if ((n = writeBegin(log->file, 5)) < 0) {
-        return RR_ERROR;
-    }
-    written += n;
-    if ((n = writeBuffer(log->file, "ENTRY", 5)) < 0) {
-        return RR_ERROR;
-    }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->term, 0)) < 0) {
-        return RR_ERROR;
-    }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->id, 0)) < 0) {
-        return RR_ERROR;
+    uv_mutex_lock(&w->mutex);
+    if (w->synced_idx > idx) {
+        w->synced_idx = idx;
     }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->type, 0)) < 0) {
-        return RR_ERROR;
+    if (w->pending_idx > idx) {
+        w->pending_idx = idx;
     }
-    written += n;
-    if ((n = writeBuffer(log->file, entry->data, entry->data_len)) < 0) {
-        return RR_ERROR;
+    if (w->inflight_idx > idx) {
+        w->inflight_idx = idx;
     }
-    written += n;
+    uv_mutex_unlock(&w->mutex);
+}
 
-    /* Update index */
-    log->file_size = ftell(log->file);
-    off_t offset = log->file_size - written;
-    log->index++;
-    if (updateIndex(log, log->index, offset) < 0) {
-        return RR_ERROR;
-    }
+/* The log was reset or loaded, and is durable up to the specified index */
+void RaftLogWriterReset(RaftLogWriter *w, raft_index_t idx)
+{
+    RaftLogWriterTruncate(w, idx);
 
-    return RR_OK;
+    uv_mutex_lock(&w->mutex);
+    w->synced_idx = idx;
+    uv_mutex_unlock(&w->mutex);
 }
 
-RRStatus RaftLogSync(RaftLog *log)
+/* Appends an entry to the log. The entry is flushed but not synced; callers
+ * are expected to group appends and sync them, using RaftLogSync() or
+ * RaftLogWriterSync(), before acknowledging them.
+ */
+RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry)
 {
-    if (writeEnd(log->file, log->fsync) < 0) {
+    RaftLogSegment *seg = activeSegment(log);
+    int n;
+
+    if (log->segment_size && seg->num_entries > 0 && seg->size >= log->segment_size) {
+        if (startSegment(log) != RR_OK) {
+            return RR_ERROR;
+        }
+        seg = activeSegment(log);
+    }
+
+    off_t offset = seg->size;
+    if (fseek(seg->file, offset, SEEK_SET) < 0 ||
+        (n = writeEntry(seg->file, entry)) < 0 ||
+        writeEnd(seg->file, false) < 0) {
         return RR_ERROR;
     }
-    return RR_OK;
-}
 
-RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry)
-{
-    if (RaftLogWriteEntry(log, entry) != RR_OK ||
-            writeEnd(log->file, log->fsync) < 0) {
+    if (updateIndex(seg, log->index + 1, offset) < 0) {
         return RR_ERROR;
     }
 
+    seg->size += n;
+    seg->num_entries++;
+    log->file_size += n;
+    log->index++;
     log->num_entries++;
+    log->unsynced_entries++;
+
     return RR_OK;
 }
 
-static off_t seekEntry(RaftLog *log, raft_index_t idx)
+static off_t seekEntry(RaftLog *log, raft_index_t idx, RaftLogSegment **seg)
 {
     /* Bounds check */
-    if (idx <= log->snapshot_last_idx) {
-        return 0;
-    }
-
-    if (idx > log->snapshot_last_idx + log->num_entries) {
-        return 0;
+    if (idx <= log->snapshot_last_idx || idx > log->index) {
+        return -1;
     }
 
-    raft_index_t relidx = idx - log->snapshot_last_idx;
-    off_t offset;
-    if (fseek(log->idxfile, sizeof(off_t) * relidx, SEEK_SET) < 0 ||
-            fread(&offset, sizeof(offset), 1, log->idxfile) != 1) {
-        return 0;
+    if (!(*seg = findSegment(log, idx))) {
+        return -1;
     }
 
-    if (fseek(log->file, offset, SEEK_SET) < 0) {
-        return 0;
+    off_t offset = readIndex(*seg, idx);
+    if (offset < 0 || fseek((*seg)->file, offset, SEEK_SET) < 0) {
+        return -1;
     }
 
     return offset;
@@ -805,71 +1900,180 @@ static off_t seekEntry(RaftLog *log, raft_index_t idx)
 
 raft_entry_t *RaftLogGet(RaftLog *log, raft_index_t idx)
 {
-    if (seekEntry(log, idx) <= 0) {
+    RaftLogSegment *seg;
+    raft_entry_t *e;
+    off_t offset;
+
+    if ((offset = seekEntry(log, idx, &seg)) < 0) {
         return NULL;
     }
 
-    RawLogEntry *re;
-    if (readRawLogEntry(log, &re) != RR_OK) {
+    if (!readEntry(seg->file, offset, seg->size, &e)) {
         return NULL;
     }
 
-    raft_entry_t *e = parseRaftLogEntry(re);
-    freeRawLogEntry(re);
+    return e;
+}
 
-    if (!e) {
-        return NULL;
+/* Reads up to entries_n consecutive entries, starting at the specified index.
+ *
+ * Entries are read from each segment in chunks of up to LOG_READ_AHEAD_SIZE
+ * (or a single larger entry) with one read, and decoded from the buffer.
+ *
+ * Returns the number of entries read.
+ */
+int RaftLogGetBatch(RaftLog *log, raft_index_t idx, int entries_n, raft_entry_t **entries)
+{
+    size_t read_size = LOG_READ_AHEAD_SIZE;
+    char *buf = NULL;
+    size_t buf_size = 0;
+    int n = 0;
+
+    while (n < entries_n && idx > log->snapshot_last_idx && idx <= log->index) {
+        RaftLogSegment *seg = findSegment(log, idx);
+        off_t start;
+
+        if (!seg || (start = readIndex(seg, idx)) < 0 || (size_t) start >= seg->size) {
+            break;
+        }
+
+        size_t len = seg->size - start;
+        if (len > read_size) {
+            len = read_size;
+        }
+        if (buf_size < len) {
+            buf_size = len;
+            buf = RedisModule_Realloc(buf, buf_size);
+        }
+
+        if (pread(fileno(seg->file), buf, len, start) != (ssize_t) len) {
+            LOG_ERROR("Raft Log: %s: failed to read: %s", seg->filename, strerror(errno));
+            break;
+        }
+
+        raft_index_t seg_end = seg->first_idx + seg->num_entries;
+        off_t offset = 0;
+        while (n < entries_n && idx < seg_end) {
+            EntryHeader hdr;
+            size_t entry_len = parseEntryHeader(buf, len, offset, &hdr);
+            if (!entry_len) {
+                break;
+            }
+
+            if (entryChecksum(&hdr, buf + offset + sizeof(hdr)) != hdr.crc) {
+                LOG_ERROR("Raft Log: %s: invalid entry at offset %lu",
+                          seg->filename, (unsigned long) (start + offset));
+                goto exit;
+            }
+
+            raft_entry_t *e = raft_entry_new(hdr.len);
+            e->term = hdr.term;
+            e->id = hdr.id;
+            e->type = hdr.type;
+            memcpy(e->data, buf + offset + sizeof(hdr), hdr.len);
+
+            entries[n++] = e;
+            idx++;
+            offset += entry_len;
+        }
+
+        /* An entry larger than the read size is read on its own */
+        if (!offset) {
+            EntryHeader hdr;
+            if (len < sizeof(hdr)) {
+                break;
+            }
+            memcpy(&hdr, buf, sizeof(hdr));
+
+            size_t entry_len = sizeof(hdr) + hdr.len;
+            if (hdr.magic != RAFTLOG_ENTRY_MAGIC || entry_len <= len ||
+                entry_len > seg->size - start) {
+                LOG_ERROR("Raft Log: %s: invalid entry at offset %lu",
+                          seg->filename, (unsigned long) start);
+                break;
+            }
+            read_size = entry_len;
+        } else {
+            read_size = LOG_READ_AHEAD_SIZE;
+        }
     }
 
-    return e;
+exit:
+    if (buf) {
+        RedisModule_Free(buf);
+    }
+
+    return n;
 }
 
 RRStatus RaftLogDelete(RaftLog *log, raft_index_t from_idx, func_entry_notify_f cb, void *cb_arg)
 {
-    off_t offset;
-    RRStatus ret = RR_OK;
-    unsigned long removed = 0;
+    raft_index_t idx;
+    int keep;
 
     if (from_idx <= log->snapshot_last_idx) {
         return RR_ERROR;
     }
 
-    while (log->index >= from_idx) {
-        if (!(offset = seekEntry(log, log->index))) {
-            return RR_ERROR;
+    if (cb) {
+        for (idx = log->index; idx >= from_idx; idx--) {
+            raft_entry_t *e = RaftLogGet(log, idx);
+            if (!e) {
+                return RR_ERROR;
+            }
+            cb(cb_arg, e, idx);
+            raft_entry_release(e);
         }
+    }
 
-        RawLogEntry *re;
-        raft_entry_t *e;
+    if (from_idx > log->index) {
+        return RR_OK;
+    }
 
-        if (readRawLogEntry(log, &re) < 0) {
-            ret = RR_ERROR;
+    /* Unlink whole segments first, then truncate the one holding from_idx */
+    for (keep = log->num_segments; keep > 1; keep--) {
+        if (log->segments[keep - 1]->first_idx < from_idx) {
             break;
         }
+    }
 
-        if (!strcasecmp(re->elements[0].ptr, "ENTRY")) {
-            if ((e = parseRaftLogEntry(re)) == NULL) {
-                freeRawLogEntry(re);
-                ret = RR_ERROR;
-                break;
-            }
-            if (cb) {
-                cb(cb_arg, e, log->index);
-            }
+    if (keep < log->num_segments) {
+        int removed = log->num_segments - keep;
 
-            removed++;
-            log->index--;
-            log->num_entries--;
+        log->num_segments = keep;
+        if (writeMetadata(log, 0) < 0) {
+            log->num_segments += removed;
+            return RR_ERROR;
+        }
 
-            raft_entry_release(e);
+        for (int i = keep; i < keep + removed; i++) {
+            removeSegment(log->segments[i]);
+        }
+        syncRemovedSegments(log);
+    }
 
-            ftruncate(fileno(log->file), offset);
+    RaftLogSegment *seg = activeSegment(log);
+    off_t offset = 0;
+    if (from_idx >= seg->first_idx + seg->num_entries) {
+        offset = seg->size;
+    } else if (from_idx > seg->first_idx) {
+        if ((offset = readIndex(seg, from_idx)) < 0) {
+            return RR_ERROR;
         }
+    }
 
-        freeRawLogEntry(re);
+    if (ftruncate(fileno(seg->file), offset) < 0) {
+        return RR_ERROR;
     }
 
-    return ret;
+    seg->size = offset;
+    preallocateSegment(log, seg);
+    seg->num_entries = from_idx - seg->first_idx;
+    log->index = from_idx - 1;
+    log->num_entries = log->index - log->snapshot_last_idx;
+    updateFileSize(log);
+
+    return RR_OK;
 }
 
 RRStatus RaftLogSetVote(RaftLog *log, raft_node_id_t vote)
@@ -912,97 +2116,116 @@ raft_index_t RaftLogCount(RaftLog *log)
  * Log compaction.
  */
 
-
-/* Rewrite the current log state into a new file:
- * 1. Latest snapshot info
- * 2. All entries
- * 3. Current term and vote
+/* Compacts the log after a snapshot that includes all entries up to and
+ * including last_idx. The new snapshot index and term are recorded in the
+ * metadata file, and then all head segments that hold no newer entries are
+ * unlinked. Remaining entries are never copied.
  */
-long long int RaftLogRewrite(RedisRaftCtx *rr, const char *filename, raft_index_t last_idx, raft_term_t last_term)
+RRStatus RaftLogCompact(RaftLog *log, raft_index_t last_idx, raft_term_t last_term)
 {
-    RaftLog *log = RaftLogCreate(filename, rr->snapshot_info.dbid,
-            last_term, last_idx,
-            raft_get_current_term(rr->raft),
-            raft_get_voted_for(rr->raft),
-            rr->config);
-    long long int num_entries = 0;
+    raft_index_t prev_idx = log->snapshot_last_idx;
+    raft_term_t prev_term = log->snapshot_last_term;
+    int i, drop = 0;
 
-    raft_index_t i;
-    for (i = last_idx + 1; i <= RaftLogCurrentIdx(rr->log); i++) {
-        num_entries++;
-        raft_entry_t *ety = raft_get_entry_from_idx(rr->raft, i);
-        if (RaftLogWriteEntry(log, ety) != RR_OK) {
-            RaftLogClose(log);
-            return -1;
-        }
-        raft_entry_release(ety);
+    if (last_idx > log->index) {
+        LOG_ERROR("Raft Log: cannot compact to index %lu, beyond last index %lu",
+                  last_idx, log->index);
+        return RR_ERROR;
     }
 
-    if (RaftLogSync(log) != RR_OK) {
-        RaftLogClose(log);
-        return -1;
+    while (drop < log->num_segments - 1 &&
+           log->segments[drop + 1]->first_idx <= last_idx + 1) {
+        drop++;
     }
 
-    RaftLogClose(log);
-    return num_entries;
+    log->snapshot_last_idx = last_idx;
+    log->snapshot_last_term = last_term;
+    if (writeMetadata(log, drop) < 0) {
+        log->snapshot_last_idx = prev_idx;
+        log->snapshot_last_term = prev_term;
+        return RR_ERROR;
+    }
+
+    for (i = 0; i < drop; i++) {
+        removeSegment(log->segments[i]);
+    }
+    if (drop) {
+        syncRemovedSegments(log);
+    }
+    log->num_segments -= drop;
+    memmove(log->segments, log->segments + drop, sizeof(RaftLogSegment *) * log->num_segments);
+
+    log->num_entries = log->index - log->snapshot_last_idx;
+    updateFileSize(log);
+
+    return RR_OK;
 }
 
-void RaftLogRemoveFiles(const char *filename)
+static void unlinkSegmentFiles(const char *filename, raft_index_t first_idx)
 {
-    char *idx_filename = getIndexFilename(filename);
+    char *seg_filename = getSegmentFilename(filename, first_idx);
+    char *idx_filename = getIndexFilename(seg_filename);
 
-    LOG_DEBUG("Removing Raft Log files: %s", filename);
-    unlink(filename);
+    unlink(seg_filename);
     unlink(idx_filename);
 
     RedisModule_Free(idx_filename);
+    RedisModule_Free(seg_filename);
 }
 
-void RaftLogArchiveFiles(RedisRaftCtx *rr)
+/* Removes the log metadata file and all segments it refers to */
+void RaftLogRemoveFiles(const char *filename)
 {
-    char *idx_filename = getIndexFilename(rr->config->raft_log_filename);
+    RawLogEntry *re = NULL;
+    int i;
+
+    LOG_DEBUG("Removing Raft Log files: %s", filename);
+
+    FILE *file = fopen(filename, "r");
+    if (file) {
+        /* Skip header, then read manifest */
+        if (readRawLogEntry(file, &re) == 0) {
+            freeRawLogEntry(re);
+            re = NULL;
+            if (readRawLogEntry(file, &re) == 0 && re->num_elements > 0 &&
+                !strcmp(re->elements[0].ptr, "SEGMENTS")) {
+                for (i = 1; i < re->num_elements; i++) {
+                    unlinkSegmentFiles(filename, strtoul(re->elements[i].ptr, NULL, 10));
+                }
+            }
+            freeRawLogEntry(re);
+        }
+        fclose(file);
+    }
+
+    /* Index file of a version 1 or 2 log */
+    char *idx_filename = getIndexFilename(filename);
     unlink(idx_filename);
     RedisModule_Free(idx_filename);
 
-    size_t bak_filename_maxlen = strlen(rr->config->raft_log_filename) + 100;
-    char bak_filename[bak_filename_maxlen];
-    snprintf(bak_filename, bak_filename_maxlen - 1,
-            "%s.%d.bak", rr->config->raft_log_filename, raft_get_nodeid(rr->raft));
-    rename(rr->config->raft_log_filename, bak_filename);
+    unlink(filename);
 }
 
-RRStatus RaftLogRewriteSwitch(RedisRaftCtx *rr, RaftLog *new_log, unsigned long new_log_entries)
+void RaftLogArchiveFiles(RedisRaftCtx *rr)
 {
-    /* Rename Raft log.  If we fail, we can assume the old log is still
-     * okay and we can just cancel the operation.
-     */
-    if (rename(new_log->filename, rr->log->filename) < 0) {
-        LOG_ERROR("Failed to switch Raft log: %s to %s: %s",
-                new_log->filename, rr->log->filename, strerror(errno));
-        return RR_ERROR;
-    }
-
-    /* Rename the index.  If we fail now we're in inconsistent state, so we
-     * panic and expect the index to be re-built when the process restarts.
-     */
-    char *log_idx_filename = getIndexFilename(rr->log->filename);
-    char *new_idx_filename = getIndexFilename(new_log->filename);
-    if (rename(new_idx_filename, log_idx_filename) < 0) {
-        PANIC("Failed to switch Raft log index: %s to %s: %s",
-               new_idx_filename, log_idx_filename, strerror(errno));
-    }
-
-    RedisModule_Free(log_idx_filename);
-    RedisModule_Free(new_idx_filename);
+    size_t bak_filename_maxlen = strlen(rr->config->raft_log_filename) + 100;
+    char bak_filename[bak_filename_maxlen];
+    int i;
 
-    new_log->filename = rr->log->filename;
-    new_log->num_entries = new_log_entries;
-    new_log->index = new_log->snapshot_last_idx + new_log->num_entries;
+    for (i = 0; rr->log && i < rr->log->num_segments; i++) {
+        RaftLogSegment *seg = rr->log->segments[i];
+        char *idx_filename = getIndexFilename(seg->filename);
+        unlink(idx_filename);
+        RedisModule_Free(idx_filename);
 
-    RaftLogClose(rr->log);
-    rr->log = new_log;
+        snprintf(bak_filename, bak_filename_maxlen - 1,
+                "%s.%d.bak", seg->filename, raft_get_nodeid(rr->raft));
+        rename(seg->filename, bak_filename);
+    }
 
-    return RR_OK;
+    snprintf(bak_filename, bak_filename_maxlen - 1,
+            "%s.%d.bak", rr->config->raft_log_filename, raft_get_nodeid(rr->raft));
+    rename(rr->config->raft_log_filename, bak_filename);
 }
 
 /*
@@ -1037,6 +2260,9 @@ static void logImplReset(void *rr_, raft_index_t index, raft_term_t term)
      */
     assert(index >= 1);
     RaftLogReset(rr->log, index - 1, term);
+    if (rr->log_writer) {
+        RaftLogWriterReset(rr->log_writer, index - 1);
+    }
 
     TRACE_LOG_OP("Reset(index=%lu,term=%lu)", index, term);
 
@@ -1071,6 +2297,10 @@ static int logImplPop(void *rr_, raft_index_t from_idx, func_entry_notify_f cb,
     if (RaftLogDelete(rr->log, from_idx, cb, cb_arg) != RR_OK) {
         return -1;
     }
+    if (rr->log_writer) {
+        RaftLogWriterTruncate(rr->log_writer, from_idx - 1);
+    }
+    truncateSyncWaiters(rr, from_idx - 1);
     return 0;
 }
 
@@ -1101,10 +2331,23 @@ static int logImplGetBatch(void *rr_, raft_index_t idx, int entries_n, raft_entr
     while (n < entries_n) {
         raft_entry_t *e = EntryCacheGet(rr->logcache, i);
         if (!e) {
-            e = RaftLogGet(rr->log, i);
-        }
-        if (!e) {
-            break;
+            /* Entries missing from the cache precede those in it, so read
+             * them from the log in one go.
+             */
+            int count = entries_n - n;
+            if (rr->logcache->len && i < rr->logcache->start_idx &&
+                rr->logcache->start_idx - i < (raft_index_t) count) {
+                count = (int) (rr->logcache->start_idx - i);
+            }
+
+            int ret = RaftLogGetBatch(rr->log, i, count, &entries[n]);
+            if (!ret) {
+                break;
+            }
+
+            n += ret;
+            i += ret;
+            continue;
         }
 
         entries[n] = e;
@@ -13,25 +13,43 @@
  * Raft library.
  *
  * For every node we maintain a Connection that allows communicating with it
- * using Redis commands. We also maintain additional information like general
+ * using Redis commands, and optionally a second one to its peer port that
+ * carries Raft messages. We also maintain additional information like general
  * metrics, and information about pending responses (used to implement timeouts
  * and reconnects).
  */
 
 static LIST_HEAD(node_list, Node) node_list = LIST_HEAD_INITIALIZER(node_list);
 
-/* Clear all pending responses and metrics from the node. We have to do that
- * when reconnecting.
- */
-static void clearPendingResponses(Node *node)
+/* Raft messages are sent over the peer port connection, if there is one */
+static bool usePeerConn(Node *node)
+{
+    return node->peer_addr.port != 0;
+}
+
+static struct pending_responses *getPendingResponses(Node *node, bool proxy)
 {
-    node->pending_raft_response_num = 0;
-    node->pending_proxy_response_num = 0;
+    if (!proxy && usePeerConn(node)) {
+        return &node->peer_pending_responses;
+    }
+    return &node->pending_responses;
+}
 
-    while (!STAILQ_EMPTY(&node->pending_responses)) {
-        PendingResponse *resp = STAILQ_FIRST(&node->pending_responses);
-        STAILQ_REMOVE_HEAD(&node->pending_responses, entries);
-        RedisModule_Free(resp);
+/* Clear all pending responses and metrics of a connection. We have to do
+ * that when reconnecting.
+ */
+static void clearPendingResponses(Node *node, struct pending_responses *list)
+{
+    while (!STAILQ_EMPTY(list)) {
+        PendingResponse *resp = STAILQ_FIRST(list);
+        STAILQ_REMOVE_HEAD(list, entries);
+
+        if (resp->proxy) {
+            node->pending_proxy_response_num--;
+        } else {
+            node->pending_raft_response_num--;
+        }
+        ObjectPoolFree(&PendingResponsePool, resp);
     }
 }
 
@@ -41,11 +59,21 @@ static void handleNodeConnect(Connection *conn)
     Node *node = (Node *) ConnGetPrivateData(conn);
 
     if (ConnIsConnected(conn)) {
-        clearPendingResponses(node);
+        clearPendingResponses(node, &node->pending_responses);
         NODE_TRACE(node, "Node connection established.");
     }
 }
 
+static void handleNodePeerConnect(Connection *conn)
+{
+    Node *node = (Node *) ConnGetPrivateData(conn);
+
+    if (ConnIsConnected(conn)) {
+        clearPendingResponses(node, getPendingResponses(node, false));
+        NODE_TRACE(node, "Node peer port connection established.");
+    }
+}
+
 /* Idle callback: when we have a connection associated with an active node,
  * we initiate ConnConnect().
  */
@@ -56,7 +84,11 @@ static void nodeIdleCallback(Connection *conn)
 
     raft_node_t *raft_node = raft_get_node(rr->raft, node->id);
     if (raft_node != NULL && raft_node_is_active(raft_node)) {
-        ConnConnect(node->conn, &node->addr, handleNodeConnect);
+        if (conn == node->peer_conn) {
+            ConnConnect(node->peer_conn, &node->peer_addr, handleNodePeerConnect);
+        } else {
+            ConnConnect(node->conn, &node->addr, handleNodeConnect);
+        }
     }
 }
 
@@ -67,21 +99,37 @@ static void NodeFree(Node *node)
         return;
     }
 
-    clearPendingResponses(node);
+    clearPendingResponses(node, &node->pending_responses);
+    clearPendingResponses(node, &node->peer_pending_responses);
 
     LIST_REMOVE(node, entries);
     RedisModule_Free(node);
 }
 
-/* hiredis free callback */
+/* hiredis free callbacks; the node is freed along with its last connection */
 static void nodeFreeCallback(void *privdata)
 {
     Node *node = (Node *) privdata;
-    NodeFree(node);
+
+    node->conn = NULL;
+    if (!node->peer_conn) {
+        NodeFree(node);
+    }
+}
+
+static void nodePeerFreeCallback(void *privdata)
+{
+    Node *node = (Node *) privdata;
+
+    node->peer_conn = NULL;
+    if (!node->conn) {
+        NodeFree(node);
+    }
 }
 
 /* Create a new node object, put it in the nodes list and create a connection
- * object for it.
+ * object for it. If peer-port-offset is set, a second connection carries
+ * Raft messages to the node's peer port.
  *
  * Note that at this point no actual connection is made. The idle callback
  * fires at a later stage and handles connection setup.
@@ -91,6 +139,7 @@ Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr)
 {
     Node *node = RedisModule_Calloc(1, sizeof(Node));
     STAILQ_INIT(&node->pending_responses);
+    STAILQ_INIT(&node->peer_pending_responses);
 
     node->id = id;
     node->rr = rr;
@@ -101,9 +150,29 @@ Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr)
     LIST_INSERT_HEAD(&node_list, node, entries);
     node->conn = ConnCreate(node->rr, node, nodeIdleCallback, nodeFreeCallback);
 
+    if (rr->config->peer_port_offset) {
+        node->peer_addr = node->addr;
+        node->peer_addr.port += rr->config->peer_port_offset;
+        node->peer_conn = ConnCreate(node->rr, node, nodeIdleCallback, nodePeerFreeCallback);
+    }
+
     return node;
 }
 
+/* Returns the connection Raft messages are sent over */
+Connection *NodeGetRaftConn(Node *node)
+{
+    return usePeerConn(node) ? node->peer_conn : node->conn;
+}
+
+/* Terminates the node's connections; the node is freed once they are. */
+void NodeTerminate(Node *node)
+{
+    ConnAsyncTerminate(node->conn);
+    if (node->peer_conn) {
+        ConnAsyncTerminate(node->peer_conn);
+    }
+}
 
 /* Track a new pending response for a request that was sent to the node.
  * This is used to track connection liveness and decide when it should be
@@ -113,7 +182,8 @@ void NodeAddPendingResponse(Node *node, bool proxy)
 {
     static int response_id = 0;
 
-    PendingResponse *resp = RedisModule_Calloc(1, sizeof(PendingResponse));
+    PendingResponse *resp = ObjectPoolAlloc(&PendingResponsePool);
+    memset(resp, 0, sizeof(*resp));
     resp->proxy = proxy;
     resp->request_time = RedisModule_Milliseconds();
     resp->id = ++response_id;
@@ -123,19 +193,21 @@ void NodeAddPendingResponse(Node *node, bool proxy)
     } else {
         node->pending_raft_response_num++;
     }
-    STAILQ_INSERT_TAIL(&node->pending_responses, resp, entries);
+    STAILQ_INSERT_TAIL(getPendingResponses(node, proxy), resp, entries);
 
     NODE_TRACE(node, "NodeAddPendingResponse: id=%d, type=%s, request_time=%lld",
             resp->id, proxy ? "proxy" : "raft", resp->request_time);
 }
 
 /* Acknowledge a response that has been received and remove it from the
- * node's list of pending responses.
+ * node's list of pending responses. Responses arrive in order on each
+ * connection, so it is the first one sent over the same connection.
  */
-void NodeDismissPendingResponse(Node *node)
+void NodeDismissPendingResponse(Node *node, bool proxy)
 {
-    PendingResponse *resp = STAILQ_FIRST(&node->pending_responses);
-    STAILQ_REMOVE_HEAD(&node->pending_responses, entries);
+    struct pending_responses *list = getPendingResponses(node, proxy);
+    PendingResponse *resp = STAILQ_FIRST(list);
+    STAILQ_REMOVE_HEAD(list, entries);
 
     if (resp->proxy) {
         node->pending_proxy_response_num--;
@@ -147,7 +219,31 @@ void NodeDismissPendingResponse(Node *node)
             resp->id, resp->proxy ? "proxy" : "raft",
             RedisModule_Milliseconds() - resp->request_time);
 
-    RedisModule_Free(resp);
+    ObjectPoolFree(&PendingResponsePool, resp);
+}
+
+/* Drops the connection if its oldest pending response has timed out */
+static void checkPendingResponses(RedisRaftCtx *rr, Node *node, Connection *conn,
+                                  struct pending_responses *list)
+{
+    if (!conn || !ConnIsConnected(conn) || STAILQ_EMPTY(list)) {
+        return;
+    }
+
+    PendingResponse *resp = STAILQ_FIRST(list);
+    long timeout;
+
+    if (raft_is_leader(rr->raft)) {
+        timeout = rr->config->raft_response_timeout;
+    } else {
+        timeout = resp->proxy ? rr->config->proxy_response_timeout : rr->config->raft_response_timeout;
+    }
+
+    if (timeout && resp->request_time + timeout < RedisModule_Milliseconds()) {
+        NODE_TRACE(node, "Pending %s response timeout expired, reconnecting.",
+                resp->proxy ? "proxy" : "raft");
+        ConnMarkDisconnected(conn);
+    }
 }
 
 /* Gets called periodically to look for nodes with commands that should time out
@@ -161,22 +257,8 @@ void HandleNodeStates(RedisRaftCtx *rr)
     /* Iterate nodes and find nodes that require reconnection */
     Node *node, *tmp;
     LIST_FOREACH_SAFE(node, &node_list, entries, tmp) {
-        if (ConnIsConnected(node->conn) && !STAILQ_EMPTY(&node->pending_responses)) {
-            PendingResponse *resp = STAILQ_FIRST(&node->pending_responses);
-            long timeout;
-
-            if (raft_is_leader(rr->raft)) {
-                timeout = rr->config->raft_response_timeout;
-            } else {
-                timeout = resp->proxy ? rr->config->proxy_response_timeout : rr->config->raft_response_timeout;
-            }
-
-            if (timeout && resp->request_time + timeout < RedisModule_Milliseconds()) {
-                NODE_TRACE(node, "Pending %s response timeout expired, reconnecting.",
-                        resp->proxy ? "proxy" : "raft");
-                ConnMarkDisconnected(node->conn);
-            }
-        }
+        checkPendingResponses(rr, node, node->conn, &node->pending_responses);
+        checkPendingResponses(rr, node, node->peer_conn,
+                              &node->peer_pending_responses);
     }
 }
-
@@ -0,0 +1,478 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020-2021 Redis Ltd.
+ *
+ * RedisRaft is licensed under the Redis Source Available License (RSAL).
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <netdb.h>
+#include "redisraft.h"
+
+/*
+ * Peer listener.
+ *
+ * When peer-port-offset is set, Raft messages from other nodes are accepted
+ * on a dedicated port, served by the Raft thread's own event loop. Messages
+ * are RESP encoded exactly like the RAFT.AE, RAFT.REQUESTVOTE, RAFT.SNAPSHOT
+ * and RAFT.TIMEOUT_NOW commands, but never go through the Redis main thread:
+ * they are parsed here and handed to the Raft library right away.
+ *
+ * Replies are sent in the order messages were received, as the sending
+ * node matches them by order. RAFT.AE replies are held until the appended
+ * entries are synced, so every message gets a PeerReply slot which is
+ * flushed once it and all slots before it are complete.
+ */
+
+#define PEER_READ_BUF_SIZE  (64 * 1024)
+
+typedef struct PeerClient {
+    uv_tcp_t tcp;
+    RedisRaftCtx *rr;
+    redisReader *reader;
+    int refcount;                   /* Held by the connection and by incomplete replies */
+    bool closed;
+    STAILQ_HEAD(peer_replies, PeerReply) replies;
+} PeerClient;
+
+typedef struct PeerReply {
+    PeerClient *client;
+    char *buf;                      /* RESP encoded reply, NULL until complete */
+    size_t len;
+    STAILQ_ENTRY(PeerReply) entries;
+} PeerReply;
+
+static void peerClientRelease(PeerClient *client)
+{
+    if (--client->refcount > 0) {
+        return;
+    }
+
+    while (!STAILQ_EMPTY(&client->replies)) {
+        PeerReply *reply = STAILQ_FIRST(&client->replies);
+        STAILQ_REMOVE_HEAD(&client->replies, entries);
+        RedisModule_Free(reply->buf);
+        RedisModule_Free(reply);
+    }
+
+    redisReaderFree(client->reader);
+    RedisModule_Free(client);
+}
+
+static void handlePeerClientClosed(uv_handle_t *handle)
+{
+    PeerClient *client = uv_handle_get_data(handle);
+
+    client->rr->peer_clients--;
+    peerClientRelease(client);
+}
+
+static void peerClientClose(PeerClient *client)
+{
+    if (client->closed) {
+        return;
+    }
+
+    client->closed = true;
+    uv_close((uv_handle_t *) &client->tcp, handlePeerClientClosed);
+}
+
+static void handlePeerWrite(uv_write_t *req, int status)
+{
+    if (status < 0) {
+        peerClientClose(uv_req_get_data((uv_req_t *) req));
+    }
+
+    RedisModule_Free(req);
+}
+
+/* Writes all complete replies at the head of the client's reply list */
+static void peerClientFlush(PeerClient *client)
+{
+    PeerReply *reply;
+
+    while ((reply = STAILQ_FIRST(&client->replies)) != NULL && reply->buf) {
+        STAILQ_REMOVE_HEAD(&client->replies, entries);
+
+        if (!client->closed) {
+            /* The write request and the buffer share one allocation */
+            uv_write_t *req = RedisModule_Alloc(sizeof(uv_write_t) + reply->len);
+            uv_buf_t buf = uv_buf_init((char *) (req + 1), reply->len);
+
+            memcpy(buf.base, reply->buf, reply->len);
+            uv_req_set_data((uv_req_t *) req, client);
+            if (uv_write(req, (uv_stream_t *) &client->tcp, &buf, 1, handlePeerWrite) < 0) {
+                RedisModule_Free(req);
+                peerClientClose(client);
+            }
+        }
+
+        RedisModule_Free(reply->buf);
+        RedisModule_Free(reply);
+    }
+}
+
+static PeerReply *peerReplyCreate(PeerClient *client)
+{
+    PeerReply *reply = RedisModule_Calloc(1, sizeof(PeerReply));
+
+    reply->client = client;
+    client->refcount++;
+    STAILQ_INSERT_TAIL(&client->replies, reply, entries);
+
+    return reply;
+}
+
+static void peerReplyComplete(PeerReply *reply, char *buf)
+{
+    PeerClient *client = reply->client;
+
+    reply->buf = buf;
+    reply->len = strlen(buf);
+
+    peerClientFlush(client);
+    peerClientRelease(client);
+}
+
+static void peerReplyFormat(PeerReply *reply, const char *fmt, ...)
+{
+    size_t len = 128;
+    char *buf = RedisModule_Alloc(len);
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, len, fmt, ap);
+    va_end(ap);
+
+    peerReplyComplete(reply, buf);
+}
+
+void PeerReplyError(PeerReply *reply, const char *err)
+{
+    peerReplyFormat(reply, "-%s\r\n", err);
+}
+
+void PeerReplyAppendEntries(PeerReply *reply, msg_appendentries_response_t *response)
+{
+    peerReplyFormat(reply, "*4\r\n:%ld\r\n:%d\r\n:%ld\r\n:%lu\r\n",
+                    response->term, response->success,
+                    response->current_idx, response->msg_id);
+}
+
+/* Same as checkRaftState(), for messages received on the peer port */
+static RRStatus peerCheckRaftState(RedisRaftCtx *rr, PeerReply *reply)
+{
+    switch (rr->state) {
+        case REDIS_RAFT_UNINITIALIZED:
+            PeerReplyError(reply, "NOCLUSTER No Raft Cluster");
+            return RR_ERROR;
+        case REDIS_RAFT_JOINING:
+            PeerReplyError(reply, "NOCLUSTER No Raft Cluster (joining now)");
+            return RR_ERROR;
+        case REDIS_RAFT_LOADING:
+            PeerReplyError(reply, "LOADING Raft module is loading data");
+            return RR_ERROR;
+        case REDIS_RAFT_UP:
+            break;
+    }
+    return RR_OK;
+}
+
+static bool parseNodeId(redisReply *arg, raft_node_id_t *id)
+{
+    char *end;
+    long val = strtol(arg->str, &end, 10);
+
+    if (arg->len == 0 || *end != '\0' || val < 0 || val > INT32_MAX) {
+        return false;
+    }
+
+    *id = (raft_node_id_t) val;
+    return true;
+}
+
+static void peerRequestVote(RedisRaftCtx *rr, redisReply *cmd, PeerReply *reply)
+{
+    raft_node_id_t src_node_id;
+    msg_requestvote_t msg;
+    msg_requestvote_response_t response;
+
+    if (cmd->elements != 4) {
+        PeerReplyError(reply, "ERR wrong number of arguments for 'RAFT.REQUESTVOTE' command");
+        return;
+    }
+    if (!parseNodeId(cmd->element[2], &src_node_id)) {
+        PeerReplyError(reply, "invalid source node id");
+        return;
+    }
+    if (sscanf(cmd->element[3]->str, "%d:%ld:%d:%ld:%ld:%d",
+               &msg.prevote, &msg.term, &msg.candidate_id,
+               &msg.last_log_idx, &msg.last_log_term, &msg.transfer_leader) != 6) {
+        PeerReplyError(reply, "invalid message");
+        return;
+    }
+
+    if (raft_recv_requestvote(rr->raft, raft_get_node(rr->raft, src_node_id),
+                              &msg, &response) != 0) {
+        PeerReplyError(reply, "ERR operation failed");
+        return;
+    }
+
+    peerReplyFormat(reply, "*4\r\n:%d\r\n:%ld\r\n:%ld\r\n:%d\r\n",
+                    response.prevote, response.request_term,
+                    response.term, response.vote_granted);
+}
+
+static void peerAppendEntries(RedisRaftCtx *rr, redisReply *cmd, PeerReply *reply)
+{
+    if (cmd->elements != 5) {
+        PeerReplyError(reply, "ERR wrong number of arguments for 'RAFT.AE' command");
+        return;
+    }
+
+    RaftReq *req = RaftReqInit(NULL, RR_APPENDENTRIES);
+    if (!parseNodeId(cmd->element[2], &req->r.appendentries.src_node_id)) {
+        PeerReplyError(reply, "invalid source node id");
+        RaftReqFree(req);
+        return;
+    }
+    if (RaftAEDecode(&req->r.appendentries.msg,
+                     cmd->element[3]->str, cmd->element[3]->len,
+                     cmd->element[4]->str, cmd->element[4]->len) != RR_OK) {
+        PeerReplyError(reply, "invalid message");
+        RaftReqFree(req);
+        return;
+    }
+
+    /* Handled like a RAFT.AE command, which replies once entries are synced */
+    req->r.appendentries.peer_reply = reply;
+    RaftReqHandle(rr, req);
+}
+
+static void peerSnapshot(RedisRaftCtx *rr, redisReply *cmd, PeerReply *reply)
+{
+    raft_node_id_t src_node_id;
+    msg_snapshot_t msg = {0};
+    msg_snapshot_response_t response;
+
+    if (cmd->elements != 5) {
+        PeerReplyError(reply, "ERR wrong number of arguments for 'RAFT.SNAPSHOT' command");
+        return;
+    }
+    if (!parseNodeId(cmd->element[2], &src_node_id)) {
+        PeerReplyError(reply, "invalid source node id");
+        return;
+    }
+    if (sscanf(cmd->element[3]->str, "%ld:%d:%lu:%ld:%ld:%llu:%d",
+               &msg.term, &msg.leader_id, &msg.msg_id,
+               &msg.snapshot_index, &msg.snapshot_term,
+               &msg.chunk.offset, &msg.chunk.last_chunk) != 7) {
+        PeerReplyError(reply, "invalid message");
+        return;
+    }
+
+    /* Chunks are stored before raft_recv_snapshot() returns */
+    msg.chunk.data = cmd->element[4]->str;
+    msg.chunk.len = cmd->element[4]->len;
+
+    if (raft_recv_snapshot(rr->raft, raft_get_node(rr->raft, src_node_id),
+                           &msg, &response) != 0) {
+        PeerReplyError(reply, "ERR operation failed");
+        return;
+    }
+
+    peerReplyFormat(reply, "*5\r\n:%ld\r\n:%lu\r\n:%llu\r\n:%d\r\n:%d\r\n",
+                    response.term, response.msg_id, response.offset,
+                    response.success, response.last_chunk);
+}
+
+static void peerProcessCommand(PeerClient *client, redisReply *cmd)
+{
+    RedisRaftCtx *rr = client->rr;
+    PeerReply *reply = peerReplyCreate(client);
+    raft_node_id_t target_node_id;
+    size_t i;
+
+    rr->peer_messages++;
+
+    if (cmd->type != REDIS_REPLY_ARRAY || cmd->elements < 1) {
+        PeerReplyError(reply, "ERR invalid request");
+        return;
+    }
+    for (i = 0; i < cmd->elements; i++) {
+        if (cmd->element[i]->type != REDIS_REPLY_STRING) {
+            PeerReplyError(reply, "ERR invalid request");
+            return;
+        }
+    }
+
+    const char *name = cmd->element[0]->str;
+    if (!strcasecmp(name, "RAFT.TIMEOUT_NOW")) {
+        if (peerCheckRaftState(rr, reply) == RR_OK) {
+            raft_set_timeout_now(rr->raft);
+            peerReplyFormat(reply, "+OK\r\n");
+        }
+        return;
+    }
+
+    if (strcasecmp(name, "RAFT.AE") != 0 &&
+        strcasecmp(name, "RAFT.REQUESTVOTE") != 0 &&
+        strcasecmp(name, "RAFT.SNAPSHOT") != 0) {
+        PeerReplyError(reply, "ERR unknown command");
+        return;
+    }
+
+    if (cmd->elements < 2 || !parseNodeId(cmd->element[1], &target_node_id) ||
+        target_node_id != rr->config->id) {
+        PeerReplyError(reply, "invalid or incorrect target node id");
+        return;
+    }
+
+    if (peerCheckRaftState(rr, reply) == RR_ERROR) {
+        return;
+    }
+
+    if (!strcasecmp(name, "RAFT.AE")) {
+        peerAppendEntries(rr, cmd, reply);
+    } else if (!strcasecmp(name, "RAFT.REQUESTVOTE")) {
+        peerRequestVote(rr, cmd, reply);
+    } else {
+        peerSnapshot(rr, cmd, reply);
+    }
+}
+
+static void allocPeerReadBuf(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+    UNUSED(handle);
+    UNUSED(suggested_size);
+
+    buf->base = RedisModule_Alloc(PEER_READ_BUF_SIZE);
+    buf->len = PEER_READ_BUF_SIZE;
+}
+
+static void handlePeerRead(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+    PeerClient *client = uv_handle_get_data((uv_handle_t *) stream);
+    RedisRaftCtx *rr = client->rr;
+    void *cmd;
+
+    if (nread < 0) {
+        peerClientClose(client);
+        goto exit;
+    }
+
+    if (redisReaderFeed(client->reader, buf->base, nread) != REDIS_OK) {
+        peerClientClose(client);
+        goto exit;
+    }
+
+    /* Keep a reference, as a failed write may close the client */
+    client->refcount++;
+    while (!client->closed) {
+        if (redisReaderGetReply(client->reader, &cmd) != REDIS_OK) {
+            LOG_VERBOSE("Peer protocol error: %s", client->reader->errstr);
+            peerClientClose(client);
+            break;
+        }
+        if (!cmd) {
+            break;
+        }
+
+        peerProcessCommand(client, cmd);
+        freeReplyObject(cmd);
+    }
+    peerClientRelease(client);
+
+    /* Messages received together share a single fsync */
+    RaftReqHandleDone(rr);
+
+exit:
+    RedisModule_Free(buf->base);
+}
+
+static void handlePeerConnection(uv_stream_t *server, int status)
+{
+    RedisRaftCtx *rr = uv_handle_get_data((uv_handle_t *) server);
+
+    if (status < 0) {
+        LOG_ERROR("Peer connection error: %s", uv_strerror(status));
+        return;
+    }
+
+    PeerClient *client = RedisModule_Calloc(1, sizeof(PeerClient));
+    client->rr = rr;
+    client->refcount = 1;
+    client->reader = redisReaderCreate();
+    STAILQ_INIT(&client->replies);
+
+    uv_tcp_init(rr->loop, &client->tcp);
+    uv_handle_set_data((uv_handle_t *) &client->tcp, client);
+    rr->peer_clients++;
+
+    if (uv_accept(server, (uv_stream_t *) &client->tcp) != 0) {
+        peerClientClose(client);
+        return;
+    }
+
+    uv_tcp_nodelay(&client->tcp, 1);
+    uv_read_start((uv_stream_t *) &client->tcp, allocPeerReadBuf, handlePeerRead);
+}
+
+/* Starts listening on the peer port, if one is configured.
+ *
+ * Messages on the peer port are not authenticated, so we only listen on the
+ * address other nodes know us by rather than on all interfaces. Like hiredis
+ * when connecting, we prefer its IPv4 address if it has one.
+ */
+RRStatus PeerListenerStart(RedisRaftCtx *rr)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_NUMERICSERV
+    };
+    struct addrinfo *res, *ai;
+    const char *host = rr->config->addr.host;
+    char port_str[8];
+    int port, ret;
+
+    if (!rr->config->peer_port_offset) {
+        return RR_OK;
+    }
+
+    port = rr->config->addr.port + rr->config->peer_port_offset;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    if ((ret = getaddrinfo(host, port_str, &hints, &res)) != 0) {
+        LOG_ERROR("Failed to resolve peer address %s: %s", host, gai_strerror(ret));
+        return RR_ERROR;
+    }
+
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET) {
+            break;
+        }
+    }
+    if (!ai) {
+        ai = res;
+    }
+
+    uv_tcp_init(rr->loop, &rr->peer_listener);
+    uv_handle_set_data((uv_handle_t *) &rr->peer_listener, rr);
+
+    ret = uv_tcp_bind(&rr->peer_listener, ai->ai_addr, 0);
+    freeaddrinfo(res);
+
+    if (ret != 0 ||
+        (ret = uv_listen((uv_stream_t *) &rr->peer_listener, 128, handlePeerConnection)) != 0) {
+        LOG_ERROR("Failed to listen on peer port %s:%d: %s", host, port, uv_strerror(ret));
+        return RR_ERROR;
+    }
+
+    LOG_INFO("Listening for Raft peers on %s:%d", host, port);
+    return RR_OK;
+}
@@ -0,0 +1,287 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020-2021 Redis Ltd.
+ *
+ * RedisRaft is licensed under the Redis Source Available License (RSAL).
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "redisraft.h"
+
+/*
+ * Object pools.
+ *
+ * Objects allocated and freed for every request (RaftReq, PendingResponse
+ * and memory used by the Raft library, most notably log entries) are recycled
+ * rather than returned to the allocator.
+ *
+ * Every thread keeps a small cache of free objects per pool, so allocating
+ * and freeing objects normally takes no locks. Caches exchange objects with
+ * a shared free list in batches, which also lets objects be freed by a thread
+ * other than the one that allocated them.
+ */
+
+#define POOL_CACHE_SIZE     64      /* Free objects cached per thread and pool */
+#define POOL_SHARED_SIZE    4096    /* Free objects kept on the shared list */
+#define POOL_MAX            16
+
+typedef struct PoolCache {
+    void *head;
+    int count;
+} PoolCache;
+
+static __thread PoolCache pool_caches[POOL_MAX];
+
+ObjectPool RaftReqPool = { .name = "raftreq", .id = 0, .size = sizeof(RaftReq) };
+ObjectPool PendingResponsePool = { .name = "pending_response", .id = 1, .size = sizeof(PendingResponse) };
+
+/* Memory allocated by the Raft library is served from size classes. Every
+ * block starts with a header that holds its size class, so it can be freed
+ * without knowing its size.
+ */
+typedef struct HeapHeader {
+    uint32_t pool;                  /* Index in heap_pools, or HEAP_LARGE */
+    uint32_t unused;
+    uint64_t size;                  /* Requested size */
+} HeapHeader;
+
+#define HEAP_LARGE  UINT32_MAX
+
+static ObjectPool heap_pools[] = {
+    { .name = "heap_64", .id = 2, .size = 64 },
+    { .name = "heap_128", .id = 3, .size = 128 },
+    { .name = "heap_256", .id = 4, .size = 256 },
+    { .name = "heap_512", .id = 5, .size = 512 },
+    { .name = "heap_1024", .id = 6, .size = 1024 },
+    { .name = "heap_2048", .id = 7, .size = 2048 },
+    { .name = "heap_4096", .id = 8, .size = 4096 },
+};
+
+#define HEAP_POOLS_NUM  (sizeof(heap_pools) / sizeof(heap_pools[0]))
+
+static ObjectPool *pools[] = {
+    &RaftReqPool, &PendingResponsePool,
+    &heap_pools[0], &heap_pools[1], &heap_pools[2], &heap_pools[3],
+    &heap_pools[4], &heap_pools[5], &heap_pools[6],
+};
+
+#define POOLS_NUM       (sizeof(pools) / sizeof(pools[0]))
+
+void ObjectPoolsInit(void)
+{
+    static bool initialized = false;
+    unsigned int i;
+
+    if (initialized) {
+        return;
+    }
+
+    for (i = 0; i < POOLS_NUM; i++) {
+        assert(pools[i]->id == (int) i && pools[i]->id < POOL_MAX);
+        uv_mutex_init(&pools[i]->mutex);
+    }
+    initialized = true;
+}
+
+/* Moves up to n objects from the shared list to the cache */
+static void refillCache(ObjectPool *pool, PoolCache *cache, int n)
+{
+    uv_mutex_lock(&pool->mutex);
+    while (n-- > 0 && pool->free_list) {
+        void *obj = pool->free_list;
+        pool->free_list = *(void **) obj;
+        pool->free_count--;
+
+        *(void **) obj = cache->head;
+        cache->head = obj;
+        cache->count++;
+    }
+    uv_mutex_unlock(&pool->mutex);
+}
+
+/* Moves n objects from the cache to the shared list, or returns them to the
+ * system if the shared list is full.
+ */
+static void drainCache(ObjectPool *pool, PoolCache *cache, int n)
+{
+    uv_mutex_lock(&pool->mutex);
+    while (n-- > 0 && cache->head) {
+        void *obj = cache->head;
+        cache->head = *(void **) obj;
+        cache->count--;
+
+        if (pool->free_count < POOL_SHARED_SIZE) {
+            *(void **) obj = pool->free_list;
+            pool->free_list = obj;
+            pool->free_count++;
+        } else {
+            RedisModule_Free(obj);
+            __atomic_sub_fetch(&pool->allocated, 1, __ATOMIC_RELAXED);
+        }
+    }
+    uv_mutex_unlock(&pool->mutex);
+}
+
+/* Allocates an object from the pool. Its contents are undefined. */
+void *ObjectPoolAlloc(ObjectPool *pool)
+{
+    PoolCache *cache = &pool_caches[pool->id];
+    void *obj;
+
+    if (!cache->head) {
+        refillCache(pool, cache, POOL_CACHE_SIZE / 2);
+    }
+
+    if (cache->head) {
+        obj = cache->head;
+        cache->head = *(void **) obj;
+        cache->count--;
+    } else {
+        obj = RedisModule_Alloc(pool->size);
+        __atomic_add_fetch(&pool->allocated, 1, __ATOMIC_RELAXED);
+    }
+
+    __atomic_add_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+    return obj;
+}
+
+void ObjectPoolFree(ObjectPool *pool, void *obj)
+{
+    PoolCache *cache = &pool_caches[pool->id];
+
+    __atomic_sub_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+
+    *(void **) obj = cache->head;
+    cache->head = obj;
+    cache->count++;
+
+    if (cache->count > POOL_CACHE_SIZE) {
+        drainCache(pool, cache, POOL_CACHE_SIZE / 2);
+    }
+}
+
+/* Returns the free objects held by the calling thread's cache and the shared
+ * list to the system.
+ */
+void ObjectPoolRelease(ObjectPool *pool)
+{
+    PoolCache *cache = &pool_caches[pool->id];
+
+    uv_mutex_lock(&pool->mutex);
+    while (cache->head) {
+        void *obj = cache->head;
+        cache->head = *(void **) obj;
+        cache->count--;
+
+        *(void **) obj = pool->free_list;
+        pool->free_list = obj;
+        pool->free_count++;
+    }
+
+    while (pool->free_list) {
+        void *obj = pool->free_list;
+        pool->free_list = *(void **) obj;
+        pool->free_count--;
+
+        RedisModule_Free(obj);
+        __atomic_sub_fetch(&pool->allocated, 1, __ATOMIC_RELAXED);
+    }
+    uv_mutex_unlock(&pool->mutex);
+}
+
+void ObjectPoolsRelease(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < POOLS_NUM; i++) {
+        ObjectPoolRelease(pools[i]);
+    }
+}
+
+/* Heap functions for the Raft library */
+
+void *PoolHeapAlloc(size_t size)
+{
+    size_t total = sizeof(HeapHeader) + size;
+    HeapHeader *hdr;
+    uint32_t i;
+
+    for (i = 0; i < HEAP_POOLS_NUM; i++) {
+        if (total <= heap_pools[i].size) {
+            break;
+        }
+    }
+
+    if (i < HEAP_POOLS_NUM) {
+        hdr = ObjectPoolAlloc(&heap_pools[i]);
+        hdr->pool = i;
+    } else {
+        hdr = RedisModule_Alloc(total);
+        hdr->pool = HEAP_LARGE;
+    }
+    hdr->size = size;
+
+    return hdr + 1;
+}
+
+void *PoolHeapCalloc(size_t nmemb, size_t size)
+{
+    void *ptr = PoolHeapAlloc(nmemb * size);
+    memset(ptr, 0, nmemb * size);
+
+    return ptr;
+}
+
+void PoolHeapFree(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    HeapHeader *hdr = (HeapHeader *) ptr - 1;
+    if (hdr->pool == HEAP_LARGE) {
+        RedisModule_Free(hdr);
+    } else {
+        ObjectPoolFree(&heap_pools[hdr->pool], hdr);
+    }
+}
+
+void *PoolHeapRealloc(void *ptr, size_t size)
+{
+    if (!ptr) {
+        return PoolHeapAlloc(size);
+    }
+
+    HeapHeader *hdr = (HeapHeader *) ptr - 1;
+
+    /* Grow or shrink in place if the block is large enough */
+    if (hdr->pool != HEAP_LARGE && sizeof(HeapHeader) + size <= heap_pools[hdr->pool].size) {
+        hdr->size = size;
+        return ptr;
+    }
+
+    void *new_ptr = PoolHeapAlloc(size);
+    memcpy(new_ptr, ptr, hdr->size < size ? hdr->size : size);
+    PoolHeapFree(ptr);
+
+    return new_ptr;
+}
+
+char *ObjectPoolsInfo(char *s, size_t *slen)
+{
+    unsigned int i;
+
+    for (i = 0; i < POOLS_NUM; i++) {
+        ObjectPool *pool = pools[i];
+
+        s = catsnprintf(s, slen, "pool_%s:size=%zu,in_use=%lu,allocated=%lu,shared_free=%lu\r\n",
+                        pool->name, pool->size,
+                        __atomic_load_n(&pool->in_use, __ATOMIC_RELAXED),
+                        __atomic_load_n(&pool->allocated, __ATOMIC_RELAXED),
+                        __atomic_load_n(&pool->free_count, __ATOMIC_RELAXED));
+    }
+
+    return s;
+}
@@ -49,7 +49,7 @@ static void handleProxiedCommandResponse(redisAsyncContext *c, void *r, void *pr
     redisReply *reply = r;
 
     redis_raft.proxy_outstanding_reqs--;
-    NodeDismissPendingResponse(req->r.redis.proxy_node);
+    NodeDismissPendingResponse(req->r.redis.proxy_node, true);
 
     if (!reply) {
         /* Connection have dropped.  The state of the request is unknown at this point
@@ -102,3 +102,146 @@ RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader)
     return RR_OK;
 }
 
+
+/* Spread the reply to a RAFT.ENTRY.BATCH over the requests proxied in it. A
+ * single error means none of the commands was appended, so all requests
+ * receive it.
+ */
+static void handleProxiedBatchResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    RaftReq *req = privdata;
+    redisReply *reply = r;
+    Node *leader = req->r.redis.proxy_node;
+    size_t i = 0;
+
+    NodeDismissPendingResponse(leader, true);
+    if (!reply) {
+        ConnMarkDisconnected(leader->conn);
+    }
+
+    while (req) {
+        RaftReq *next = req->r.redis.batch_next;
+        redis_raft.proxy_outstanding_reqs--;
+
+        if (!reply) {
+            RedisModule_ReplyWithError(req->ctx, "TIMEOUT no reply from leader");
+            redis_raft.proxy_failed_responses++;
+        } else if (RedisModule_BlockedClientDisconnected(req->ctx)) {
+            /* Nothing to reply to */
+        } else if (reply->type == REDIS_REPLY_ERROR) {
+            RedisModule_ReplyWithError(req->ctx, reply->str);
+        } else if (reply->type != REDIS_REPLY_ARRAY || i >= reply->elements ||
+                   hiredisReplyToModule(reply->element[i], req->ctx) != RR_OK) {
+            RedisModule_ReplyWithError(req->ctx, "ERR bad reply from leader");
+        }
+
+        RaftReqFree(req);
+        req = next;
+        i++;
+    }
+}
+
+/* Send the commands batched by ProxyBatchAdd() to the leader, in a single
+ * RAFT.ENTRY.BATCH message.
+ */
+static RRStatus proxyBatch(RedisRaftCtx *rr, RaftReq *head, int len, Node *leader)
+{
+    redisAsyncContext *rc;
+    RaftReq *req;
+    int i = 0;
+
+    if (!ConnIsConnected(leader->conn) || !(rc = ConnGetRedisCtx(leader->conn))) {
+        rr->proxy_failed_reqs += len;
+        return RR_ERROR;
+    }
+
+    RaftRedisCommandArray cmds = {
+        .size = len,
+        .len = len,
+        .commands = RedisModule_Calloc(len, sizeof(RaftRedisCommand *))
+    };
+    for (req = head; req != NULL; req = req->r.redis.batch_next) {
+        req->r.redis.proxy_node = leader;
+        cmds.commands[i++] = req->r.redis.cmds.commands[0];
+    }
+
+    raft_entry_t *entry = RaftRedisCommandArraySerialize(&cmds);
+    RedisModule_Free(cmds.commands);
+
+    int ret = redisAsyncCommand(rc, handleProxiedBatchResponse,
+        head, "RAFT.ENTRY.BATCH %b", entry->data, entry->data_len);
+    raft_entry_release(entry);
+
+    if (ret != REDIS_OK) {
+        rr->proxy_failed_reqs += len;
+        return RR_ERROR;
+    }
+
+    NodeAddPendingResponse(leader, true);
+    rr->proxy_reqs += len;
+    rr->proxy_outstanding_reqs += len;
+    rr->proxy_batches++;
+    rr->proxy_batch_reqs += len;
+
+    return RR_OK;
+}
+
+/* Queue a single command request to be proxied to the leader along with other
+ * commands received while draining the request queue. The batch is sent once
+ * the queue is drained, or once it reaches raft-write-batch-size.
+ */
+void ProxyBatchAdd(RedisRaftCtx *rr, RaftReq *req, Node *leader)
+{
+    if (rr->proxy_batch.leader != leader) {
+        ProxyBatchFlush(rr);
+    }
+
+    req->r.redis.batch_next = NULL;
+    if (rr->proxy_batch.tail) {
+        rr->proxy_batch.tail->r.redis.batch_next = req;
+    } else {
+        rr->proxy_batch.head = req;
+    }
+    rr->proxy_batch.tail = req;
+    rr->proxy_batch.leader = leader;
+    rr->proxy_batch.len++;
+    rr->proxy_batch.size += RaftRedisCommandArraySerializedSize(&req->r.redis.cmds);
+
+    if (rr->proxy_batch.size >= rr->config->raft_write_batch_size) {
+        ProxyBatchFlush(rr);
+    }
+}
+
+void ProxyBatchFlush(RedisRaftCtx *rr)
+{
+    RaftReq *head = rr->proxy_batch.head;
+    Node *leader = rr->proxy_batch.leader;
+    int len = rr->proxy_batch.len;
+    RRStatus ret;
+
+    if (!head) {
+        return;
+    }
+
+    rr->proxy_batch.head = NULL;
+    rr->proxy_batch.tail = NULL;
+    rr->proxy_batch.leader = NULL;
+    rr->proxy_batch.len = 0;
+    rr->proxy_batch.size = 0;
+
+    /* A lone command is proxied as usual, and replied to without an array */
+    if (len == 1) {
+        ret = ProxyCommand(rr, head, leader);
+    } else {
+        ret = proxyBatch(rr, head, len, leader);
+    }
+
+    if (ret != RR_OK) {
+        while (head) {
+            RaftReq *next = head->r.redis.batch_next;
+            RedisModule_ReplyWithError(head->ctx, "NOTLEADER Failed to proxy command");
+            RaftReqFree(head);
+            head = next;
+        }
+    }
+}
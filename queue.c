@@ -0,0 +1,184 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020-2021 Redis Ltd.
+ *
+ * RedisRaft is licensed under the Redis Source Available License (RSAL).
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "redisraft.h"
+
+/*
+ * Bounded lock-free queue for any number of producer threads and a single
+ * consumer thread.
+ *
+ * Every slot carries a sequence number that tells whose turn it is: a
+ * producer may fill slot 'pos & mask' when its sequence equals 'pos', and the
+ * consumer may take it when it equals 'pos + 1'. Producers claim a position
+ * by advancing 'tail' with a compare-and-swap, so the only contention is
+ * between producers enqueueing at the same time.
+ *
+ * Pushing never blocks: once the ring is full, items go to an unbounded
+ * overflow list protected by a mutex, and keep going there until the consumer
+ * has emptied it. The consumer only takes overflow items once the ring is
+ * empty, so items pushed by any one producer still come out in order.
+ */
+
+void MPSCQueueInit(MPSCQueue *q, unsigned long size)
+{
+    unsigned long i;
+
+    assert(size && !(size & (size - 1)));
+
+    q->slots = RedisModule_Calloc(size, sizeof(*q->slots));
+    q->mask = size - 1;
+    q->head = 0;
+    q->tail = 0;
+
+    for (i = 0; i < size; i++) {
+        q->slots[i].seq = i;
+    }
+
+    uv_mutex_init(&q->overflow_lock);
+    q->overflow = NULL;
+    q->overflow_start = 0;
+    q->overflow_end = 0;
+    q->overflow_size = 0;
+    q->overflow_len = 0;
+}
+
+void MPSCQueueFree(MPSCQueue *q)
+{
+    RedisModule_Free(q->slots);
+    q->slots = NULL;
+
+    if (q->overflow) {
+        RedisModule_Free(q->overflow);
+        q->overflow = NULL;
+    }
+    uv_mutex_destroy(&q->overflow_lock);
+}
+
+static void pushOverflow(MPSCQueue *q, void *item)
+{
+    uv_mutex_lock(&q->overflow_lock);
+
+    if (q->overflow_end == q->overflow_size) {
+        unsigned long len = q->overflow_end - q->overflow_start;
+
+        /* Reclaim the space of taken items first, grow if that's not enough */
+        if (q->overflow_start > 0) {
+            memmove(q->overflow, q->overflow + q->overflow_start, len * sizeof(void *));
+            q->overflow_start = 0;
+            q->overflow_end = len;
+        }
+        if (len == q->overflow_size) {
+            q->overflow_size = q->overflow_size ? q->overflow_size * 2 : 64;
+            q->overflow = RedisModule_Realloc(q->overflow, q->overflow_size * sizeof(void *));
+        }
+    }
+
+    q->overflow[q->overflow_end++] = item;
+    __atomic_store_n(&q->overflow_len, q->overflow_end - q->overflow_start, __ATOMIC_RELEASE);
+
+    uv_mutex_unlock(&q->overflow_lock);
+}
+
+static int popOverflow(MPSCQueue *q, void **items, int max)
+{
+    int n = 0;
+
+    uv_mutex_lock(&q->overflow_lock);
+
+    while (n < max && q->overflow_start < q->overflow_end) {
+        items[n++] = q->overflow[q->overflow_start++];
+    }
+    if (q->overflow_start == q->overflow_end) {
+        q->overflow_start = q->overflow_end = 0;
+    }
+    __atomic_store_n(&q->overflow_len, q->overflow_end - q->overflow_start, __ATOMIC_RELEASE);
+
+    uv_mutex_unlock(&q->overflow_lock);
+
+    return n;
+}
+
+/* Adds an item to the queue. Returns false if the ring was full, or still
+ * had items overflowing it, so the item was put on the overflow list.
+ */
+bool MPSCQueuePush(MPSCQueue *q, void *item)
+{
+    unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    MPSCQueueSlot *slot;
+
+    if (__atomic_load_n(&q->overflow_len, __ATOMIC_ACQUIRE)) {
+        pushOverflow(q, item);
+        return false;
+    }
+
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long diff = (long) (seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            pushOverflow(q, item);
+            return false;
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Takes up to 'max' items from the queue, in order. Returns the number of
+ * items taken. May only be called by the consumer thread.
+ */
+int MPSCQueuePopBatch(MPSCQueue *q, void **items, int max)
+{
+    int n = 0;
+
+    while (n < max) {
+        MPSCQueueSlot *slot = &q->slots[q->head & q->mask];
+
+        /* Empty, or the next producer has not finished writing its item */
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->head + 1) {
+            break;
+        }
+
+        items[n++] = slot->item;
+        __atomic_store_n(&slot->seq, q->head + q->mask + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELAXED);
+    }
+
+    /* Overflow items are newer than anything on the ring, including items a
+     * producer has claimed a position for but not written yet.
+     */
+    if (n < max && __atomic_load_n(&q->overflow_len, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->head) {
+        n += popOverflow(q, items + n, max - n);
+    }
+
+    return n;
+}
+
+/* Returns the number of items in the queue; only a hint while producers
+ * are active.
+ */
+unsigned long MPSCQueueLen(MPSCQueue *q)
+{
+    unsigned long head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    unsigned long tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    return tail - head + __atomic_load_n(&q->overflow_len, __ATOMIC_RELAXED);
+}
@@ -35,12 +35,19 @@ const char *RaftReqTypeStr[] = {
     "RR_SHARDGROUP_LINK",
     "RR_TRANSFER_LEADER",
     "RR_TIMEOUT_NOW",
+    "RR_READINDEX",
 };
 
 /* Forward declarations */
 static void initRaftLibrary(RedisRaftCtx *rr);
 static void configureFromSnapshot(RedisRaftCtx *rr);
 static void applyShardGroupChange(RedisRaftCtx *rr, raft_entry_t *entry);
+static void notifyLogSynced(void *arg);
+static void handleLogSynced(uv_async_t *handle);
+static void appendWriteBatch(RedisRaftCtx *rr);
+static void processFollowerReads(RedisRaftCtx *rr);
+static void updateLocalReads(RedisRaftCtx *rr);
+static void disableLocalReads(RedisRaftCtx *rr);
 static RaftReqHandler RaftReqHandlers[];
 
 static bool processExiting = false;
@@ -64,6 +71,7 @@ static RaftReq *entryDetachRaftReq(RedisRaftCtx *rr, raft_entry_t *entry)
     entry->user_data = NULL;
     entry->free_func = NULL;
     rr->client_attached_entries--;
+    rr->client_attached_bytes -= entry->data_len;
 
     return req;
 }
@@ -76,12 +84,16 @@ static void entryFreeAttachedRaftReq(raft_entry_t *ety)
 {
     RaftReq *req = entryDetachRaftReq(&redis_raft, ety);
 
-    if (req) {
+    while (req) {
+        RaftReq *next = req->type == RR_REDISCOMMAND ? req->r.redis.batch_next : NULL;
+
         RedisModule_ReplyWithError(req->ctx, "TIMEOUT not committed yet");
         RaftReqFree(req);
+        req = next;
     }
 
-    RedisModule_Free(ety);
+    /* Entries are allocated by the Raft library, see raft_set_heap_functions() */
+    PoolHeapFree(ety);
 }
 
 /* Attach a RaftReq to a Raft log entry. The common case for this is when a user request
@@ -96,6 +108,7 @@ static void entryAttachRaftReq(RedisRaftCtx *rr, raft_entry_t *entry, RaftReq *r
     entry->user_data = req;
     entry->free_func = entryFreeAttachedRaftReq;
     rr->client_attached_entries++;
+    rr->client_attached_bytes += entry->data_len;
 }
 
 /* ------------------------------------ RaftRedisCommand ------------------------------------ */
@@ -186,6 +199,116 @@ static void executeRaftRedisCommandArray(RaftRedisCommandArray *array,
     }
 }
 
+/* Free a request along with the requests batched after it, see appendWriteBatch() */
+static void freeRaftReqBatch(RaftReq *req)
+{
+    while (req) {
+        RaftReq *next = req->r.redis.batch_next;
+        RaftReqFree(req);
+        req = next;
+    }
+}
+
+/* Execute the commands of the requests appended in a single entry, delivering
+ * the reply to each command to the request it came from.
+ */
+static void executeWriteBatch(RedisRaftCtx *rr, RaftReq *req)
+{
+    uint64_t now = uv_hrtime();
+
+    while (req) {
+        if (req->r.redis.proxy_batch) {
+            RedisModule_ReplyWithArray(req->ctx, req->r.redis.cmds.len);
+        }
+        executeRaftRedisCommandArray(&req->r.redis.cmds, req->ctx, req->ctx);
+        LatencyHistogramAdd(&rr->commit_latency.hist, (now - req->submit_time) / 1000);
+        req = req->r.redis.batch_next;
+    }
+}
+
+/* Committed entries are applied holding the Redis lock, which is acquired once
+ * for a run of entries rather than for every entry. It is released once
+ * raft_apply_all() is done, or earlier if it has been held for longer than
+ * raft-apply-lock-budget, so the main thread is not starved.
+ */
+static void applyLockAcquire(RedisRaftCtx *rr)
+{
+    if (rr->apply_lock.held) {
+        return;
+    }
+
+    uint64_t start = uv_hrtime();
+    RedisModule_ThreadSafeContextLock(rr->ctx);
+
+    rr->apply_lock.held = true;
+    rr->apply_lock.acquired = uv_hrtime();
+    rr->apply_lock_count++;
+    rr->apply_lock_wait_usec += (rr->apply_lock.acquired - start) / 1000;
+}
+
+static void applyLockRelease(RedisRaftCtx *rr)
+{
+    if (!rr->apply_lock.held) {
+        return;
+    }
+
+    if (rr->released_cmds.len) {
+        RaftRedisCommandArrayFree(&rr->released_cmds);
+    }
+    RedisModule_ThreadSafeContextUnlock(rr->ctx);
+    rr->apply_lock.held = false;
+
+    unsigned long long hold_usec = (uv_hrtime() - rr->apply_lock.acquired) / 1000;
+    rr->apply_lock_hold_usec += hold_usec;
+    if (hold_usec > rr->apply_lock_max_hold_usec) {
+        rr->apply_lock_max_hold_usec = hold_usec;
+    }
+}
+
+/* Client arguments are held rather than copied, see holdClientString(), so
+ * their reference count is shared with the main thread and is not atomic.
+ * They are only released holding the Redis lock; when the Raft thread frees
+ * them without it, they are set aside until applyLockRelease() or the next
+ * raft_periodic() call.
+ */
+static bool holdsRedisLock(RedisRaftCtx *rr)
+{
+    uv_thread_t self = uv_thread_self();
+    return rr->apply_lock.held || !uv_thread_equal(&self, &rr->thread);
+}
+
+static void releaseClientCommands(RedisRaftCtx *rr, RaftRedisCommandArray *cmds)
+{
+    if (!holdsRedisLock(rr)) {
+        RaftRedisCommandArrayMove(&rr->released_cmds, cmds);
+    }
+    RaftRedisCommandArrayFree(cmds);
+}
+
+static void releaseClientString(RedisRaftCtx *rr, RedisModuleString *str)
+{
+    if (!str) {
+        return;
+    }
+    if (holdsRedisLock(rr)) {
+        RedisModule_FreeString(NULL, str);
+        return;
+    }
+
+    RaftRedisCommand *cmd = RaftRedisCommandArrayExtend(&rr->released_cmds);
+    cmd->argc = 1;
+    cmd->argv = RedisModule_Alloc(sizeof(RedisModuleString *));
+    cmd->argv[0] = str;
+}
+
+static void releaseSetAsideCommands(RedisRaftCtx *rr)
+{
+    if (rr->released_cmds.len && !rr->apply_lock.held) {
+        applyLockAcquire(rr);
+        applyLockRelease(rr);
+    }
+}
+
 /*
  * Execution of Raft log on the local instance.
  *
@@ -198,24 +321,26 @@ static void executeLogEntry(RedisRaftCtx *rr, raft_entry_t *entry, raft_index_t
 {
     assert(entry->type == RAFT_LOGTYPE_NORMAL);
 
-    /* TODO: optimize and avoid deserialization here, we can use the
-     * original argv in RaftReq
+    /* A locally initiated entry still has the commands it was created from
+     * attached, so only entries received from another node are deserialized.
      */
-
+    RaftReq *req = entry->user_data;
     RaftRedisCommandArray entry_cmds = { 0 };
-    if (RaftRedisCommandArrayDeserialize(&entry_cmds, entry->data, entry->data_len) != RR_OK) {
+
+    if (!req && RaftRedisCommandArrayDeserialize(&entry_cmds, entry->data, entry->data_len) != RR_OK) {
         PANIC("Invalid Raft entry");
     }
 
-    RaftReq *req = entry->user_data;
-    RedisModuleCtx *ctx = req ? req->ctx : rr->ctx;
-
     /* Redis Module API requires commands executing on a locked thread
      * safe context.
      */
 
-    RedisModule_ThreadSafeContextLock(ctx);
-    executeRaftRedisCommandArray(&entry_cmds, ctx, req? req->ctx : NULL);
+    applyLockAcquire(rr);
+    if (req) {
+        executeWriteBatch(rr, req);
+    } else {
+        executeRaftRedisCommandArray(&entry_cmds, rr->ctx, NULL);
+    }
 
     /* Update snapshot info in Redis dataset. This must be done now so it's
      * always consistent with what we applied and we never end up applying
@@ -224,13 +349,15 @@ static void executeLogEntry(RedisRaftCtx *rr, raft_entry_t *entry, raft_index_t
     rr->snapshot_info.last_applied_term = entry->term;
     rr->snapshot_info.last_applied_idx = entry_idx;
 
-    RedisModule_ThreadSafeContextUnlock(ctx);
+    if ((uv_hrtime() - rr->apply_lock.acquired) / 1000 >= rr->config->raft_apply_lock_budget) {
+        applyLockRelease(rr);
+    }
     RaftRedisCommandArrayFree(&entry_cmds);
 
     if (req) {
         /* Free request now, we don't need it anymore */
         entryDetachRaftReq(rr, entry);
-        RaftReqFree(req);
+        freeRaftReqBatch(req);
     }
 }
 
@@ -266,10 +393,10 @@ static void handleRequestVoteResponse(redisAsyncContext *c, void *r, void *privd
 
     redisReply *reply = r;
 
-    NodeDismissPendingResponse(node);
+    NodeDismissPendingResponse(node, false);
     if (!reply) {
         NODE_LOG_DEBUG(node, "RAFT.REQUESTVOTE failed: connection dropped.");
-        ConnMarkDisconnected(node->conn);
+        ConnMarkDisconnected(NodeGetRaftConn(node));
         return;
     }
     if (reply->type == REDIS_REPLY_ERROR) {
@@ -313,14 +440,15 @@ static int raftSendRequestVote(raft_server_t *raft, void *user_data,
         raft_node_t *raft_node, msg_requestvote_t *msg)
 {
     Node *node = (Node *) raft_node_get_udata(raft_node);
+    Connection *conn = NodeGetRaftConn(node);
 
-    if (!ConnIsConnected(node->conn)) {
-        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(node->conn));
+    if (!ConnIsConnected(conn)) {
+        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(conn));
         return 0;
     }
 
     /* RAFT.REQUESTVOTE <src_node_id> <term> <candidate_id> <last_log_idx> <last_log_term> */
-    if (redisAsyncCommand(ConnGetRedisCtx(node->conn), handleRequestVoteResponse,
+    if (redisAsyncCommand(ConnGetRedisCtx(conn), handleRequestVoteResponse,
                 node, "RAFT.REQUESTVOTE %d %d %d:%ld:%d:%ld:%ld:%d",
                 raft_node_get_id(raft_node),
                 raft_get_nodeid(raft),
@@ -345,12 +473,12 @@ static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *pri
     Node *node = privdata;
     RedisRaftCtx *rr = node->rr;
 
-    NodeDismissPendingResponse(node);
+    NodeDismissPendingResponse(node, false);
 
     redisReply *reply = r;
     if (!reply) {
         NODE_TRACE(node, "RAFT.AE failed: connection dropped.");
-        ConnMarkDisconnected(node->conn);
+        ConnMarkDisconnected(NodeGetRaftConn(node));
         return;
     }
     if (reply->type == REDIS_REPLY_ERROR) {
@@ -386,74 +514,93 @@ static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *pri
     /* Maybe we have pending stuff to apply now */
     raft_apply_all(rr->raft);
     raft_process_read_queue(rr->raft);
+
+    /* The response may have renewed our lease */
+    updateLocalReads(rr);
+}
+
+/* Returns the encoded entries buffer of a RAFT.AE message. The last one is
+ * reused when followers need the same entries: entries with the same index
+ * and term are identical, and so are all entries preceding them.
+ */
+static const char *getEncodedAEEntries(RedisRaftCtx *rr, msg_appendentries_t *msg, size_t *len)
+{
+    raft_term_t last_term = msg->n_entries ? msg->entries[msg->n_entries - 1]->term : 0;
+
+    if (!rr->ae_entries.buf ||
+        rr->ae_entries.first_idx != msg->prev_log_idx + 1 ||
+        rr->ae_entries.n_entries != msg->n_entries ||
+        rr->ae_entries.last_term != last_term) {
+        if (rr->ae_entries.buf) {
+            RedisModule_Free(rr->ae_entries.buf);
+        }
+
+        rr->ae_entries.buf = RaftAEEncodeEntries(msg->entries, msg->n_entries, &rr->ae_entries.len);
+        rr->ae_entries.first_idx = msg->prev_log_idx + 1;
+        rr->ae_entries.n_entries = msg->n_entries;
+        rr->ae_entries.last_term = last_term;
+    }
+
+    *len = rr->ae_entries.len;
+    return rr->ae_entries.buf;
 }
 
 static int raftSendAppendEntries(raft_server_t *raft, void *user_data,
         raft_node_t *raft_node, msg_appendentries_t *msg)
 {
     Node *node = (Node *) raft_node_get_udata(raft_node);
+    Connection *conn = NodeGetRaftConn(node);
 
-    int argc = 5 + msg->n_entries * 2;
-    char **argv = NULL;
-    size_t *argvlen = NULL;
+    if (!ConnIsConnected(conn)) {
+        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(conn));
+        return -1;
+    }
 
-    if (!ConnIsConnected(node->conn)) {
-        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(node->conn));
-        return 0;
+    /* Messages are sent ahead of responses, up to a limit. Once a response
+     * arrives, the Raft library sends the next one.
+     */
+    if (node->pending_raft_response_num >= node->rr->config->raft_ae_max_inflight) {
+        node->ae_window_full++;
+        return -1;
     }
 
-    argv = RedisModule_Alloc(sizeof(argv[0]) * argc);
-    argvlen = RedisModule_Alloc(sizeof(argvlen[0]) * argc);
+    /* Entries are fetched right before sending, so anything found in the
+     * cache now was served from it.
+     */
+    unsigned long hits = EntryCacheCountRange(node->rr->logcache, msg->prev_log_idx + 1, msg->n_entries);
+    node->cache_hits += hits;
+    node->cache_misses += msg->n_entries - hits;
 
     char target_node_str[12];
     char source_node_str[12];
-    char msg_str[100];
-    char nentries_str[12];
-
-    argv[0] = "RAFT.AE";
-    argvlen[0] = strlen(argv[0]);
-
-    argv[1] = target_node_str;
-    argvlen[1] = snprintf(target_node_str, sizeof(target_node_str)-1, "%d", raft_node_get_id(raft_node));
-
-    argv[2] = source_node_str;
-    argvlen[2] = snprintf(source_node_str, sizeof(source_node_str)-1, "%d", raft_get_nodeid(raft));
-
-    argv[3] = msg_str;
-    argvlen[3] = snprintf(msg_str, sizeof(msg_str)-1, "%d:%ld:%ld:%ld:%ld:%lu",
-            msg->leader_id,
-            msg->term,
-            msg->prev_log_idx,
-            msg->prev_log_term,
-            msg->leader_commit,
-            msg->msg_id);
-
-    argv[4] = nentries_str;
-    argvlen[4] = snprintf(nentries_str, sizeof(nentries_str)-1, "%d", msg->n_entries);
-
-    int i;
-    for (i = 0; i < msg->n_entries; i++) {
-        raft_entry_t *e = msg->entries[i];
-        argv[5 + i*2] = RedisModule_Alloc(64);
-        argvlen[5 + i*2] = snprintf(argv[5 + i*2], 63, "%ld:%d:%d", e->term, e->id, e->type);
-        argvlen[6 + i*2] = e->data_len;
-        argv[6 + i*2] = e->data;
-    }
+    RaftAEHeader hdr;
+    size_t entries_len;
+
+    RaftAEEncodeHeader(&hdr, msg);
+    const char *entries = getEncodedAEEntries(node->rr, msg, &entries_len);
+
+    const char *argv[5] = {
+        "RAFT.AE",
+        target_node_str,
+        source_node_str,
+        (const char *) &hdr,
+        entries
+    };
+    size_t argvlen[5] = {
+        strlen(argv[0]),
+        snprintf(target_node_str, sizeof(target_node_str)-1, "%d", raft_node_get_id(raft_node)),
+        snprintf(source_node_str, sizeof(source_node_str)-1, "%d", raft_get_nodeid(raft)),
+        sizeof(hdr),
+        entries_len
+    };
 
-    if (redisAsyncCommandArgv(ConnGetRedisCtx(node->conn), handleAppendEntriesResponse,
-                node, argc, (const char **)argv, argvlen) != REDIS_OK) {
+    if (redisAsyncCommandArgv(ConnGetRedisCtx(conn), handleAppendEntriesResponse,
+                node, 5, argv, argvlen) != REDIS_OK) {
         NODE_TRACE(node, "failed appendentries");
-    } else{
-        NodeAddPendingResponse(node, false);
-    }
-
-    for (i = 0; i < msg->n_entries; i++) {
-        RedisModule_Free(argv[5 + i*2]);
+        return -1;
     }
 
-    RedisModule_Free(argv);
-    RedisModule_Free(argvlen);
-
+    NodeAddPendingResponse(node, false);
     return 0;
 }
 
@@ -464,12 +611,12 @@ static void handleTimeoutNowResponse(redisAsyncContext *c, void *r, void *privda
     Node *node = privdata;
     //RedisRaftCtx *rr = node->rr;
 
-    NodeDismissPendingResponse(node);
+    NodeDismissPendingResponse(node, false);
 
     redisReply *reply = r;
     if (!reply) {
         NODE_TRACE(node, "RAFT.TIMEOUT_NOW failed: connection dropped.");
-        ConnMarkDisconnected(node->conn);
+        ConnMarkDisconnected(NodeGetRaftConn(node));
         return;
     }
     if (reply->type == REDIS_REPLY_ERROR) {
@@ -486,13 +633,14 @@ static void handleTimeoutNowResponse(redisAsyncContext *c, void *r, void *privda
 static int raftSendTimeoutNow(raft_server_t *raft, raft_node_t *raft_node)
 {
     Node *node = raft_node_get_udata(raft_node);
+    Connection *conn = NodeGetRaftConn(node);
 
-    if (!ConnIsConnected(node->conn)) {
-        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(node->conn));
+    if (!ConnIsConnected(conn)) {
+        NODE_TRACE(node, "not connected, state=%s", ConnGetStateStr(conn));
         return 0;
     }
 
-    if (redisAsyncCommand(ConnGetRedisCtx(node->conn), handleTimeoutNowResponse,
+    if (redisAsyncCommand(ConnGetRedisCtx(conn), handleTimeoutNowResponse,
                           node, "RAFT.TIMEOUT_NOW") != REDIS_OK) {
         NODE_TRACE(node, "failed timeout now");
     } else {
@@ -680,7 +828,7 @@ void raftNotifyMembershipEvent(raft_server_t *raft, void *user_data, raft_node_t
         case RAFT_MEMBERSHIP_REMOVE:
             node = raft_node_get_udata(raft_node);
             if (node != NULL) {
-                ConnAsyncTerminate(node->conn);
+                NodeTerminate(node);
                 raft_node_set_udata(raft_node, NULL);
             }
             break;
@@ -723,6 +871,23 @@ static char *raftMembershipInfoString(raft_server_t *raft)
     return buf;
 }
 
+/* The read lease is timed with the monotonic clock, which keeps going while
+ * we're stalled (e.g. waiting for the Redis lock) and miss raft_periodic()
+ * calls. Other nodes may elect a new leader in the meantime.
+ */
+static long raftTimestamp(raft_server_t *raft, void *user_data)
+{
+    return (long) (uv_hrtime() / 1000000);
+}
+
+static void raftApplyLogDone(raft_server_t *raft, void *user_data)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) user_data;
+
+    applyLockRelease(rr);
+    processFollowerReads(rr);
+}
+
 static void handleTransferLeaderComplete(raft_server_t *raft, raft_transfer_state_e state);
 
 /* just keep libraft callbacks together
@@ -735,6 +900,9 @@ static void raftNotifyTransferEvent(raft_server_t *raft, void *user_data, raft_t
 
 static void raftNotifyStateEvent(raft_server_t *raft, void *user_data, raft_state_e state)
 {
+    /* Reads go through the Raft thread until we publish otherwise */
+    disableLocalReads((RedisRaftCtx *) user_data);
+
     switch (state) {
         case RAFT_STATE_FOLLOWER:
             LOG_INFO("State change: Node is now a follower, term %ld",
@@ -778,7 +946,9 @@ raft_cbs_t redis_raft_callbacks = {
     .notify_membership_event = raftNotifyMembershipEvent,
     .notify_state_event = raftNotifyStateEvent,
     .send_timeoutnow = raftSendTimeoutNow,
+    .applylog_done = raftApplyLogDone,
     .notify_transfer_event = raftNotifyTransferEvent,
+    .timestamp = raftTimestamp,
 };
 
 /* ------------------------------------ Raft Thread ------------------------------------ */
@@ -818,6 +988,8 @@ RRStatus applyLoadedRaftLog(RedisRaftCtx *rr)
             rr->snapshot_info.last_applied_term);
     }
 
+    resetRaftLogSync(rr);
+
     /* Special case: if no other nodes, set commit index to the latest
      * entry in the log.
      */
@@ -897,7 +1069,11 @@ static void handleLoadingState(RedisRaftCtx *rr)
             configureFromSnapshot(rr);
         }
 
-        if (loadRaftLog(rr) == RR_OK) {
+        uint64_t start = uv_hrtime();
+        RRStatus ret = loadRaftLog(rr);
+        rr->log_load_usec = (uv_hrtime() - start) / 1000;
+
+        if (ret == RR_OK) {
             if (rr->log->snapshot_last_term) {
                 LOG_INFO("Loading: Log starts from snapshot term=%lu, index=%lu",
                         rr->log->snapshot_last_term, rr->log->snapshot_last_idx);
@@ -905,7 +1081,12 @@ static void handleLoadingState(RedisRaftCtx *rr)
                 LOG_INFO("Loading: Log is complete.");
             }
 
+            start = uv_hrtime();
             applyLoadedRaftLog(rr);
+            rr->log_apply_usec = (uv_hrtime() - start) / 1000;
+
+            LOG_INFO("Loading: Log opened in %llu usec, read in %llu usec, applied in %llu usec",
+                     rr->log_open_usec, rr->log_load_usec, rr->log_apply_usec);
             rr->state = REDIS_RAFT_UP;
         } else {
             rr->state = REDIS_RAFT_UNINITIALIZED;
@@ -924,9 +1105,62 @@ static void shutdownAfterRemoval(RedisRaftCtx *rr)
         archiveSnapshot(rr);
     }
 
+    RaftLogWriterFree(rr->log_writer);
+    rr->log_writer = NULL;
+
     exit(0);
 }
 
+/* Returns the first index the log cache should keep, which is the first entry
+ * not yet applied or, on a leader, the lowest next index of any follower.
+ */
+static raft_index_t getCacheKeepIdx(RedisRaftCtx *rr)
+{
+    raft_index_t keep_idx = raft_get_last_applied_idx(rr->raft) + 1;
+
+    if (raft_is_leader(rr->raft)) {
+        raft_node_t *me = raft_get_my_node(rr->raft);
+        int i;
+
+        for (i = 0; i < raft_get_num_nodes(rr->raft); i++) {
+            raft_node_t *node = raft_get_node_from_idx(rr->raft, i);
+            if (node != me && raft_node_get_next_idx(node) < keep_idx) {
+                keep_idx = raft_node_get_next_idx(node);
+            }
+        }
+    }
+
+    return keep_idx;
+}
+
+/* Commit latency is measured over one second windows. When the p99 commit
+ * latency of a window is over commit-latency-target, writes are shed until a
+ * window is back under the target, see admitWrite().
+ */
+static void updateCommitLatency(RedisRaftCtx *rr)
+{
+    uint64_t now = uv_hrtime();
+
+    if (now - rr->commit_latency.window_start < 1000000000) {
+        return;
+    }
+
+    LatencyHistogram *hist = &rr->commit_latency.hist;
+    unsigned long long target_usec = rr->config->commit_latency_target * 1000;
+    bool shedding;
+
+    rr->commit_latency.p99_usec = LatencyHistogramPercentile(hist, 99);
+    shedding = target_usec && rr->commit_latency.p99_usec > target_usec;
+    if (shedding != rr->commit_latency.shedding) {
+        LOG_VERBOSE("Commit latency p99 is %llu usec, %s shedding writes",
+                    rr->commit_latency.p99_usec, shedding ? "started" : "stopped");
+    }
+    rr->commit_latency.shedding = shedding;
+
+    LatencyHistogramReset(hist);
+    rr->commit_latency.window_start = now;
+}
+
 static void callRaftPeriodic(uv_timer_t *handle)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
@@ -941,6 +1175,8 @@ static void callRaftPeriodic(uv_timer_t *handle)
      */
     if (rr->state == REDIS_RAFT_LOADING) {
         handleLoadingState(rr);
+    } else {
+        releaseSetAsideCommands(rr);
     }
 
     /* Proceed only if we're initialized */
@@ -964,8 +1200,10 @@ static void callRaftPeriodic(uv_timer_t *handle)
 
     ret = raft_periodic(rr->raft, rr->config->raft_interval);
     if (ret == 0) {
+        syncRaftLog(rr);
         ret = raft_apply_all(rr->raft);
     }
+    updateLocalReads(rr);
 
     if (ret == RAFT_ERR_SHUTDOWN) {
         shutdownAfterRemoval(rr);
@@ -973,9 +1211,17 @@ static void callRaftPeriodic(uv_timer_t *handle)
 
     assert(ret == 0);
 
+    updateCommitLatency(rr);
+
     /* Compact cache */
     if (rr->config->raft_log_max_cache_size) {
-        EntryCacheCompact(rr->logcache, rr->config->raft_log_max_cache_size);
+        size_t tail_size = rr->config->raft_log_cache_tail_size;
+        if (tail_size > rr->config->raft_log_max_cache_size) {
+            tail_size = rr->config->raft_log_max_cache_size;
+        }
+
+        EntryCacheCompact(rr->logcache, rr->config->raft_log_max_cache_size,
+                          tail_size, getCacheKeepIdx(rr));
     }
 
     /* Initiate snapshot if log size exceeds raft-log-file-max */
@@ -1007,6 +1253,16 @@ static void callHandleNodeStates(uv_timer_t *handle)
     HandleNodeStates(rr);
 }
 
+/* Syncs the log once a second when using the 'everysec' fsync policy */
+static void callLogFlush(uv_timer_t *handle)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
+
+    if (rr->log && RaftLogWriterFlush(rr->log_writer, rr->log) != RR_OK) {
+        PANIC("Failed to sync Raft log: %s", strerror(errno));
+    }
+}
+
 /* Main Raft thread, which handles:
  * 1. The libuv loop for managing all connections with other Raft nodes.
  * 2. All Raft periodic tasks.
@@ -1026,6 +1282,7 @@ static void RedisRaftThread(void *arg)
             rr->config->raft_interval, rr->config->raft_interval);
     uv_timer_start(&rr->node_reconnect_timer, callHandleNodeStates, 0,
             rr->config->reconnect_interval);
+    uv_timer_start(&rr->log_flush_timer, callLogFlush, 1000, 1000);
     uv_run(rr->loop, UV_RUN_DEFAULT);
 }
 
@@ -1186,6 +1443,19 @@ static void initRaftLibrary(RedisRaftCtx *rr)
     }
     raft_set_election_timeout(rr->raft, rr->config->election_timeout);
     raft_set_request_timeout(rr->raft, rr->config->request_timeout);
+    raft_set_appendentries_limits(rr->raft, rr->config->raft_ae_max_entries,
+                                  rr->config->raft_ae_max_size);
+
+    /* A follower's election timer advances by a whole interval on every
+     * raft_periodic() call, so it may run ahead of the clock by up to an
+     * interval.
+     */
+    raft_set_lease_maxdrift(rr->raft, rr->config->lease_max_drift + rr->config->raft_interval);
+
+    /* Our own log is synced by the log writer thread, so it only counts
+     * towards committing entries once the writer reports them durable.
+     */
+    raft_set_async_persistence(rr->raft, 1);
 
     // To avoid performance hit, get library logs only if log level is debug
     if (redis_raft_loglevel != LOGLEVEL_DEBUG) {
@@ -1193,6 +1463,7 @@ static void initRaftLibrary(RedisRaftCtx *rr)
     }
 
     raft_set_callbacks(rr->raft, &redis_raft_callbacks, rr);
+    resetRaftLogSync(rr);
 }
 
 static void configureFromSnapshot(RedisRaftCtx *rr)
@@ -1219,7 +1490,8 @@ static void configureFromSnapshot(RedisRaftCtx *rr)
 RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *config)
 {
     memset(rr, 0, sizeof(RedisRaftCtx));
-    STAILQ_INIT(&rr->rqueue);
+    STAILQ_INIT(&rr->sync_waiters);
+    STAILQ_INIT(&rr->read_index_waiters);
 
 
     /* Register an atexit handler to tell us we're exiting.  Redis offers no
@@ -1233,10 +1505,19 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
     uv_loop_init(rr->loop);
 
     /* Requests queue */
-    uv_mutex_init(&rr->rqueue_mutex);
+    for (int i = 0; i < RR_LANES; i++) {
+        MPSCQueueInit(&rr->rqueue[i], REDIS_RAFT_RQUEUE_SIZE);
+    }
     uv_async_init(rr->loop, &rr->rqueue_sig, RaftReqHandleQueue);
     uv_handle_set_data((uv_handle_t *) &rr->rqueue_sig, rr);
 
+    /* Start log writer thread */
+    uv_async_init(rr->loop, &rr->log_sync_sig, handleLogSynced);
+    uv_handle_set_data((uv_handle_t *) &rr->log_sync_sig, rr);
+    rr->log_writer = RaftLogWriterNew(notifyLogSynced, rr);
+    uv_timer_init(rr->loop, &rr->log_flush_timer);
+    uv_handle_set_data((uv_handle_t *) &rr->log_flush_timer, rr);
+
     /* Periodic timer */
     uv_timer_init(rr->loop, &rr->raft_periodic_timer);
     uv_handle_set_data((uv_handle_t *) &rr->raft_periodic_timer, rr);
@@ -1263,6 +1544,11 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
         PANIC("Raft initialization failed: invalid Redis configuration!");
     }
 
+    /* Raft messages from other nodes, if received on a dedicated port */
+    if (PeerListenerStart(rr) == RR_ERROR) {
+        return RR_ERROR;
+    }
+
     /* Cluster configuration */
     ShardingInfoInit(rr);
 
@@ -1278,7 +1564,11 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
      * or RAFT.CLUSTER JOIN command.
      */
 
-    if ((rr->log = RaftLogOpen(rr->config->raft_log_filename, rr->config, 0)) != NULL) {
+    uint64_t start = uv_hrtime();
+    rr->log = RaftLogOpen(rr->config->raft_log_filename, rr->config, RAFTLOG_KEEP_INDEX);
+    rr->log_open_usec = (uv_hrtime() - start) / 1000;
+
+    if (rr->log != NULL) {
         rr->state = REDIS_RAFT_LOADING;
     } else {
         rr->state = REDIS_RAFT_UNINITIALIZED;
@@ -1326,15 +1616,19 @@ void RaftReqFree(RaftReq *req)
                 RedisModule_Free(req->r.appendentries.msg.entries);
                 req->r.appendentries.msg.entries = NULL;
             }
+            /* Don't leave later replies to the peer waiting behind this one */
+            if (req->r.appendentries.peer_reply) {
+                PeerReplyError(req->r.appendentries.peer_reply, "ERR request dropped");
+            }
             break;
         case RR_REDISCOMMAND:
             if (req->ctx && req->r.redis.cmds.size) {
-                RaftRedisCommandArrayFree(&req->r.redis.cmds);
+                releaseClientCommands(&redis_raft, &req->r.redis.cmds);
             }
             // TODO: hold a reference from entry so we can disconnect our req
             break;
         case RR_SNAPSHOT:
-            RedisModule_FreeString(req->ctx, req->r.snapshot.data);
+            releaseClientString(&redis_raft, req->r.snapshot.data);
             break;
         case RR_CLUSTER_JOIN:
             NodeAddrListFree(req->r.cluster_join.addr);
@@ -1365,12 +1659,13 @@ void RaftReqFree(RaftReq *req)
 
         RedisModule_UnblockClient(req->client, NULL);
     }
-    RedisModule_Free(req);
+    ObjectPoolFree(&RaftReqPool, req);
 }
 
 RaftReq *RaftReqInit(RedisModuleCtx *ctx, enum RaftReqType type)
 {
-    RaftReq *req = RedisModule_Calloc(1, sizeof(RaftReq));
+    RaftReq *req = ObjectPoolAlloc(&RaftReqPool);
+    memset(req, 0, sizeof(*req));
     if (ctx != NULL) {
         req->client = RedisModule_BlockClient(ctx, NULL, NULL, NULL, 0);
         req->ctx = RedisModule_GetThreadSafeContext(req->client);
@@ -1391,38 +1686,185 @@ RaftReq *RaftDebugReqInit(RedisModuleCtx *ctx, enum RaftDebugReqType type)
     return req;
 }
 
+#define RQUEUE_DRAIN_BUDGET     2000    /* usec */
+
+static const char *RaftReqLaneStr[] = {
+    "consensus",
+    "read",
+    "write"
+};
+
+static enum RaftReqLane getRaftReqLane(RaftReq *req)
+{
+    switch (req->type) {
+        case RR_APPENDENTRIES:
+        case RR_REQUESTVOTE:
+        case RR_SNAPSHOT:
+        case RR_TIMEOUT_NOW:
+        case RR_READINDEX:
+            return RR_LANE_CONSENSUS;
+        case RR_REDISCOMMAND: {
+            unsigned int flags = CommandSpecGetAggregateFlags(&req->r.redis.cmds, CMD_SPEC_WRITE);
+            if (flags & CMD_SPEC_READONLY && !(flags & (CMD_SPEC_WRITE | CMD_SPEC_UNSUPPORTED))) {
+                return RR_LANE_READ;
+            }
+            return RR_LANE_WRITE;
+        }
+        default:
+            return RR_LANE_WRITE;
+    }
+}
+
+/* Hands a request over to the Raft thread. Any thread may submit requests.
+ *
+ * Requests are only reordered across lanes, never within one. Redis doesn't
+ * run a client's next command before its current one completes, so each
+ * client's requests still run in order.
+ */
 void RaftReqSubmit(RedisRaftCtx *rr, RaftReq *req)
 {
-    uv_mutex_lock(&rr->rqueue_mutex);
-    STAILQ_INSERT_TAIL(&rr->rqueue, req, entries);
-    uv_mutex_unlock(&rr->rqueue_mutex);
-    uv_async_send(&rr->rqueue_sig);
+    MPSCQueue *q = &rr->rqueue[getRaftReqLane(req)];
+
+    req->submit_time = uv_hrtime();
+
+    /* The ring only fills up if the Raft thread falls far behind. We may be
+     * holding the Redis lock the Raft thread needs to make progress, so we
+     * never wait for room: the request goes on the lane's overflow list.
+     */
+    if (!MPSCQueuePush(q, req)) {
+        __atomic_add_fetch(&rr->rqueue_full, 1, __ATOMIC_RELAXED);
+    }
+
+    /* No need to signal the Raft thread if it's awake already */
+    if (!__atomic_exchange_n(&rr->rqueue_awake, true, __ATOMIC_SEQ_CST)) {
+        uv_async_send(&rr->rqueue_sig);
+    }
 }
 
-static RaftReq *raft_req_fetch(RedisRaftCtx *rr)
+static unsigned long getRaftReqQueueLen(RedisRaftCtx *rr)
 {
-    RaftReq *r = NULL;
+    unsigned long len = 0;
+
+    for (int i = 0; i < RR_LANES; i++) {
+        len += MPSCQueueLen(&rr->rqueue[i]);
+    }
+    return len;
+}
 
-    uv_mutex_lock(&rr->rqueue_mutex);
-    if (!STAILQ_EMPTY(&rr->rqueue)) {
-        r = STAILQ_FIRST(&rr->rqueue);
-        STAILQ_REMOVE_HEAD(&rr->rqueue, entries);
+/* Takes the next batch of requests to handle. Messages from other nodes come
+ * first, as delaying them may cost us leadership. Reads are taken ahead of
+ * writes, but can't starve them: lanes take turns once the consensus lane is
+ * empty. The turn holds the lane to try next, and starts with the read lane.
+ */
+int RaftReqPopBatch(RedisRaftCtx *rr, RaftReq **batch, int *turn)
+{
+    int n = MPSCQueuePopBatch(&rr->rqueue[RR_LANE_CONSENSUS], (void **) batch, REDIS_RAFT_RQUEUE_BATCH_SIZE);
+    if (n > 0) {
+        return n;
     }
-    uv_mutex_unlock(&rr->rqueue_mutex);
 
-    return r;
+    for (int i = 0; i < 2; i++) {
+        int lane = *turn;
+
+        *turn = lane == RR_LANE_READ ? RR_LANE_WRITE : RR_LANE_READ;
+        if ((n = MPSCQueuePopBatch(&rr->rqueue[lane], (void **) batch, REDIS_RAFT_RQUEUE_BATCH_SIZE)) > 0) {
+            return n;
+        }
+    }
+
+    return 0;
 }
 
+/* Handles queued requests. Draining the queue yields to timers and I/O every
+ * RQUEUE_DRAIN_BUDGET microseconds, so a steady stream of requests doesn't
+ * hold back callRaftPeriodic().
+ */
 void RaftReqHandleQueue(uv_async_t *handle)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
-    RaftReq *req;
+    RaftReq *batch[REDIS_RAFT_RQUEUE_BATCH_SIZE];
+    uint64_t start = uv_hrtime();
+    int turn = RR_LANE_READ;
+    int i, n;
+
+    rr->rqueue_wakeups++;
+
+    do {
+        unsigned long len = getRaftReqQueueLen(rr);
+        if (len > rr->rqueue_max_len) {
+            rr->rqueue_max_len = len;
+        }
+
+        while ((n = RaftReqPopBatch(rr, batch, &turn)) > 0) {
+            uint64_t now = uv_hrtime();
+
+            for (i = 0; i < n; i++) {
+                unsigned long long wait = (now - batch[i]->submit_time) / 1000;
+
+                rr->rqueue_wait_usec += wait;
+                if (wait > rr->rqueue_max_wait_usec) {
+                    rr->rqueue_max_wait_usec = wait;
+                }
+
+                RaftReqHandle(rr, batch[i]);
+            }
+            rr->rqueue_reqs += n;
+
+            /* Still awake, so producers won't signal; come back on the
+             * next loop iteration.
+             */
+            if ((uv_hrtime() - start) / 1000 >= RQUEUE_DRAIN_BUDGET) {
+                rr->rqueue_budget_exhausted++;
+                uv_async_send(&rr->rqueue_sig);
+                goto done;
+            }
+        }
 
-    while ((req = raft_req_fetch(rr))) {
-        TRACE("RaftReqHandleQueue: req=%p, type=%s",
-                req, RaftReqTypeStr[req->type]);
-        RaftReqHandlers[req->type](rr, req);
+        /* Producers only signal us once we're no longer awake, so look for
+         * requests submitted before they could tell.
+         */
+        __atomic_store_n(&rr->rqueue_awake, false, __ATOMIC_SEQ_CST);
+    } while (getRaftReqQueueLen(rr) &&
+             !__atomic_exchange_n(&rr->rqueue_awake, true, __ATOMIC_SEQ_CST));
+
+done:
+    RaftReqHandleDone(rr);
+}
+
+void RaftReqHandle(RedisRaftCtx *rr, RaftReq *req)
+{
+    TRACE("RaftReqHandle: req=%p, type=%s", req, RaftReqTypeStr[req->type]);
+    RaftReqHandlers[req->type](rr, req);
+}
+
+/* Completes work deferred while handling a batch of requests */
+void RaftReqHandleDone(RedisRaftCtx *rr)
+{
+    /* Commands batched while draining the queue are appended, or proxied to
+     * the leader, now.
+     */
+    appendWriteBatch(rr);
+    ProxyBatchFlush(rr);
+
+    /* Group commit: all entries appended while draining the queue share a
+     * single fsync, after which held replies are released.
+     */
+    syncRaftLog(rr);
+
+    /* If we're a single node we can try to apply now, as we have no need
+     * or way to wait for AE responses to do that.
+     */
+    if (rr->raft && rr->state == REDIS_RAFT_UP &&
+        raft_get_current_idx(rr->raft) == raft_get_commit_idx(rr->raft)) {
+        raft_apply_all(rr->raft);
+    }
+
+    /* Reads queued while draining the queue share a single heartbeat round */
+    if (rr->raft && rr->state == REDIS_RAFT_UP) {
+        raft_process_read_queue(rr->raft);
     }
+
+    updateLocalReads(rr);
 }
 
 /* ------------------------------------ RaftReq Implementation ------------------------------------ */
@@ -1467,6 +1909,9 @@ static void handleTransferLeader(RedisRaftCtx *rr, RaftReq *req)
         goto exit;
     }
 
+    /* The target may take over without waiting for our lease to expire */
+    disableLocalReads(rr);
+
     if ((err = raft_transfer_leader(rr->raft, req->r.node_to_transfer_leader, 0)) != 0) {
         char e[128];
         switch (err) {
@@ -1549,20 +1994,126 @@ static void handleAppendEntries(RedisRaftCtx *rr, RaftReq *req)
                 &response)) != 0) {
         char msg[128];
         snprintf(msg, sizeof(msg)-1, "operation failed, error %d", err);
-        RedisModule_ReplyWithError(req->ctx, msg);
+        if (req->r.appendentries.peer_reply) {
+            PeerReplyError(req->r.appendentries.peer_reply, msg);
+            req->r.appendentries.peer_reply = NULL;
+        } else {
+            RedisModule_ReplyWithError(req->ctx, msg);
+        }
         goto exit;
     }
 
-    RedisModule_ReplyWithArray(req->ctx, 4);
-    RedisModule_ReplyWithLongLong(req->ctx, response.term);
-    RedisModule_ReplyWithLongLong(req->ctx, response.success);
-    RedisModule_ReplyWithLongLong(req->ctx, response.current_idx);
-    RedisModule_ReplyWithLongLong(req->ctx, response.msg_id);
+    /* Entries appended by this message are not durable yet, so the reply is
+     * held until the log writer reports they are synced.
+     */
+    req->r.appendentries.response = response;
+    STAILQ_INSERT_TAIL(&rr->sync_waiters, req, entries);
+    return;
 
 exit:
     RaftReqFree(req);
 }
 
+static void replyAppendEntries(RaftReq *req)
+{
+    msg_appendentries_response_t *response = &req->r.appendentries.response;
+
+    if (req->r.appendentries.peer_reply) {
+        PeerReplyAppendEntries(req->r.appendentries.peer_reply, response);
+        req->r.appendentries.peer_reply = NULL;
+        return;
+    }
+
+    RedisModule_ReplyWithArray(req->ctx, 4);
+    RedisModule_ReplyWithLongLong(req->ctx, response->term);
+    RedisModule_ReplyWithLongLong(req->ctx, response->success);
+    RedisModule_ReplyWithLongLong(req->ctx, response->current_idx);
+    RedisModule_ReplyWithLongLong(req->ctx, response->msg_id);
+}
+
+/* Reports the synced log index to the Raft library, which may commit more
+ * entries, and releases AppendEntries replies that were waiting for it.
+ */
+static void processSyncedLog(RedisRaftCtx *rr)
+{
+    raft_index_t synced_idx = RaftLogWriterSyncedIdx(rr->log_writer);
+    RaftReq *req;
+
+    if (rr->raft) {
+        raft_set_persisted_idx(rr->raft, synced_idx);
+    }
+
+    while ((req = STAILQ_FIRST(&rr->sync_waiters)) != NULL &&
+           req->r.appendentries.response.current_idx <= synced_idx) {
+        STAILQ_REMOVE_HEAD(&rr->sync_waiters, entries);
+        replyAppendEntries(req);
+        RaftReqFree(req);
+    }
+}
+
+/* Entries beyond the specified index were removed from the log, so replies
+ * still waiting for them to be synced can no longer acknowledge them. They
+ * are turned into rejections at that index, which the leader resolves by
+ * retrying, and no longer hold back the replies queued after them.
+ */
+void truncateSyncWaiters(RedisRaftCtx *rr, raft_index_t idx)
+{
+    RaftReq *req;
+
+    STAILQ_FOREACH(req, &rr->sync_waiters, entries) {
+        msg_appendentries_response_t *response = &req->r.appendentries.response;
+        if (response->current_idx > idx) {
+            response->success = 0;
+            response->current_idx = idx;
+        }
+    }
+}
+
+/* Called by the log writer thread once a sync completes */
+static void notifyLogSynced(void *arg)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) arg;
+    uv_async_send(&rr->log_sync_sig);
+}
+
+static void handleLogSynced(uv_async_t *handle)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
+
+    processSyncedLog(rr);
+
+    if (rr->raft && rr->state == REDIS_RAFT_UP) {
+        raft_apply_all(rr->raft);
+        raft_process_read_queue(rr->raft);
+    }
+}
+
+/* Hands all log entries appended since the last call over to the log writer
+ * thread, so they are synced with a single fsync while the Raft thread keeps
+ * going.
+ */
+void syncRaftLog(RedisRaftCtx *rr)
+{
+    if (rr->log && RaftLogWriterSync(rr->log_writer, rr->log) != RR_OK) {
+        PANIC("Failed to sync Raft log: %s", strerror(errno));
+    }
+
+    processSyncedLog(rr);
+}
+
+/* The log is durable as created or loaded, so the log writer and the Raft
+ * library start out with all entries synced.
+ */
+void resetRaftLogSync(RedisRaftCtx *rr)
+{
+    raft_index_t idx = RaftLogCurrentIdx(rr->log);
+
+    RaftLogWriterReset(rr->log_writer, idx);
+    if (rr->raft) {
+        raft_set_persisted_idx(rr->raft, idx);
+    }
+}
+
 static void handleCfgChange(RedisRaftCtx *rr, RaftReq *req)
 {
     raft_entry_t *entry;
@@ -1661,6 +2212,174 @@ exit:
     RaftReqFree(req);
 }
 
+/* Publishes until when read-only commands can be executed natively by the
+ * main thread instead of being handed over to us, see interceptRedisCommands().
+ * That's while we could serve them right away: as a leader with quorum reads
+ * disabled or a valid read lease.
+ *
+ * Clients in MULTI state must have their reads queued, and sharding requires
+ * hash slot validation, so these always go through the Raft thread.
+ */
+static void updateLocalReads(RedisRaftCtx *rr)
+{
+    uint64_t deadline = 0;
+
+    if (rr->raft && rr->state == REDIS_RAFT_UP && raft_is_leader(rr->raft) &&
+        !rr->config->sharding && !RedisModule_DictSize(multiClientState)) {
+        if (!rr->config->quorum_reads) {
+            deadline = UINT64_MAX;
+        } else if (rr->config->lease_reads) {
+            /* The lease is timed with raftTimestamp(), in milliseconds. Taking
+             * the time before the library does keeps the deadline within
+             * the lease, however long we're stalled after publishing it.
+             */
+            uint64_t now_ms = uv_hrtime() / 1000000;
+            int remaining = raft_get_read_lease_remaining(rr->raft);
+            if (remaining > 0) {
+                deadline = (now_ms + remaining) * 1000000;
+            }
+        }
+    }
+
+    __atomic_store_n(&rr->local_reads_deadline, deadline, __ATOMIC_RELEASE);
+}
+
+static void disableLocalReads(RedisRaftCtx *rr)
+{
+    __atomic_store_n(&rr->local_reads_deadline, 0, __ATOMIC_RELEASE);
+}
+
+bool RaftCanReadLocally(RedisRaftCtx *rr)
+{
+    return uv_hrtime() < __atomic_load_n(&rr->local_reads_deadline, __ATOMIC_ACQUIRE);
+}
+
+/* Calls cb once it's safe to serve a read as the leader: right away if
+ * quorum reads are disabled or we hold a read lease, otherwise once a round
+ * of heartbeats confirms we're still the leader.
+ */
+static void confirmReadLeadership(RedisRaftCtx *rr, func_read_request_callback_f cb, void *arg)
+{
+    if (!rr->config->quorum_reads) {
+        cb(arg, 1);
+        return;
+    }
+
+    if (rr->config->lease_reads) {
+        if (raft_has_read_lease(rr->raft)) {
+            rr->lease_read_hits++;
+            cb(arg, 1);
+            return;
+        }
+        rr->lease_read_misses++;
+    }
+
+    raft_queue_read_request(rr->raft, cb, arg);
+}
+
+static void replyReadIndex(void *arg, int can_read)
+{
+    RaftReq *req = (RaftReq *) arg;
+
+    if (!can_read) {
+        RedisModule_ReplyWithError(req->ctx, "TIMEOUT no quorum for read");
+    } else {
+        RedisModule_ReplyWithLongLong(req->ctx, raft_get_commit_idx(redis_raft.raft));
+    }
+
+    RaftReqFree(req);
+}
+
+/* Replies to RAFT.READINDEX with our commit index once our leadership is
+ * confirmed. Everything acknowledged to clients before the request was
+ * received is included by then.
+ */
+static void handleReadIndex(RedisRaftCtx *rr, RaftReq *req)
+{
+    if (checkRaftState(rr, req) == RR_ERROR ||
+        checkLeader(rr, req, NULL) == RR_ERROR) {
+        goto exit;
+    }
+
+    confirmReadLeadership(rr, replyReadIndex, req);
+    return;
+
+exit:
+    RaftReqFree(req);
+}
+
+/* Serves follower reads whose read index has been applied, in the order
+ * the leader returned them.
+ */
+static void processFollowerReads(RedisRaftCtx *rr)
+{
+    raft_index_t applied_idx = raft_get_last_applied_idx(rr->raft);
+    RaftReq *req;
+
+    while ((req = STAILQ_FIRST(&rr->read_index_waiters)) != NULL &&
+           req->r.redis.read_idx <= applied_idx) {
+        STAILQ_REMOVE_HEAD(&rr->read_index_waiters, entries);
+        handleReadOnlyCommand(req, 1);
+    }
+}
+
+static void handleReadIndexResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    RedisRaftCtx *rr = &redis_raft;
+    RaftReq *req = privdata;
+    redisReply *reply = r;
+
+    NodeDismissPendingResponse(req->r.redis.proxy_node, true);
+
+    if (!reply) {
+        ConnMarkDisconnected(req->r.redis.proxy_node->conn);
+        RedisModule_ReplyWithError(req->ctx, "TIMEOUT no reply from leader");
+        rr->follower_read_failed++;
+        goto exit;
+    }
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+        RedisModule_ReplyWithError(req->ctx, reply->str);
+        rr->follower_read_failed++;
+        goto exit;
+    }
+
+    if (reply->type != REDIS_REPLY_INTEGER) {
+        RedisModule_ReplyWithError(req->ctx, "ERR bad reply from leader");
+        rr->follower_read_failed++;
+        goto exit;
+    }
+
+    req->r.redis.read_idx = reply->integer;
+    STAILQ_INSERT_TAIL(&rr->read_index_waiters, req, entries);
+    processFollowerReads(rr);
+    return;
+
+exit:
+    RaftReqFree(req);
+}
+
+/* Serves a read-only command on a follower: the leader is only asked for its
+ * read index, and the command runs locally once we've applied it.
+ */
+static RRStatus sendReadIndexRequest(RedisRaftCtx *rr, RaftReq *req, Node *leader)
+{
+    redisAsyncContext *rc;
+    if (!ConnIsConnected(leader->conn) || !(rc = ConnGetRedisCtx(leader->conn))) {
+        return RR_ERROR;
+    }
+
+    req->r.redis.proxy_node = leader;
+    if (redisAsyncCommand(rc, handleReadIndexResponse, req, "RAFT.READINDEX") != REDIS_OK) {
+        return RR_ERROR;
+    }
+
+    NodeAddPendingResponse(leader, true);
+    rr->follower_reads++;
+
+    return RR_OK;
+}
+
 /* Handle MULTI/EXEC transactions here.
  *
  * If this logic was applied, the request is freeed (if necessary) and the
@@ -1701,7 +2420,7 @@ typedef struct MultiState {
 
 static void freeMultiState(MultiState *multiState)
 {
-    RaftRedisCommandArrayFree(&multiState->cmds);
+    releaseClientCommands(&redis_raft, &multiState->cmds);
     RedisModule_Free(multiState);
 }
 
@@ -1736,6 +2455,10 @@ static bool handleMultiExec(RedisRaftCtx *rr, RaftReq *req)
             multiState = RedisModule_Calloc(sizeof(MultiState), 1);
             RedisModule_DictSetC(multiClientState, &client_id, sizeof(client_id), multiState);
 
+            /* Reads must be queued from now on, but the main thread can't
+             * tell which client is in MULTI. */
+            disableLocalReads(rr);
+
             /* We put the MULTI as the first command in the array, as we still need to
              * distinguish single-MULTI array from a single command.
              */
@@ -1771,7 +2494,7 @@ static bool handleMultiExec(RedisRaftCtx *rr, RaftReq *req)
             req = NULL;
         } else {
             /* Just swap our commands with the EXEC command and proceed. */
-            RaftRedisCommandArrayFree(&req->r.redis.cmds);
+            releaseClientCommands(&redis_raft, &req->r.redis.cmds);
             RaftRedisCommandArrayMove(&req->r.redis.cmds, &multiState->cmds);
         }
 
@@ -1930,6 +2653,120 @@ static RRStatus handleSharding(RedisRaftCtx *rr, RaftReq *req)
     return RR_OK;
 }
 
+/* Append the commands batched by addToWriteBatch() to the log, as a single
+ * entry. All requests remain attached to the entry, so every client receives
+ * the reply to its own command when the entry is applied.
+ */
+static void appendWriteBatch(RedisRaftCtx *rr)
+{
+    RaftReq *head = rr->write_batch.head;
+    RaftReq *req;
+    int i = 0;
+
+    if (!head) {
+        return;
+    }
+
+    RaftRedisCommandArray cmds = {
+        .size = rr->write_batch.len,
+        .len = rr->write_batch.len,
+        .commands = RedisModule_Calloc(rr->write_batch.len, sizeof(RaftRedisCommand *))
+    };
+    for (req = head; req != NULL; req = req->r.redis.batch_next) {
+        cmds.commands[i++] = req->r.redis.cmds.commands[0];
+    }
+
+    rr->write_batch.head = NULL;
+    rr->write_batch.tail = NULL;
+    rr->write_batch.len = 0;
+    rr->write_batch.size = 0;
+
+    raft_entry_t *entry = RaftRedisCommandArraySerialize(&cmds);
+    RedisModule_Free(cmds.commands);
+
+    entry->id = rand();
+    entry->type = RAFT_LOGTYPE_NORMAL;
+    entryAttachRaftReq(rr, entry, head);
+    int e = raft_recv_entry(rr->raft, entry, &head->r.redis.response);
+    if (e != 0) {
+        entryDetachRaftReq(rr, entry);
+        raft_entry_release(entry);
+        for (req = head; req != NULL; req = req->r.redis.batch_next) {
+            replyRaftError(req->ctx, e);
+        }
+        freeRaftReqBatch(head);
+        return;
+    }
+
+    raft_entry_release(entry);
+
+    rr->write_batches++;
+    rr->write_batch_commands += cmds.len;
+}
+
+/* Writes are rejected rather than appended once too many entries, or too much
+ * data, are pending commit. While commit latency is over target, writes are
+ * only admitted when nothing else is pending, so the log keeps moving while
+ * the backlog drains.
+ */
+static bool admitWrite(RedisRaftCtx *rr, RaftReq *req)
+{
+    RedisRaftConfig *config = rr->config;
+
+    if ((config->max_pending_entries && rr->client_attached_entries >= config->max_pending_entries) ||
+        (config->max_pending_size &&
+         rr->client_attached_bytes + rr->write_batch.size >= config->max_pending_size)) {
+        RedisModule_ReplyWithError(req->ctx, "BUSY too many writes pending commit");
+        rr->rejected_pending_writes++;
+        return false;
+    }
+
+    if (rr->commit_latency.shedding && (rr->client_attached_entries || rr->write_batch.len)) {
+        RedisModule_ReplyWithError(req->ctx, "BUSY commit latency over target");
+        rr->shed_writes++;
+        return false;
+    }
+
+    return true;
+}
+
+/* Only single commands are batched. An empty MULTI/EXEC transaction is also a
+ * single command (MULTI), but needs an entry of its own to be replied to as a
+ * transaction.
+ */
+static bool isWriteBatchable(RaftReq *req)
+{
+    if (req->r.redis.cmds.len != 1) {
+        return false;
+    }
+
+    size_t cmd_len;
+    const char *cmd = RedisModule_StringPtrLen(req->r.redis.cmds.commands[0]->argv[0], &cmd_len);
+
+    return !(cmd_len == 5 && !strncasecmp(cmd, "MULTI", 5));
+}
+
+/* Queue a single command request to be appended along with other commands
+ * received while draining the request queue. The batch is appended once the
+ * queue is drained, or once it reaches raft-write-batch-size.
+ */
+static void addToWriteBatch(RedisRaftCtx *rr, RaftReq *req)
+{
+    req->r.redis.batch_next = NULL;
+    if (rr->write_batch.tail) {
+        rr->write_batch.tail->r.redis.batch_next = req;
+    } else {
+        rr->write_batch.head = req;
+    }
+    rr->write_batch.tail = req;
+    rr->write_batch.len++;
+    rr->write_batch.size += RaftRedisCommandArraySerializedSize(&req->r.redis.cmds);
+
+    if (rr->write_batch.size >= rr->config->raft_write_batch_size) {
+        appendWriteBatch(rr);
+    }
+}
+
 static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
 {
     Node *leader_proxy = NULL;
@@ -1951,7 +2788,7 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
      * commands we've received this as a RAFT.ENTRY input and bundling, probably through a
      * proxy, and bundling was done before.
      */
-    if (req->r.redis.cmds.len == 1) {
+    if (req->r.redis.cmds.len == 1 && !req->r.redis.proxy_batch) {
         if (handleMultiExec(rr, req)) {
             return;
         }
@@ -1967,7 +2804,7 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
     /* Handle intercepted commands. We do this also on non-leader nodes or if we don't
      * have a leader, so it's up to the commands to check these conditions if they have to.
      */
-    if (handleInterceptedCommands(rr, req)) {
+    if (!req->r.redis.proxy_batch && handleInterceptedCommands(rr, req)) {
         return;
     }
 
@@ -1979,13 +2816,55 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
         goto exit;
     }
 
+    /* Read-only commands may be served by followers, see sendReadIndexRequest().
+     *
+     * Normally we can expect a single command in the request, unless it is a
+     * MULTI/EXEC transaction in which case all queued commands are handled at once.
+     *
+     * A batch proxied by a follower is always appended, so it gets a single
+     * reply with an array of all replies, see executeWriteBatch().
+     */
+    unsigned int cmd_flags = CommandSpecGetAggregateFlags(&req->r.redis.cmds, CMD_SPEC_WRITE);
+    bool readonly = cmd_flags & CMD_SPEC_READONLY && !(cmd_flags & (CMD_SPEC_WRITE | CMD_SPEC_UNSUPPORTED)) &&
+                    !req->r.redis.proxy_batch;
+    bool follower_read = readonly && rr->config->follower_reads;
+    bool can_proxy = (rr->config->follower_proxy || follower_read) && !req->r.redis.proxy_batch;
+
     /* Confirm that we're the leader and handle redirect or proxying if not. */
-    if (checkLeader(rr, req, rr->config->follower_proxy ? &leader_proxy : NULL) == RR_ERROR) {
+    if (checkLeader(rr, req, can_proxy ? &leader_proxy : NULL) == RR_ERROR) {
         goto exit;
     }
 
+    if (leader_proxy && follower_read) {
+        if (sendReadIndexRequest(rr, req, leader_proxy) != RR_OK) {
+            RedisModule_ReplyWithError(req->ctx, "NOTLEADER Failed to request read index");
+            rr->follower_read_failed++;
+            goto exit;
+        }
+        return;
+    }
+
     /* Proxy */
     if (leader_proxy) {
+        if (rr->config->max_proxy_outstanding &&
+            rr->proxy_outstanding_reqs + rr->proxy_batch.len >= rr->config->max_proxy_outstanding) {
+            RedisModule_ReplyWithError(req->ctx, "BUSY too many commands proxied to leader");
+            rr->rejected_proxy_reqs++;
+            goto exit;
+        }
+
+        /* Writes are sent to the leader in batches, like they are appended
+         * to the log, see ProxyBatchAdd().
+         */
+        if (rr->config->raft_write_batch_size > 0 && !rr->config->sharding && isWriteBatchable(req) &&
+            cmd_flags & CMD_SPEC_WRITE && !(cmd_flags & CMD_SPEC_UNSUPPORTED)) {
+            ProxyBatchAdd(rr, req, leader_proxy);
+            return;
+        }
+
+        /* Keep commands in the order they were received */
+        ProxyBatchFlush(rr);
+
         if (ProxyCommand(rr, req, leader_proxy) != RR_OK) {
             RedisModule_ReplyWithError(req->ctx, "NOTLEADER Failed to proxy command");
             goto exit;
@@ -1993,26 +2872,30 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
         return;
     }
 
-    /* Handle the special case of read-only commands here: if quroum reads
-     * are enabled schedule the request to be processed when we have a guarantee
-     * we're still a leader. Otherwise, just process the reads.
-     *
-     * Normally we can expect a single command in the request, unless it is a
-     * MULTI/EXEC transaction in which case all queued commands are handled at once.
+    /* Handle the special case of read-only commands here: the request is
+     * processed once we have a guarantee we're still a leader, see
+     * confirmReadLeadership().
      */
-    unsigned int cmd_flags = CommandSpecGetAggregateFlags(&req->r.redis.cmds, CMD_SPEC_WRITE);
     if (cmd_flags & CMD_SPEC_UNSUPPORTED) {
         RedisModule_ReplyWithError(req->ctx, "ERR not supported by RedisRaft");
         goto exit;
-    } else if (cmd_flags & CMD_SPEC_READONLY && !(cmd_flags & CMD_SPEC_WRITE)) {
-        if (rr->config->quorum_reads) {
-            raft_queue_read_request(rr->raft, handleReadOnlyCommand, req);
-        } else {
-            handleReadOnlyCommand(req, 1);
-        }
+    } else if (readonly) {
+        confirmReadLeadership(rr, handleReadOnlyCommand, req);
+        return;
+    }
+
+    if (!admitWrite(rr, req)) {
+        goto exit;
+    }
+
+    if (rr->config->raft_write_batch_size > 0 && isWriteBatchable(req)) {
+        addToWriteBatch(rr, req);
         return;
     }
 
+    /* Keep entries in the order commands were received */
+    appendWriteBatch(rr);
+
     raft_entry_t *entry = RaftRedisCommandArraySerialize(&req->r.redis.cmds);
     entry->id = rand();
     entry->type = RAFT_LOGTYPE_NORMAL;
@@ -2027,15 +2910,9 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
 
     raft_entry_release(entry);
 
-    /* If we're a single node we can try to apply now, as we have no need
-     * or way to wait for AE responses to do that.
-     */
-    if (raft_get_current_idx(rr->raft) == raft_get_commit_idx(rr->raft)) {
-        raft_apply_all(rr->raft);
-    }
-
-    /* Unless applied by raft_apply_all() (and freed by it), the request
-     * is pending so we don't free it or unblock the client.
+    /* The request is pending until the entry is synced and applied, so we
+     * don't free it or unblock the client. A single node cluster applies it
+     * at the end of the queue drain, once the log has been synced.
      */
     return;
 
@@ -2085,7 +2962,10 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
             "leader_id:%d\r\n"
             "current_term:%ld\r\n"
             "num_nodes:%d\r\n"
-            "num_voting_nodes:%d\r\n",
+            "num_voting_nodes:%d\r\n"
+            "peer_port:%d\r\n"
+            "peer_clients:%lu\r\n"
+            "peer_messages:%llu\r\n",
             REDISRAFT_VERSION,
             REDISRAFT_GIT_SHA1,
             rr->config->id,
@@ -2095,7 +2975,10 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
             rr->raft ? raft_get_leader_id(rr->raft) : -1,
             rr->raft ? raft_get_current_term(rr->raft) : 0,
             rr->raft ? raft_get_num_nodes(rr->raft) : 0,
-            rr->raft ? raft_get_num_voting_nodes(rr->raft) : 0);
+            rr->raft ? raft_get_num_voting_nodes(rr->raft) : 0,
+            rr->config->peer_port_offset ? rr->config->addr.port + rr->config->peer_port_offset : 0,
+            rr->peer_clients,
+            rr->peer_messages);
 
     int i;
     long long now = RedisModule_Milliseconds();
@@ -2108,12 +2991,18 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
         }
 
         s = catsnprintf(s, &slen,
-                "node%d:id=%d,state=%s,voting=%s,addr=%s,port=%d,last_conn_secs=%lld,conn_errors=%lu,conn_oks=%lu\r\n",
+                "node%d:id=%d,state=%s,voting=%s,addr=%s,port=%d,last_conn_secs=%lld,conn_errors=%lu,conn_oks=%lu,"
+                "cache_hits=%lu,cache_misses=%lu,next_idx=%ld,match_idx=%ld,pending_responses=%ld,ae_window_full=%lu,"
+                "peer_state=%s\r\n",
                 i, node->id, ConnGetStateStr(node->conn),
                 raft_node_is_voting(rnode) ? "yes" : "no",
                 node->addr.host, node->addr.port,
                 node->conn->last_connected_time ? (now - node->conn->last_connected_time)/1000 : -1,
-                node->conn->connect_errors, node->conn->connect_oks);
+                node->conn->connect_errors, node->conn->connect_oks,
+                node->cache_hits, node->cache_misses,
+                raft_node_get_next_idx(rnode), raft_node_get_match_idx(rnode),
+                node->pending_raft_response_num, node->ae_window_full,
+                node->peer_conn ? ConnGetStateStr(node->peer_conn) : "-");
     }
 
     s = catsnprintf(s, &slen,
@@ -2125,7 +3014,22 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
             "file_size:%lu\r\n"
             "cache_memory_size:%lu\r\n"
             "cache_entries:%lu\r\n"
-            "client_attached_entries:%lu\r\n",
+            "client_attached_entries:%lu\r\n"
+            "client_attached_bytes:%lu\r\n"
+            "write_batches:%llu\r\n"
+            "write_batch_commands:%llu\r\n"
+            "apply_lock_count:%llu\r\n"
+            "apply_lock_wait_usec:%llu\r\n"
+            "apply_lock_hold_usec:%llu\r\n"
+            "apply_lock_max_hold_usec:%llu\r\n"
+            "synced_index:%ld\r\n"
+            "fsync_policy:%s\r\n"
+            "preallocate:%s\r\n"
+            "fsync_count:%llu\r\n"
+            "loading_log_open_usec:%llu\r\n"
+            "loading_log_read_usec:%llu\r\n"
+            "loading_log_apply_usec:%llu\r\n"
+            "loading_index_rebuilds:%lu\r\n",
             rr->raft ? raft_get_log_count(rr->raft) : 0,
             rr->raft ? raft_get_current_idx(rr->raft) : 0,
             rr->raft ? raft_get_commit_idx(rr->raft) : 0,
@@ -2133,7 +3037,22 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
             rr->log ? rr->log->file_size : 0,
             rr->logcache ? rr->logcache->entries_memsize : 0,
             rr->logcache ? rr->logcache->len : 0,
-            rr->client_attached_entries);
+            rr->client_attached_entries,
+            rr->client_attached_bytes,
+            rr->write_batches,
+            rr->write_batch_commands,
+            rr->apply_lock_count,
+            rr->apply_lock_wait_usec,
+            rr->apply_lock_hold_usec,
+            rr->apply_lock_max_hold_usec,
+            RaftLogWriterSyncedIdx(rr->log_writer),
+            getFsyncPolicyName(rr->config->raft_log_fsync_policy),
+            rr->config->raft_log_preallocate ? "yes" : "no",
+            (rr->log ? rr->log->fsync_count : 0) + RaftLogWriterFsyncCount(rr->log_writer),
+            rr->log_open_usec,
+            rr->log_load_usec,
+            rr->log_apply_usec,
+            rr->log ? rr->log->index_rebuilds : 0);
 
     s = catsnprintf(s, &slen,
             "\r\n# Snapshot\r\n"
@@ -2145,15 +3064,66 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
     s = catsnprintf(s, &slen,
             "\r\n# Clients\r\n"
             "clients_in_multi_state:%"PRIu64"\r\n"
+            "lease_read_hits:%llu\r\n"
+            "lease_read_misses:%llu\r\n"
+            "local_reads:%llu\r\n"
+            "follower_reads:%llu\r\n"
+            "follower_read_failed:%llu\r\n"
             "proxy_reqs:%llu\r\n"
             "proxy_failed_reqs:%llu\r\n"
             "proxy_failed_responses:%llu\r\n"
-            "proxy_outstanding_reqs:%ld\r\n",
+            "proxy_outstanding_reqs:%ld\r\n"
+            "proxy_batches:%llu\r\n"
+            "proxy_batch_reqs:%llu\r\n"
+            "rejected_proxy_reqs:%llu\r\n"
+            "rejected_pending_writes:%llu\r\n"
+            "shed_writes:%llu\r\n"
+            "commit_latency_p99_usec:%llu\r\n"
+            "commit_latency_shedding:%s\r\n",
             RedisModule_DictSize(multiClientState),
+            rr->lease_read_hits,
+            rr->lease_read_misses,
+            __atomic_load_n(&rr->local_reads, __ATOMIC_RELAXED),
+            rr->follower_reads,
+            rr->follower_read_failed,
             rr->proxy_reqs,
             rr->proxy_failed_reqs,
             rr->proxy_failed_responses,
-            rr->proxy_outstanding_reqs);
+            rr->proxy_outstanding_reqs,
+            rr->proxy_batches,
+            rr->proxy_batch_reqs,
+            rr->rejected_proxy_reqs,
+            rr->rejected_pending_writes,
+            rr->shed_writes,
+            rr->commit_latency.p99_usec,
+            rr->commit_latency.shedding ? "yes" : "no");
+
+    s = catsnprintf(s, &slen,
+            "\r\n# Queue\r\n"
+            "rqueue_len:%lu\r\n"
+            "rqueue_max_len:%lu\r\n"
+            "rqueue_reqs:%llu\r\n"
+            "rqueue_wakeups:%llu\r\n"
+            "rqueue_full:%llu\r\n"
+            "rqueue_wait_usec:%llu\r\n"
+            "rqueue_max_wait_usec:%llu\r\n"
+            "rqueue_budget_exhausted:%llu\r\n",
+            getRaftReqQueueLen(rr),
+            rr->rqueue_max_len,
+            rr->rqueue_reqs,
+            rr->rqueue_wakeups,
+            __atomic_load_n(&rr->rqueue_full, __ATOMIC_RELAXED),
+            rr->rqueue_wait_usec,
+            rr->rqueue_max_wait_usec,
+            rr->rqueue_budget_exhausted);
+
+    for (int lane = 0; lane < RR_LANES; lane++) {
+        s = catsnprintf(s, &slen, "rqueue_%s_len:%lu\r\n",
+                        RaftReqLaneStr[lane], MPSCQueueLen(&rr->rqueue[lane]));
+    }
+
+    s = catsnprintf(s, &slen, "\r\n# Pools\r\n");
+    s = ObjectPoolsInfo(s, &slen);
 
     RedisModule_ReplyWithStringBuffer(req->ctx, s, strlen(s));
     RedisModule_Free(s);
@@ -2512,5 +3482,6 @@ static RaftReqHandler RaftReqHandlers[] = {
     handleNodeShutdown,     /* RR_NODE_SHUTDOWN */
     handleTransferLeader,   /* RR_TRANSFER_LEADER */
     handleTimeoutNow,       /* RR_TIMEOUT_NOW */
+    handleReadIndex,        /* RR_READINDEX */
     NULL
 };
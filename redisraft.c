@@ -182,6 +182,32 @@ static int cmdRaftTimeoutNow(RedisModuleCtx *ctx, RedisModuleString **argv, int
     return REDISMODULE_OK;
 }
 
+/* RAFT.READINDEX
+ *   Request the leader's commit index, once it has confirmed it is still the
+ *   leader. A follower can serve a read locally after applying the index.
+ * Reply:
+ *   -NOCLUSTER ||
+ *   -LOADING ||
+ *   -CLUSTERDOWN ||
+ *   -MOVED <slot> <addr>:<port> ||
+ *   -TIMEOUT ||
+ *   :<index>
+ */
+
+static int cmdRaftReadIndex(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    RedisRaftCtx *rr = &redis_raft;
+    if (argc != 1) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    RaftReq *req = RaftReqInit(ctx, RR_READINDEX);
+    RaftReqSubmit(rr, req);
+
+    return REDISMODULE_OK;
+}
+
 /* RAFT.REQUESTVOTE [target_node_id] [src_node_id] [term]:[candidate_id]:[last_log_idx]:[last_log_term]:[transfer_leader]
  *   Request a node's vote (per Raft paper).
  * Reply:
@@ -235,6 +261,27 @@ error_cleanup:
     return REDISMODULE_OK;
 }
 
+/* Returns a reference to a client argument that remains valid after the
+ * command returns, so it can be handed over to the Raft thread.
+ *
+ * Retaining argv strings used to be unsafe (see redis/redis#5834): Redis may
+ * trim an argument's allocation once the command returns, racing with the
+ * Raft thread that serializes it. Trimming it here first makes this a no-op
+ * and the string is shared rather than copied. As its reference count is
+ * not atomic, the Raft thread only releases it holding the Redis lock, see
+ * releaseClientCommands(). On servers without
+ * RedisModule_TrimStringAllocation() we fall back to copying it.
+ */
+static RedisModuleString *holdClientString(RedisModuleString *str)
+{
+    if (!RedisModule_TrimStringAllocation) {
+        return RedisModule_CreateStringFromString(NULL, str);
+    }
+
+    RedisModule_TrimStringAllocation(str);
+    return RedisModule_HoldString(NULL, str);
+}
+
 /* RAFT [Redis command to execute]
  *   Submit a Redis command to be appended to the Raft log and applied.
  *   The command blocks until it has been committed to the log by the majority
@@ -262,15 +309,7 @@ static int cmdRaft(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 
     int i;
     for (i = 0; i < argc - 1; i++) {
-        /* TODO: We currently duplicate the string instead of using RetainString
-         * due to a problem introduced by https://github.com/redis/redis/pull/5834
-         * where a retained string may still be mutated upon returning to Redis,
-         * so we end up with a race that can result with corruption before we
-         * serialize the request into a log entry entry.
-         *
-         * Revisit this if/when the Module API addresses this issue in a better way.
-         */
-        cmd->argv[i] = RedisModule_CreateStringFromString(NULL, argv[i + 1]);
+        cmd->argv[i] = holdClientString(argv[i + 1]);
     }
     RaftReqSubmit(&redis_raft, req);
 
@@ -307,6 +346,38 @@ static int cmdRaftEntry(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
     return REDISMODULE_OK;
 }
 
+/* RAFT.ENTRY.BATCH [Serialized Entry]
+ *   Receive a serialized batch of single Redis commands proxied by a follower
+ *   and append them to the log together, replying to each of them.
+ * Reply:
+ *   -MOVED <addr> ||
+ *   -BUSY ... ||
+ *   *<n>
+ *   <reply to each command>
+ */
+static int cmdRaftEntryBatch(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc != 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    size_t data_len;
+    const char *data = RedisModule_StringPtrLen(argv[1], &data_len);
+
+    RaftReq *req = RaftReqInit(ctx, RR_REDISCOMMAND);
+    if (RaftRedisCommandArrayDeserialize(&req->r.redis.cmds, data, data_len) != RR_OK ||
+        !req->r.redis.cmds.len) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid argument");
+        RaftReqFree(req);
+    } else {
+        req->r.redis.proxy_batch = true;
+        RaftReqSubmit(&redis_raft, req);
+    }
+
+    return REDISMODULE_OK;
+}
+
 /* RAFT.INFO
  *   Display Raft module specific info.
  * Reply:
@@ -321,9 +392,13 @@ static int cmdRaftInfo(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 }
 
 
-/* RAFT.AE [target_node_id] [src_node_id] [term]:[prev_log_idx]:[prev_log_term]:[leader_commit]
+/* RAFT.AE [target_node_id] [src_node_id] [header] [entries]
+ *   A leader request to append entries to the Raft log (per Raft paper), in
+ *   the binary encoding described in serialization.c.
+ *
+ * RAFT.AE [target_node_id] [src_node_id] [term]:[prev_log_idx]:[prev_log_term]:[leader_commit]
  *      [n_entries] [<term>:<id>:<type> <entry>]...
- *   A leader request to append entries to the Raft log (per Raft paper).
+ *   The same, in the text encoding used by earlier versions.
  * Reply:
  *   -NOCLUSTER ||
  *   -LOADING ||
@@ -334,6 +409,20 @@ static int cmdRaftInfo(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
  *   :<first_idx>
  */
 
+static bool isBinaryAppendEntries(RedisModuleString **argv, int argc)
+{
+    size_t len;
+    const char *hdr = RedisModule_StringPtrLen(argv[3], &len);
+    uint32_t magic;
+
+    if (argc != 5 || len != sizeof(RaftAEHeader)) {
+        return false;
+    }
+
+    memcpy(&magic, hdr, sizeof(magic));
+    return magic == RAFT_AE_MAGIC;
+}
+
 static int cmdRaftAppendEntries(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
     RedisRaftCtx *rr = &redis_raft;
@@ -350,6 +439,30 @@ static int cmdRaftAppendEntries(RedisModuleCtx *ctx, RedisModuleString **argv, i
             return REDISMODULE_OK;
     }
 
+    size_t tmplen;
+    const char *tmpstr;
+
+    if (isBinaryAppendEntries(argv, argc)) {
+        RaftReq *req = RaftReqInit(ctx, RR_APPENDENTRIES);
+        if (RedisModuleStringToInt(argv[2], &req->r.appendentries.src_node_id) == REDISMODULE_ERR) {
+            RedisModule_ReplyWithError(ctx, "invalid source node id");
+            RaftReqFree(req);
+            return REDISMODULE_OK;
+        }
+
+        size_t hdr_len;
+        const char *hdr = RedisModule_StringPtrLen(argv[3], &hdr_len);
+        tmpstr = RedisModule_StringPtrLen(argv[4], &tmplen);
+        if (RaftAEDecode(&req->r.appendentries.msg, hdr, hdr_len, tmpstr, tmplen) != RR_OK) {
+            RedisModule_ReplyWithError(ctx, "invalid message");
+            RaftReqFree(req);
+            return REDISMODULE_OK;
+        }
+
+        RaftReqSubmit(rr, req);
+        return REDISMODULE_OK;
+    }
+
     long long n_entries;
     if (RedisModule_StringToLongLong(argv[4], &n_entries) != REDIS_OK) {
         RedisModule_ReplyWithError(ctx, "invalid n_entries value");
@@ -366,8 +479,7 @@ static int cmdRaftAppendEntries(RedisModuleCtx *ctx, RedisModuleString **argv, i
         goto error_cleanup;
     }
 
-    size_t tmplen;
-    const char *tmpstr = RedisModule_StringPtrLen(argv[3], &tmplen);
+    tmpstr = RedisModule_StringPtrLen(argv[3], &tmplen);
     if (sscanf(tmpstr, "%d:%ld:%ld:%ld:%ld:%lu",
                 &req->r.appendentries.msg.leader_id,
                 &req->r.appendentries.msg.term,
@@ -499,15 +611,7 @@ static int cmdRaftSnapshot(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         goto error;
     }
 
-    /* TODO: We currently duplicate the string instead of using RetainString
-     * due to a problem introduced by https://github.com/redis/redis/pull/5834
-     * where a retained string may still be mutated upon returning to Redis,
-     * so we end up with a race that can result with corruption before we
-     * serialize the request into a log entry entry.
-     *
-     * Revisit this if/when the Module API addresses this issue in a better way.
-     */
-    req->r.snapshot.data = RedisModule_CreateStringFromString(NULL, argv[4]);
+    req->r.snapshot.data = holdClientString(argv[4]);
 
     size_t len;
     void *data = (void*) RedisModule_StringPtrLen(req->r.snapshot.data, &len);
@@ -808,6 +912,17 @@ static void handleClientDisconnect(RedisModuleCtx *ctx,
     }
 }
 
+/* Stops the log writer when Redis shuts down, so the process does not exit
+ * while it is in the middle of a sync.
+ */
+static void handleServerShutdown(RedisModuleCtx *ctx,
+        RedisModuleEvent eid, uint64_t subevent, void *data)
+{
+    if (eid.id == REDISMODULE_EVENT_SHUTDOWN && redis_raft.log_writer) {
+        RaftLogWriterStop(redis_raft.log_writer);
+    }
+}
+
 /* Command filter callback that intercepts normal Redis commands and prefixes them
  * with a RAFT command prefix in order to divert them to execute inside RedisRaft.
  */
@@ -824,6 +939,16 @@ static void interceptRedisCommands(RedisModuleCommandFilterCtx *filter)
     if (cs && (cs->flags & CMD_SPEC_DONT_INTERCEPT))
         return;
 
+    /* Leave read-only commands to Redis when the Raft thread would execute
+     * them right away anyway.
+     */
+    if (cs && (cs->flags & CMD_SPEC_READONLY) &&
+        !(cs->flags & (CMD_SPEC_WRITE | CMD_SPEC_UNSUPPORTED)) &&
+        RaftCanReadLocally(&redis_raft)) {
+        __atomic_add_fetch(&redis_raft.local_reads, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
     /* Prepend RAFT to the original command */
     RedisModuleString *raft_str = RedisModule_CreateString(NULL, "RAFT", 4);
     RedisModule_CommandFilterArgInsert(filter, 0, raft_str);
@@ -848,6 +973,11 @@ static int registerRaftCommands(RedisModuleCtx *ctx)
         return REDISMODULE_ERR;
     }
 
+    if (RedisModule_CreateCommand(ctx, "raft.entry.batch",
+                cmdRaftEntryBatch, "write", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     if (RedisModule_CreateCommand(ctx, "raft.info",
                 cmdRaftInfo, "admin", 0, 0, 0) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
@@ -888,6 +1018,11 @@ static int registerRaftCommands(RedisModuleCtx *ctx)
         return REDISMODULE_ERR;
     }
 
+    if (RedisModule_CreateCommand(ctx, "raft.readindex",
+                                  cmdRaftReadIndex, "admin", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     if (RedisModule_CreateCommand(ctx, "raft.requestvote",
                 cmdRaftRequestVote, "admin", 0, 0, 0) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
@@ -982,10 +1117,11 @@ __attribute__((__unused__)) int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisMod
         return REDISMODULE_ERR;
     }
 
-    raft_set_heap_functions(RedisModule_Alloc,
-                            RedisModule_Calloc,
-                            RedisModule_Realloc,
-                            RedisModule_Free);
+    ObjectPoolsInit();
+    raft_set_heap_functions(PoolHeapAlloc,
+                            PoolHeapCalloc,
+                            PoolHeapRealloc,
+                            PoolHeapFree);
     uv_replace_allocator(RedisModule_Alloc,
                          RedisModule_Realloc,
                          RedisModule_Calloc,
@@ -999,7 +1135,9 @@ __attribute__((__unused__)) int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisMod
         interceptRedisCommands, REDISMODULE_CMDFILTER_NOSELF);
 
     if (RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_ClientChange,
-                handleClientDisconnect) != REDISMODULE_OK) {
+                handleClientDisconnect) != REDISMODULE_OK ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_Shutdown,
+                handleServerShutdown) != REDISMODULE_OK) {
         RedisModule_Log(ctx, REDIS_WARNING, "Failed to subscribe to server events.");
         return REDISMODULE_ERR;
     }
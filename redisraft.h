@@ -38,6 +38,7 @@ struct EntryCache;
 struct RedisRaftConfig;
 struct Node;
 struct Connection;
+struct PeerReply;
 struct ShardingInfo;
 struct ShardGroup;
 
@@ -239,6 +240,56 @@ typedef struct SnapshotFile {
     size_t len;
 } SnapshotFile;
 
+/* Requests are queued to the Raft thread in separate lanes, handled in order
+ * of priority; see RaftReqHandleQueue().
+ */
+enum RaftReqLane {
+    RR_LANE_CONSENSUS = 0,          /* Messages from other nodes */
+    RR_LANE_READ,                   /* Read-only client commands */
+    RR_LANE_WRITE,                  /* Everything else */
+    RR_LANES
+};
+
+typedef struct MPSCQueueSlot {
+    unsigned long       seq;                    /* Position the slot is ready for, see queue.c */
+    void                *item;
+} MPSCQueueSlot;
+
+typedef struct MPSCQueue {
+    MPSCQueueSlot       *slots;
+    unsigned long       mask;                   /* Number of slots minus one */
+    unsigned long       head;                   /* Next position to dequeue, owned by the consumer */
+    char                pad[64];                /* Keep producers off the consumer's cache line */
+    unsigned long       tail;                   /* Next position to enqueue */
+    uv_mutex_t          overflow_lock;
+    void                **overflow;             /* Items pushed while the ring was full */
+    unsigned long       overflow_start;         /* Next overflow item to dequeue */
+    unsigned long       overflow_end;
+    unsigned long       overflow_size;
+    unsigned long       overflow_len;           /* Items on overflow, read without the lock */
+} MPSCQueue;
+
+/* Latency histogram with four buckets per power of two, so a percentile read
+ * back from it is within 25% of the actual value.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS   256
+
+typedef struct LatencyHistogram {
+    unsigned long long buckets[LATENCY_HISTOGRAM_BUCKETS];
+    unsigned long long count;
+} LatencyHistogram;
+
+typedef struct {
+    int argc;
+    RedisModuleString **argv;
+} RaftRedisCommand;
+
+typedef struct {
+    int size;           /* Size of allocated array */
+    int len;            /* Number of elements in array */
+    RaftRedisCommand **commands;
+} RaftRedisCommandArray;
+
 /* Global Raft context */
 typedef struct RedisRaftCtx {
     void *raft;                                  /* Raft library context */
@@ -250,10 +301,48 @@ typedef struct RedisRaftCtx {
     uv_async_t rqueue_sig;                       /* A signal we have something on rqueue */
     uv_timer_t raft_periodic_timer;              /* Invoke Raft periodic func */
     uv_timer_t node_reconnect_timer;             /* Handle connection issues */
-    uv_mutex_t rqueue_mutex;                     /* Mutex protecting rqueue access */
-    STAILQ_HEAD(rqueue, RaftReq) rqueue;         /* Requests queue (Redis thread -> Raft thread) */
+    uv_tcp_t peer_listener;                      /* Accepts Raft messages on the peer port, if enabled */
+    MPSCQueue rqueue[RR_LANES];                  /* Requests queue (Redis thread -> Raft thread), per lane */
+    bool rqueue_awake;                           /* Raft thread is signaled or draining rqueue */
+    STAILQ_HEAD(sync_waiters, RaftReq) sync_waiters; /* Requests to reply to once the log is synced */
+    STAILQ_HEAD(read_index_waiters, RaftReq) read_index_waiters; /* Follower reads waiting for their read index to be applied */
+    uint64_t local_reads_deadline;               /* uv_hrtime() until which reads may run natively on the main thread */
     struct RaftLog *log;                         /* Raft persistent log; May be NULL if not used */
+    struct RaftLogWriter *log_writer;            /* Syncs the log in the background */
+    uv_async_t log_sync_sig;                     /* A signal the log writer completed a sync */
+    uv_timer_t log_flush_timer;                  /* Sync the log once a second, if fsync policy is 'everysec' */
     struct EntryCache *logcache;                 /* Log entry cache to keep entries in memory for faster access */
+    struct {
+        raft_index_t first_idx;
+        int n_entries;
+        raft_term_t last_term;
+        char *buf;
+        size_t len;
+    } ae_entries;                                /* Last encoded RAFT.AE entries, sent to all followers needing them */
+    struct {
+        struct RaftReq *head;
+        struct RaftReq *tail;
+        int len;
+        size_t size;
+    } write_batch;                               /* Client commands to append to the log as a single entry */
+    struct {
+        struct RaftReq *head;
+        struct RaftReq *tail;
+        struct Node *leader;
+        int len;
+        size_t size;
+    } proxy_batch;                               /* Client commands to proxy to the leader in a single RAFT.ENTRY.BATCH */
+    struct {
+        bool held;
+        uint64_t acquired;
+    } apply_lock;                                /* Redis lock held while applying entries, see applyLockAcquire() */
+    RaftRedisCommandArray released_cmds;         /* Client commands to free once the Redis lock is held, see releaseClientCommands() */
+    struct {
+        LatencyHistogram hist;                   /* Commit latency of writes in the current window */
+        uint64_t window_start;
+        unsigned long long p99_usec;             /* p99 of the last complete window */
+        bool shedding;                           /* p99 is over commit-latency-target */
+    } commit_latency;                            /* Commit latency tracking, see updateCommitLatency() */
     struct RedisRaftConfig *config;              /* User provided configuration */
     bool snapshot_in_progress;                   /* Indicates we're creating a snapshot in the background */
     raft_index_t incoming_snapshot_idx;          /* Incoming snapshot's last included idx to verify chunks
@@ -272,11 +361,40 @@ typedef struct RedisRaftCtx {
 
     /* General stats */
     unsigned long client_attached_entries;       /* Number of log entries attached to user connections */
+    unsigned long client_attached_bytes;         /* Size of log entries attached to user connections */
+    unsigned long long write_batches;            /* Number of entries appended from a write batch */
+    unsigned long long write_batch_commands;     /* Number of commands appended in write batches */
+    unsigned long long apply_lock_count;         /* Number of times the Redis lock was acquired to apply entries */
+    unsigned long long apply_lock_wait_usec;     /* Time spent waiting for the Redis lock to apply entries */
+    unsigned long long apply_lock_hold_usec;     /* Time the Redis lock was held to apply entries */
+    unsigned long long apply_lock_max_hold_usec; /* Longest time the Redis lock was held to apply entries */
+    unsigned long long lease_read_hits;          /* Number of reads served under the leader's lease */
+    unsigned long long lease_read_misses;        /* Number of reads that had to confirm leadership instead */
+    unsigned long long local_reads;              /* Number of reads executed natively by the main thread */
+    unsigned long long follower_reads;           /* Number of reads served by a follower using the leader's read index */
+    unsigned long long follower_read_failed;     /* Number of follower reads that failed to get a read index */
     unsigned long long proxy_reqs;               /* Number of proxied requests */
     unsigned long long proxy_failed_reqs;        /* Number of failed proxy requests, i.e. did not send */
     unsigned long long proxy_failed_responses;   /* Number of failed proxy responses, i.e. did not complete */
     unsigned long proxy_outstanding_reqs;        /* Number of proxied requests pending */
+    unsigned long long proxy_batches;            /* Number of RAFT.ENTRY.BATCH messages sent to the leader */
+    unsigned long long proxy_batch_reqs;         /* Number of requests proxied in RAFT.ENTRY.BATCH messages */
+    unsigned long long rejected_pending_writes;  /* Number of writes rejected by max-pending-entries/size */
+    unsigned long long rejected_proxy_reqs;      /* Number of requests rejected by max-proxy-outstanding */
+    unsigned long long shed_writes;              /* Number of writes rejected by commit-latency-target */
+    unsigned long long rqueue_reqs;              /* Number of requests taken off rqueue */
+    unsigned long long rqueue_wakeups;           /* Number of times the Raft thread woke up to drain rqueue */
+    unsigned long long rqueue_full;              /* Number of requests put on rqueue's overflow list */
+    unsigned long long rqueue_wait_usec;         /* Time requests spent on rqueue */
+    unsigned long long rqueue_max_wait_usec;     /* Longest time a request spent on rqueue */
+    unsigned long rqueue_max_len;                /* Largest number of requests found on rqueue */
+    unsigned long long rqueue_budget_exhausted;  /* Number of times draining rqueue yielded to timers and I/O */
     unsigned long snapshots_loaded;              /* Number of snapshots loaded */
+    unsigned long peer_clients;                  /* Number of connections on the peer port */
+    unsigned long long peer_messages;            /* Number of Raft messages received on the peer port */
+    unsigned long long log_open_usec;            /* Time spent opening the Raft log on startup */
+    unsigned long long log_load_usec;            /* Time spent reading the Raft log on startup */
+    unsigned long long log_apply_usec;           /* Time spent applying the loaded Raft log on startup */
     char *resp_call_fmt;                         /* Format string to use in RedisModule_Call(), Redis version-specific */
 } RedisRaftCtx;
 
@@ -294,7 +412,17 @@ extern raft_log_impl_t RaftLogImpl;
 #define REDIS_RAFT_DEFAULT_PROXY_RESPONSE_TIMEOUT   10000
 #define REDIS_RAFT_DEFAULT_RAFT_RESPONSE_TIMEOUT    1000
 #define REDIS_RAFT_DEFAULT_LOG_MAX_CACHE_SIZE       8*1000*1000
+#define REDIS_RAFT_DEFAULT_LOG_CACHE_TAIL_SIZE      1*1000*1000
 #define REDIS_RAFT_DEFAULT_LOG_MAX_FILE_SIZE        64*1000*1000
+#define REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE         8*1000*1000
+#define REDIS_RAFT_DEFAULT_AE_MAX_ENTRIES           10000
+#define REDIS_RAFT_DEFAULT_AE_MAX_SIZE              1*1000*1000
+#define REDIS_RAFT_DEFAULT_AE_MAX_INFLIGHT          8
+#define REDIS_RAFT_DEFAULT_WRITE_BATCH_SIZE         64*1000
+#define REDIS_RAFT_DEFAULT_APPLY_LOCK_BUDGET        1000 /* usec */
+#define REDIS_RAFT_DEFAULT_LEASE_MAX_DRIFT          100 /* msec */
+#define REDIS_RAFT_RQUEUE_SIZE                      16384
+#define REDIS_RAFT_RQUEUE_BATCH_SIZE                64
 
 #define REDIS_RAFT_HASH_SLOTS                       16384
 #define REDIS_RAFT_HASH_MIN_SLOT                    0
@@ -312,6 +440,13 @@ static inline bool HashSlotRangeValid(int start_slot, int end_slot)
             start_slot <= end_slot);
 }
 
+/* Raft log fsync policies */
+typedef enum RaftLogFsyncPolicy {
+    RAFT_LOG_FSYNC_ALWAYS = 0,      /* Sync entries before acknowledging them */
+    RAFT_LOG_FSYNC_EVERYSEC,        /* Sync entries once a second */
+    RAFT_LOG_FSYNC_NEVER            /* Leave syncing entries to the OS */
+} RaftLogFsyncPolicy;
+
 typedef struct RedisRaftConfig {
     raft_node_id_t id;          /* Local node Id */
     NodeAddr addr;              /* Address of local node, if specified */
@@ -319,6 +454,9 @@ typedef struct RedisRaftConfig {
     char *raft_log_filename;    /* Raft log file name, derived from dbfilename */
     bool follower_proxy;        /* Do follower nodes proxy requests to leader? */
     bool quorum_reads;          /* Reads have to go through quorum */
+    bool follower_reads;        /* Do follower nodes serve reads once they've applied the leader's read index? */
+    bool lease_reads;           /* Leader serves quorum reads locally while it holds a lease */
+    int lease_max_drift;        /* Milliseconds of clock drift between nodes the lease accounts for */
     /* Tuning */
     int raft_interval;
     int request_timeout;
@@ -328,10 +466,25 @@ typedef struct RedisRaftConfig {
     int reconnect_interval;
     int proxy_response_timeout;
     int raft_response_timeout;
+    /* Replication */
+    int raft_ae_max_entries;            /* Entries per RAFT.AE message */
+    unsigned long raft_ae_max_size;     /* Entries data size per RAFT.AE message */
+    int raft_ae_max_inflight;           /* RAFT.AE messages awaiting a response, per node */
+    int peer_port_offset;               /* Peer port is addr's port plus this, 0 to disable */
+    unsigned long raft_write_batch_size;    /* Client commands appended as a single entry, 0 to disable */
+    unsigned long raft_apply_lock_budget;   /* Microseconds to hold the Redis lock for while applying entries */
+    /* Admission control, 0 to disable */
+    unsigned long max_pending_entries;      /* Log entries pending commit on behalf of clients */
+    unsigned long max_pending_size;         /* Size of log entries pending commit on behalf of clients */
+    unsigned long max_proxy_outstanding;    /* Commands proxied to the leader, awaiting a reply */
+    unsigned long commit_latency_target;    /* Milliseconds of p99 commit latency above which writes are shed */
     /* Cache and file compaction */
     unsigned long raft_log_max_cache_size;
+    unsigned long raft_log_cache_tail_size;
     unsigned long raft_log_max_file_size;
-    bool raft_log_fsync;
+    unsigned long raft_log_segment_size;
+    RaftLogFsyncPolicy raft_log_fsync_policy;
+    bool raft_log_preallocate;
     /* Cluster mode */
     bool sharding;                      /* Are we running in a sharding configuration? */
     char *slot_config;                  /* Defining multiple slot ranges (# or #:#) that are delimited by ',' */
@@ -351,10 +504,16 @@ typedef struct Node {
     raft_node_id_t id;              /* Raft unique node ID */
     RedisRaftCtx *rr;               /* RedisRaftCtx handle */
     Connection *conn;               /* Connection to node */
+    Connection *peer_conn;          /* Connection to node's peer port, if enabled */
     NodeAddr addr;                  /* Node's address */
+    NodeAddr peer_addr;             /* Node's peer port address, if enabled */
     long pending_raft_response_num;     /* Number of pending Raft responses */
     long pending_proxy_response_num;    /* Number of pending proxy responses */
+    unsigned long cache_hits;           /* Entries sent to node from the log cache */
+    unsigned long cache_misses;         /* Entries sent to node that were read from the log */
+    unsigned long ae_window_full;       /* RAFT.AE messages held back by raft-ae-max-inflight */
     STAILQ_HEAD(pending_responses, PendingResponse) pending_responses;
+    struct pending_responses peer_pending_responses;
     LIST_ENTRY(Node) entries;
 } Node;
 
@@ -389,6 +548,7 @@ enum RaftReqType {
     RR_NODE_SHUTDOWN,
     RR_TRANSFER_LEADER,
     RR_TIMEOUT_NOW,
+    RR_READINDEX,
 };
 
 extern const char *RaftReqTypeStr[];
@@ -398,17 +558,6 @@ typedef struct {
     NodeAddr addr;
 } RaftCfgChange;
 
-typedef struct {
-    int argc;
-    RedisModuleString **argv;
-} RaftRedisCommand;
-
-typedef struct {
-    int size;           /* Size of allocated array */
-    int len;            /* Number of elements in array */
-    RaftRedisCommand **commands;
-} RaftRedisCommandArray;
-
 /* Max length of a ShardGroupNode string, including newline and null terminator */
 #define SHARDGROUPNODE_MAXLEN   (RAFT_SHARDGROUP_NODEID_LEN+1 + NODEADDR_MAXLEN + 2)
 
@@ -512,6 +661,7 @@ typedef struct RaftDebugReq {
 typedef struct RaftReq {
     int type;
     STAILQ_ENTRY(RaftReq) entries;
+    uint64_t submit_time;               /* uv_hrtime() when put on rqueue */
     RedisModuleBlockedClient *client;
     RedisModuleCtx *ctx;
     union {
@@ -522,6 +672,8 @@ typedef struct RaftReq {
         struct {
             raft_node_id_t src_node_id;
             msg_appendentries_t msg;
+            msg_appendentries_response_t response;
+            struct PeerReply *peer_reply;       /* Reply slot, if received on the peer port */
         } appendentries;
         struct {
             raft_node_id_t src_node_id;
@@ -532,6 +684,9 @@ typedef struct RaftReq {
             int hash_slot;
             RaftRedisCommandArray cmds;
             msg_entry_response_t response;
+            struct RaftReq *batch_next;     /* Next request appended in the same entry, or proxied in the same batch */
+            bool proxy_batch;               /* Received in RAFT.ENTRY.BATCH, replies to all commands in an array */
+            raft_index_t read_idx;          /* Index to apply before serving a follower read */
         } redis;
         struct {
             void *data;
@@ -555,28 +710,93 @@ typedef struct RaftReq {
     } r;
 } RaftReq;
 
-#define RAFTLOG_VERSION     1
+#define RAFTLOG_VERSION     3
 
 /* Flags for RaftLogOpen */
-#define RAFTLOG_KEEP_INDEX  1                   /* Index was written by this process, safe to use. */
+#define RAFTLOG_KEEP_INDEX  1                   /* Keep existing index files, used on load if they match the log. */
+
+typedef struct RaftLogSegment {
+    raft_index_t        first_idx;              /* Index of first entry in segment */
+    unsigned long int   num_entries;            /* Entries in segment */
+    size_t              size;                   /* Segment file size */
+    char                *filename;
+    FILE                *file;
+    int                 idxfd;                  /* Index file, mapped to index */
+    off_t               *index;                 /* Entry offsets, by index relative to first_idx */
+    size_t              index_size;             /* Number of offsets the mapped index can hold */
+    bool                index_kept;             /* Index was kept on open, to be validated on load */
+} RaftLogSegment;
 
 typedef struct RaftLog {
     uint32_t            version;                /* Log file format version */
     char                dbid[RAFT_DBID_LEN+1];  /* DB unique ID */
     raft_node_id_t      node_id;                /* Node ID */
-    bool                fsync;                  /* Should fsync every append? */
+    RaftLogFsyncPolicy  fsync_policy;           /* When to sync appended entries */
+    bool                preallocate;            /* Preallocate segment files? */
     unsigned long int   num_entries;            /* Entries in log */
+    unsigned long int   unsynced_entries;       /* Entries written since last sync */
+    unsigned long long  fsync_count;            /* Number of fsync() calls made for entries */
+    unsigned long       index_rebuilds;         /* Number of segment indexes rebuilt on load */
     raft_term_t         snapshot_last_term;     /* Last term included in snapshot */
     raft_index_t        snapshot_last_idx;      /* Last index included in snapshot */
     raft_index_t        index;                  /* Index of last entry */
     raft_term_t         term;                   /* Last term we're aware of */
     raft_node_id_t      vote;                   /* Our vote in the last term, or -1 */
-    size_t              file_size;              /* File size at the time of last write */
-    const char          *filename;
-    FILE                *file;
-    FILE                *idxfile;
+    size_t              file_size;              /* Size of log data, excluding compacted entries */
+    size_t              segment_size;           /* Start a new segment beyond this size, or 0 */
+    const char          *filename;              /* Log metadata file */
+    RaftLogSegment      **segments;             /* Log segments, the last one is active */
+    int                 num_segments;           /* Number of segments */
+    int                 sealed_fd;              /* Duplicate fd of a previous segment to sync, or -1 */
 } RaftLog;
 
+typedef struct RaftLogWriter {
+    uv_thread_t         thread;
+    uv_mutex_t          mutex;                  /* Protects all fields below */
+    uv_cond_t           cond;                   /* Signals a pending sync or exit */
+    bool                exit;                   /* Writer thread should exit */
+    int                 pending_fd;             /* Duplicate fd to sync next, or -1 */
+    int                 pending_sealed_fd;      /* Previous segment to sync before it, or -1 */
+    raft_index_t        pending_idx;            /* Last index covered by the pending sync */
+    raft_index_t        inflight_idx;           /* Last index covered by the sync in progress */
+    raft_index_t        synced_idx;             /* Last index known to be durable */
+    unsigned long long  fsync_count;            /* Number of fsync() calls made by the writer */
+    void                (*notify)(void *arg);   /* Called by the writer thread after a sync */
+    void                *notify_arg;
+} RaftLogWriter;
+
+/* RAFT.AE messages are sent as a binary header and an entries buffer, see
+ * serialization.c.
+ */
+#define RAFT_AE_MAGIC       0x31454152  /* "RAE1" */
+#define RAFT_AE_VERSION     1
+
+typedef struct RaftAEHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    int32_t leader_id;
+    int32_t n_entries;
+    int64_t term;
+    int64_t prev_log_idx;
+    int64_t prev_log_term;
+    int64_t leader_commit;
+    uint64_t msg_id;
+} RaftAEHeader;
+
+typedef struct ObjectPool {
+    const char          *name;
+    int                 id;                     /* Slot of the pool in per-thread caches */
+    size_t              size;                   /* Object size */
+    uv_mutex_t          mutex;                  /* Protects the shared free list */
+    void                *free_list;             /* Shared list of free objects */
+    unsigned long       free_count;             /* Number of objects on the shared list */
+    unsigned long       allocated;              /* Number of objects allocated from the system */
+    unsigned long       in_use;                 /* Number of objects currently in use */
+} ObjectPool;
+
+extern ObjectPool RaftReqPool;
+extern ObjectPool PendingResponsePool;
 
 #define SNAPSHOT_RESULT_MAGIC    0x70616e73  /* "snap" */
 typedef struct SnapshotResult {
@@ -663,9 +883,17 @@ void NodeAddrListFree(NodeAddrListElement *head);
 Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr);
 void HandleNodeStates(RedisRaftCtx *rr);
 void NodeAddPendingResponse(Node *node, bool proxy);
-void NodeDismissPendingResponse(Node *node);
+void NodeDismissPendingResponse(Node *node, bool proxy);
+Connection *NodeGetRaftConn(Node *node);
+void NodeTerminate(Node *node);
+
+/* peer.c */
+RRStatus PeerListenerStart(RedisRaftCtx *rr);
+void PeerReplyError(struct PeerReply *reply, const char *err);
+void PeerReplyAppendEntries(struct PeerReply *reply, msg_appendentries_response_t *response);
 
 /* serialization.c */
+size_t RaftRedisCommandArraySerializedSize(const RaftRedisCommandArray *source);
 raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source);
 size_t RaftRedisCommandDeserialize(RaftRedisCommand *target, const void *buf, size_t buf_size);
 RRStatus RaftRedisCommandArrayDeserialize(RaftRedisCommandArray *target, const void *buf, size_t buf_size);
@@ -673,6 +901,10 @@ void RaftRedisCommandArrayFree(RaftRedisCommandArray *array);
 void RaftRedisCommandFree(RaftRedisCommand *r);
 RaftRedisCommand *RaftRedisCommandArrayExtend(RaftRedisCommandArray *target);
 void RaftRedisCommandArrayMove(RaftRedisCommandArray *target, RaftRedisCommandArray *source);
+void RaftAEEncodeHeader(RaftAEHeader *hdr, const msg_appendentries_t *msg);
+char *RaftAEEncodeEntries(raft_entry_t **entries, int n_entries, size_t *len);
+RRStatus RaftAEDecode(msg_appendentries_t *msg, const void *hdr_buf, size_t hdr_len,
+                      const void *entries_buf, size_t entries_len);
 
 /* raft.c */
 RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *config);
@@ -682,6 +914,13 @@ RaftReq *RaftReqInit(RedisModuleCtx *ctx, enum RaftReqType type);
 RaftReq *RaftDebugReqInit(RedisModuleCtx *ctx, enum RaftDebugReqType type);
 void RaftReqSubmit(RedisRaftCtx *rr, RaftReq *req);
 void RaftReqHandleQueue(uv_async_t *handle);
+int RaftReqPopBatch(RedisRaftCtx *rr, RaftReq **batch, int *turn);
+void RaftReqHandle(RedisRaftCtx *rr, RaftReq *req);
+void RaftReqHandleDone(RedisRaftCtx *rr);
+bool RaftCanReadLocally(RedisRaftCtx *rr);
+void syncRaftLog(RedisRaftCtx *rr);
+void resetRaftLogSync(RedisRaftCtx *rr);
+void truncateSyncWaiters(RedisRaftCtx *rr, raft_index_t idx);
 void addUsedNodeId(RedisRaftCtx *rr, raft_node_id_t node_id);
 bool hasNodeIdBeenUsed(RedisRaftCtx *rr, raft_node_id_t node_id);
 
@@ -694,6 +933,28 @@ int RedisInfoIterate(const char **info_ptr, size_t *info_len, const char **key,
 char *RedisInfoGetParam(RedisRaftCtx *rr, const char *section, const char *param);
 RRStatus parseMemorySize(const char *value, unsigned long *result);
 RRStatus formatExactMemorySize(unsigned long value, char *buf, size_t buf_size);
+void LatencyHistogramAdd(LatencyHistogram *h, uint64_t value);
+uint64_t LatencyHistogramPercentile(LatencyHistogram *h, double percentile);
+void LatencyHistogramReset(LatencyHistogram *h);
+
+/* pool.c */
+void ObjectPoolsInit(void);
+void *ObjectPoolAlloc(ObjectPool *pool);
+void ObjectPoolFree(ObjectPool *pool, void *obj);
+void ObjectPoolRelease(ObjectPool *pool);
+void ObjectPoolsRelease(void);
+void *PoolHeapAlloc(size_t size);
+void *PoolHeapCalloc(size_t nmemb, size_t size);
+void *PoolHeapRealloc(void *ptr, size_t size);
+void PoolHeapFree(void *ptr);
+char *ObjectPoolsInfo(char *s, size_t *slen);
+
+/* queue.c */
+void MPSCQueueInit(MPSCQueue *q, unsigned long size);
+void MPSCQueueFree(MPSCQueue *q);
+bool MPSCQueuePush(MPSCQueue *q, void *item);
+int MPSCQueuePopBatch(MPSCQueue *q, void **items, int max);
+unsigned long MPSCQueueLen(MPSCQueue *q);
 
 /* log.c */
 RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term, raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config);
@@ -703,18 +964,26 @@ RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry);
 RRStatus RaftLogSetVote(RaftLog *log, raft_node_id_t vote);
 RRStatus RaftLogSetTerm(RaftLog *log, raft_term_t term, raft_node_id_t vote);
 int RaftLogLoadEntries(RaftLog *log, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg);
-RRStatus RaftLogWriteEntry(RaftLog *log, raft_entry_t *entry);
 RRStatus RaftLogSync(RaftLog *log);
+RaftLogWriter *RaftLogWriterNew(void (*notify)(void *arg), void *notify_arg);
+void RaftLogWriterStop(RaftLogWriter *w);
+void RaftLogWriterFree(RaftLogWriter *w);
+RRStatus RaftLogWriterSync(RaftLogWriter *w, RaftLog *log);
+RRStatus RaftLogWriterFlush(RaftLogWriter *w, RaftLog *log);
+raft_index_t RaftLogWriterSyncedIdx(RaftLogWriter *w);
+unsigned long long RaftLogWriterFsyncCount(RaftLogWriter *w);
+void RaftLogWriterTruncate(RaftLogWriter *w, raft_index_t idx);
+void RaftLogWriterReset(RaftLogWriter *w, raft_index_t idx);
 raft_entry_t *RaftLogGet(RaftLog *log, raft_index_t idx);
+int RaftLogGetBatch(RaftLog *log, raft_index_t idx, int entries_n, raft_entry_t **entries);
 RRStatus RaftLogDelete(RaftLog *log, raft_index_t from_idx, func_entry_notify_f cb, void *cb_arg);
 RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term);
 raft_index_t RaftLogCount(RaftLog *log);
 raft_index_t RaftLogFirstIdx(RaftLog *log);
 raft_index_t RaftLogCurrentIdx(RaftLog *log);
-long long int RaftLogRewrite(RedisRaftCtx *rr, const char *filename, raft_index_t last_idx, raft_term_t last_term);
+RRStatus RaftLogCompact(RaftLog *log, raft_index_t last_idx, raft_term_t last_term);
 void RaftLogRemoveFiles(const char *filename);
 void RaftLogArchiveFiles(RedisRaftCtx *rr);
-RRStatus RaftLogRewriteSwitch(RedisRaftCtx *rr, RaftLog *new_log, unsigned long new_log_entries);
 
 typedef struct EntryCache {
     unsigned long int size;             /* Size of ptrs */
@@ -731,7 +1000,8 @@ void EntryCacheAppend(EntryCache *cache, raft_entry_t *ety, raft_index_t idx);
 raft_entry_t *EntryCacheGet(EntryCache *cache, raft_index_t idx);
 long EntryCacheDeleteHead(EntryCache *cache, raft_index_t idx);
 long EntryCacheDeleteTail(EntryCache *cache, raft_index_t index);
-long EntryCacheCompact(EntryCache *cache, size_t max_memory);
+long EntryCacheCompact(EntryCache *cache, size_t max_memory, size_t tail_memory, raft_index_t keep_idx);
+unsigned long EntryCacheCountRange(EntryCache *cache, raft_index_t idx, unsigned long n);
 
 /* config.c */
 void ConfigInit(RedisModuleCtx *ctx, RedisRaftConfig *config);
@@ -740,6 +1010,7 @@ void handleConfigSet(RedisRaftCtx *rr, RedisModuleCtx *ctx, RedisModuleString **
 void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleString **argv, int argc);
 RRStatus ConfigReadFromRedis(RedisRaftCtx *rr);
 RRStatus ConfigureRedis(RedisModuleCtx *ctx);
+const char *getFsyncPolicyName(RaftLogFsyncPolicy policy);
 
 /* snapshot.c */
 extern RedisModuleTypeMethods RedisRaftTypeMethods;
@@ -761,6 +1032,8 @@ void archiveSnapshot(RedisRaftCtx *rr);
 
 /* proxy.c */
 RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader);
+void ProxyBatchAdd(RedisRaftCtx *rr, RaftReq *req, Node *leader);
+void ProxyBatchFlush(RedisRaftCtx *rr);
 
 /* connection.c */
 Connection *ConnCreate(RedisRaftCtx *rr, void *privdata, ConnectionCallbackFunc idle_cb, ConnectionFreeFunc free_cb);
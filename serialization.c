@@ -7,6 +7,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include "redisraft.h"
 
@@ -125,19 +126,27 @@ static int encodeInteger(char prefix, char *ptr, size_t sz, unsigned long val)
     return n;
 }
 
-/* Serialize a number of RaftRedisCommand into a Raft entry */
-raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source)
+/* Returns the size of a serialized RaftRedisCommandArray */
+size_t RaftRedisCommandArraySerializedSize(const RaftRedisCommandArray *source)
 {
     size_t sz = calcIntSerializedLen(source->len);
-    size_t len;
-    int n, i, j;
-    char *p;
+    int i;
 
-    /* Compute sizes */
     for (i = 0; i < source->len; i++) {
         sz += calcSerializedSize(source->commands[i]);
     }
 
+    return sz;
+}
+
+/* Serialize a number of RaftRedisCommand into a Raft entry */
+raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source)
+{
+    size_t sz = RaftRedisCommandArraySerializedSize(source);
+    size_t len;
+    int n, i, j;
+    char *p;
+
     /* Prepare entry */
     raft_entry_t *ety = raft_entry_new(sz);
     p = ety->data;
@@ -280,3 +289,165 @@ RRStatus RaftRedisCommandArrayDeserialize(RaftRedisCommandArray *target, const v
 }
 
 
+
+/* RAFT.AE messages are sent in binary form, as a fixed size header
+ * (RaftAEHeader) followed by an entries buffer. The entries buffer holds a
+ * table of entry headers, followed by the data of all entries, each padded
+ * to an 8 byte boundary.
+ *
+ * The entries buffer only depends on the entries, so the leader encodes it
+ * once and sends it to every follower that needs the same entries. Received
+ * entries point into a single copy of it, rather than having their data
+ * copied one by one.
+ *
+ * Fields are stored in host byte order.
+ */
+
+typedef struct RaftAEEntry {
+    int64_t term;
+    int32_t id;
+    int16_t type;
+    int16_t unused;
+    uint64_t data_len;
+} RaftAEEntry;
+
+#define AE_DATA_ALIGN(len)  (((len) + 7) & ~((size_t) 7))
+
+typedef struct RaftAEBuffer {
+    unsigned int refs;
+    size_t len;
+    char data[];
+} RaftAEBuffer;
+
+/* An entry whose data is part of a shared RaftAEBuffer */
+typedef struct RaftAESharedEntry {
+    raft_entry_t entry;
+    RaftAEBuffer *buf;
+} RaftAESharedEntry;
+
+void RaftAEEncodeHeader(RaftAEHeader *hdr, const msg_appendentries_t *msg)
+{
+    *hdr = (RaftAEHeader) {
+        .magic = RAFT_AE_MAGIC,
+        .version = RAFT_AE_VERSION,
+        .leader_id = msg->leader_id,
+        .n_entries = msg->n_entries,
+        .term = msg->term,
+        .prev_log_idx = msg->prev_log_idx,
+        .prev_log_term = msg->prev_log_term,
+        .leader_commit = msg->leader_commit,
+        .msg_id = msg->msg_id
+    };
+}
+
+char *RaftAEEncodeEntries(raft_entry_t **entries, int n_entries, size_t *len)
+{
+    size_t size = sizeof(RaftAEEntry) * n_entries;
+    int i;
+
+    for (i = 0; i < n_entries; i++) {
+        size += AE_DATA_ALIGN(entries[i]->data_len);
+    }
+
+    char *buf = RedisModule_Calloc(1, size ? size : 1);
+    RaftAEEntry *table = (RaftAEEntry *) buf;
+    char *p = buf + sizeof(RaftAEEntry) * n_entries;
+
+    for (i = 0; i < n_entries; i++) {
+        raft_entry_t *e = entries[i];
+
+        table[i] = (RaftAEEntry) {
+            .term = e->term,
+            .id = e->id,
+            .type = e->type,
+            .data_len = e->data_len
+        };
+        memcpy(p, e->data, e->data_len);
+        p += AE_DATA_ALIGN(e->data_len);
+    }
+
+    *len = size;
+    return buf;
+}
+
+static void freeSharedEntry(raft_entry_t *ety)
+{
+    RaftAESharedEntry *se = (RaftAESharedEntry *) ety;
+
+    if (!__atomic_sub_fetch(&se->buf->refs, 1, __ATOMIC_ACQ_REL)) {
+        RedisModule_Free(se->buf);
+    }
+    RedisModule_Free(se);
+}
+
+/* Decodes a RAFT.AE message. On success, msg->entries holds newly allocated
+ * entries that share a copy of the entries buffer.
+ */
+RRStatus RaftAEDecode(msg_appendentries_t *msg, const void *hdr_buf, size_t hdr_len,
+                      const void *entries_buf, size_t entries_len)
+{
+    RaftAEHeader hdr;
+    int i;
+
+    if (hdr_len != sizeof(hdr)) {
+        return RR_ERROR;
+    }
+    memcpy(&hdr, hdr_buf, sizeof(hdr));
+
+    if (hdr.magic != RAFT_AE_MAGIC || hdr.version != RAFT_AE_VERSION || hdr.n_entries < 0 ||
+        (size_t) hdr.n_entries > entries_len / sizeof(RaftAEEntry)) {
+        return RR_ERROR;
+    }
+
+    /* Validate the entry table before allocating anything */
+    size_t table_size = sizeof(RaftAEEntry) * hdr.n_entries;
+    size_t offset = table_size;
+    for (i = 0; i < hdr.n_entries; i++) {
+        RaftAEEntry ae;
+        memcpy(&ae, (const char *) entries_buf + sizeof(ae) * i, sizeof(ae));
+
+        if (ae.data_len > UINT_MAX || AE_DATA_ALIGN(ae.data_len) > entries_len - offset) {
+            return RR_ERROR;
+        }
+        offset += AE_DATA_ALIGN(ae.data_len);
+    }
+
+    msg->leader_id = hdr.leader_id;
+    msg->term = hdr.term;
+    msg->prev_log_idx = hdr.prev_log_idx;
+    msg->prev_log_term = hdr.prev_log_term;
+    msg->leader_commit = hdr.leader_commit;
+    msg->msg_id = hdr.msg_id;
+    msg->n_entries = hdr.n_entries;
+    msg->entries = NULL;
+
+    if (!hdr.n_entries) {
+        return RR_OK;
+    }
+
+    RaftAEBuffer *buf = RedisModule_Alloc(sizeof(RaftAEBuffer) + entries_len);
+    buf->refs = hdr.n_entries;
+    buf->len = entries_len;
+    memcpy(buf->data, entries_buf, entries_len);
+
+    msg->entries = RedisModule_Calloc(hdr.n_entries, sizeof(msg_entry_t *));
+
+    RaftAEEntry *table = (RaftAEEntry *) buf->data;
+    offset = table_size;
+    for (i = 0; i < hdr.n_entries; i++) {
+        RaftAESharedEntry *se = RedisModule_Calloc(1, sizeof(RaftAESharedEntry));
+        se->buf = buf;
+        se->entry.refs = 1;
+        se->entry.term = table[i].term;
+        se->entry.id = table[i].id;
+        se->entry.type = table[i].type;
+        se->entry.data_len = table[i].data_len;
+        se->entry.data = buf->data + offset;
+        se->entry.free_func = freeSharedEntry;
+
+        msg->entries[i] = &se->entry;
+        offset += AE_DATA_ALIGN(table[i].data_len);
+    }
+
+    return RR_OK;
+}
@@ -87,7 +87,7 @@ int raftGetSnapshotChunk(raft_server_t* raft, void *user_data,
     Node *node = raft_node_get_udata(raft_node);
 
     /* To apply some backpressure, we allow maximum 32 messages on the fly */
-    if (node->pending_raft_response_num >= 32 || !ConnIsConnected(node->conn)) {
+    if (node->pending_raft_response_num >= 32 || !ConnIsConnected(NodeGetRaftConn(node))) {
         return RAFT_ERR_DONE;
     }
 
@@ -244,53 +244,32 @@ void cancelSnapshot(RedisRaftCtx *rr, SnapshotResult *sr)
 
 RRStatus finalizeSnapshot(RedisRaftCtx *rr, SnapshotResult *sr)
 {
-    RaftLog *new_log = NULL;
-    unsigned long num_log_entries;
-
-    char temp_log_filename[256];
-    snprintf(temp_log_filename, sizeof(temp_log_filename) - 1, "%s.tmp",
-        rr->config->raft_log_filename);
-
     assert(rr->snapshot_in_progress);
 
     TRACE("Finalizing snapshot.");
 
-    /* Rewrite any additional log entries beyond the snapshot to a new
-     * log file.
-     */
-    num_log_entries = RaftLogRewrite(rr, temp_log_filename,
-        rr->last_snapshot_idx, rr->last_snapshot_term);
-
-    new_log = RaftLogOpen(temp_log_filename, rr->config, RAFTLOG_KEEP_INDEX);
-    if (!new_log) {
-        LOG_ERROR("Failed to open log after rewrite: %s", strerror(errno));
-        cancelSnapshot(rr, sr);
-        return -1;
-    }
-
-    LOG_VERBOSE("Log rewrite complete, %lu entries rewritten (from idx %lu).",
-            num_log_entries, raft_get_snapshot_last_idx(rr->raft));
-
-    /* We now have to switch temp files. We need to rename two files in a non-atomic
-     * operation, so order is critical and we must rename the snapshot file first.
-     * This guarantees we lose no data if we fail now before renaming the log -- all
-     * we'll have to do is skip redundant log entries.
+    /* Switch to the new snapshot file first, and only then compact the log.
+     * This guarantees we lose no data if we fail before the log is compacted
+     * -- all we'll have to do is skip redundant log entries.
      */
 
     if (rename(sr->rdb_filename, rr->config->rdb_filename) < 0) {
         LOG_ERROR("Failed to switch snapshot filename (%s to %s): %s",
                 sr->rdb_filename, rr->config->rdb_filename, strerror(errno));
-        RaftLogClose(new_log);
         cancelSnapshot(rr, sr);
         return -1;
     }
 
-    if (RaftLogRewriteSwitch(rr, new_log, num_log_entries) != RR_OK) {
-        RaftLogClose(new_log);
+    /* Compaction only drops whole log segments, so no entries are copied */
+    if (RaftLogCompact(rr->log, rr->last_snapshot_idx, rr->last_snapshot_term) != RR_OK) {
+        LOG_ERROR("Failed to compact Raft log");
         cancelSnapshot(rr, sr);
         return -1;
     }
 
+    LOG_VERBOSE("Log compaction complete, %lu entries left (from idx %lu).",
+            RaftLogCount(rr->log), rr->last_snapshot_idx);
+
     createOutgoingSnapshotMmap(rr);
 
     /* Finalize snapshot */
@@ -568,6 +547,7 @@ int raftLoadSnapshot(raft_server_t* raft, void *user_data, raft_index_t index, r
                 raft_get_voted_for(rr->raft),
                 rr->config);
         EntryCacheDeleteHead(rr->logcache, raft_get_snapshot_last_idx(rr->raft) + 1);
+        resetRaftLogSync(rr);
     }
 
     RedisModule_ThreadSafeContextUnlock(rr->ctx);
@@ -747,9 +727,9 @@ static void handleSnapshotResponse(redisAsyncContext *c, void *r, void *privdata
 
     redisReply *reply = r;
 
-    NodeDismissPendingResponse(node);
+    NodeDismissPendingResponse(node, false);
     if (!reply) {
-        ConnMarkDisconnected(node->conn);
+        ConnMarkDisconnected(NodeGetRaftConn(node));
         return;
     }
     if (reply->type == REDIS_REPLY_ERROR) {
@@ -825,11 +805,12 @@ int raftSendSnapshot(raft_server_t* raft,
         msg->chunk.len,
     };
 
-    if (!ConnIsConnected(node->conn)) {
+    Connection *conn = NodeGetRaftConn(node);
+    if (!ConnIsConnected(conn)) {
         return -1;
     }
 
-    if (redisAsyncCommandArgv(ConnGetRedisCtx(node->conn),
+    if (redisAsyncCommandArgv(ConnGetRedisCtx(conn),
                 handleSnapshotResponse, node, 5, args, args_len) != REDIS_OK) {
         return -1;
     }
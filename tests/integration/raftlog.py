@@ -17,6 +17,7 @@ class RawEntry(object):
     # Log entries
     RAFTLOG = 'RAFTLOG'
     ENTRY = 'ENTRY'
+    SEGMENTS = 'SEGMENTS'
 
     def __init__(self, args):
         self.args = args.copy()
@@ -50,8 +51,33 @@ class RawEntry(object):
             return LogEntry(args)
         if str(args[0], encoding='ascii') == cls.RAFTLOG:
             return LogHeader(args)
+        if str(args[0], encoding='ascii') == cls.SEGMENTS:
+            return LogManifest(args)
         return RawEntry(args)
 
+    # Version 2 binary entry header: magic, crc, term, id, type, len
+    BINARY_HEADER = struct.Struct('=IIqiiQ')
+    BINARY_MAGIC = 0x45524c52
+
+    @classmethod
+    def from_binary_file(cls, _file):
+        hdr = _file.read(cls.BINARY_HEADER.size)
+        if not hdr:
+            raise EOFError('End of file reading entry header')
+        if len(hdr) < cls.BINARY_HEADER.size:
+            raise EOFError('Truncated entry header')
+        magic, _, term, _id, _type, _len = cls.BINARY_HEADER.unpack(hdr)
+        if magic == 0:
+            # Zeroed, preallocated space past the last entry
+            raise EOFError('End of entries')
+        if magic != cls.BINARY_MAGIC:
+            raise RuntimeError('Invalid entry header magic')
+        data = _file.read(_len)
+        if len(data) < _len:
+            raise EOFError('Truncated entry data')
+        return LogEntry([cls.ENTRY.encode(), str(term).encode(),
+                         str(_id).encode(), str(_type).encode(), data])
+
     def __str__(self):
         return '<RawEntry:kind=%s>' % self.kind()
 
@@ -100,6 +126,14 @@ class LogHeader(RawEntry):
             self.snapshot_term(), self.snapshot_index())
 
 
+class LogManifest(RawEntry):
+    def segments(self):
+        return [int(x) for x in self.args[1:]]
+
+    def __repr__(self):
+        return '<LogManifest:segments=%s>' % self.segments()
+
+
 class LogEntry(RawEntry):
     class LogType(Enum):
         NORMAL = 0
@@ -177,6 +211,7 @@ class LogEntry(RawEntry):
 
 class RaftLog(object):
     def __init__(self, filename):
+        self.filename = filename
         self.logfile = open(filename, 'rb')
         self.entries = []
 
@@ -184,13 +219,38 @@ class RaftLog(object):
         self.entries = []
         self.logfile.seek(0, os.SEEK_SET)
 
+    def read_segment(self, first_idx, snapshot_index):
+        idx = first_idx
+        with open('{}.{}'.format(self.filename, first_idx), 'rb') as segfile:
+            while True:
+                try:
+                    entry = RawEntry.from_binary_file(segfile)
+                except EOFError:
+                    break
+                # Compacted entries may remain in the first segment
+                if idx > snapshot_index:
+                    self.entries.append(entry)
+                idx += 1
+
     def read(self):
-        while True:
-            try:
-                entry = RawEntry.from_file(self.logfile)
-            except EOFError:
-                break
-            self.entries.append(entry)
+        header = RawEntry.from_file(self.logfile)
+        self.entries.append(header)
+
+        if header.version() >= 3:
+            # Metadata file holds the header and the segment manifest
+            manifest = RawEntry.from_file(self.logfile)
+            for first_idx in manifest.segments():
+                self.read_segment(first_idx, header.snapshot_index())
+        else:
+            while True:
+                try:
+                    if header.version() >= 2:
+                        entry = RawEntry.from_binary_file(self.logfile)
+                    else:
+                        entry = RawEntry.from_file(self.logfile)
+                except EOFError:
+                    break
+                self.entries.append(entry)
         self.dump()
 
     def header(self):
@@ -149,6 +149,77 @@ def test_readonly_commands(cluster):
     assert cluster.node(1).client.get('key') == b'value'
 
 
+def test_lease_reads(cluster):
+    """
+    Test read-only commands served under the leader's read lease.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('lease-reads', 'yes')
+
+    assert cluster.node(1).client.set('key', 'value')
+    for _ in range(10):
+        assert cluster.node(1).client.get('key') == b'value'
+    assert cluster.node(1).raft_info()['lease_read_hits'] > 0
+
+    # Without a quorum the lease expires and reads hang
+    cluster.node(2).terminate()
+    cluster.node(3).terminate()
+    time.sleep(1)
+    misses = cluster.node(1).raft_info()['lease_read_misses']
+    conn = cluster.node(1).client.connection_pool.get_connection(
+        'RAFT', socket_timeout=1)
+    conn.send_command('GET', 'key')
+    assert not conn.can_read(timeout=1)
+    assert cluster.node(1).raft_info()['lease_read_misses'] == misses + 1
+
+
+def test_local_reads(cluster):
+    """
+    Test read-only commands executed natively by the leader's main thread.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+    assert cluster.node(1).client.set('key', 'value')
+
+    # Quorum reads go through the Raft thread
+    assert cluster.node(1).client.get('key') == b'value'
+    assert cluster.node(1).raft_info()['local_reads'] == 0
+
+    cluster.node(1).raft_config_set('lease-reads', 'yes')
+    cluster.node(1).wait_for_election()
+    time.sleep(0.5)
+    assert cluster.node(1).client.get('key') == b'value'
+    assert cluster.node(1).raft_info()['local_reads'] == 1
+
+    # Reads in MULTI are queued
+    conn = cluster.node(1).client.connection_pool.get_connection('multi')
+    for cmd, reply in ((('MULTI',), b'OK'),
+                       (('GET', 'key'), b'QUEUED'),
+                       (('EXEC',), [b'value'])):
+        conn.send_command(*cmd)
+        assert conn.read_response() == reply
+    assert cluster.node(1).raft_info()['local_reads'] == 1
+
+
+def test_follower_reads(cluster):
+    """
+    Test read-only commands served by a follower after applying the leader's
+    read index.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(2).raft_config_set('follower-reads', 'yes')
+
+    assert cluster.node(1).client.set('key', 'value')
+    assert cluster.node(2).client.get('key') == b'value'
+    assert cluster.node(2).raft_info()['follower_reads'] == 1
+
+    # Writes are still redirected
+    with raises(ResponseError, match='MOVED'):
+        cluster.node(2).client.set('key', 'value2')
+
+
 def test_auto_ids(cluster):
     """
     Test automatic assignment of ids.
@@ -345,3 +416,219 @@ def test_rolled_back_read_only_multi_reply(cluster):
 
     with raises(ResponseError, match='TIMEOUT'):
         assert conn.read_response() == None
+
+
+def test_write_batching(cluster):
+    """
+    Writes of concurrent clients may be appended as a single entry, but every
+    client receives the reply to its own command.
+    """
+
+    cluster.create(3)
+    leader = cluster.leader_node()
+
+    conns = [leader.client.connection_pool.get_connection('deferred')
+             for _ in range(20)]
+    for i, conn in enumerate(conns):
+        conn.send_command('INCRBY', 'counter', i + 1)
+    replies = [conn.read_response() for conn in conns]
+
+    assert len(set(replies)) == len(conns)
+    assert max(replies) == 210
+
+    info = leader.raft_info()
+    assert info['write_batch_commands'] >= len(conns)
+    assert info['write_batches'] <= info['write_batch_commands']
+
+    cluster.wait_for_unanimity()
+    for node in cluster.nodes.values():
+        node.wait_for_log_applied()
+        assert node.raft_debug_exec('get', 'counter') == b'210'
+
+
+def test_peer_port(cluster):
+    """
+    Raft messages are exchanged over the peer port when it is enabled.
+    """
+
+    cluster.create(3, raft_args={'peer-port-offset': 10000})
+    assert cluster.leader == 1
+    leader = cluster.leader_node()
+    assert leader.raft_info()['peer_port'] == leader.port + 10000
+
+    assert leader.client.set('key', 'value')
+    cluster.wait_for_unanimity()
+    for node in cluster.nodes.values():
+        node.wait_for_log_applied()
+        assert node.raft_debug_exec('get', 'key') == b'value'
+    assert cluster.node(2).raft_info()['peer_messages'] > 0
+
+    info = leader.raft_info()
+    peers = [v for k, v in info.items() if k.startswith('node') and k != 'node_id']
+    assert [p['peer_state'] for p in peers] == ['connected', 'connected']
+
+    # Elections take place over the peer port as well
+    cluster.node(1).terminate()
+    cluster.node(2).wait_for_election()
+    assert cluster.execute('set', 'key', 'value2')
+
+
+def test_request_queue_info(cluster):
+    """
+    RAFT.INFO reports the depth of each request queue lane, which is drained
+    once requests complete.
+    """
+
+    cluster.create(1)
+    node = cluster.node(1)
+    assert node.client.set('key', 'value')
+    assert node.client.get('key') == b'value'
+
+    info = node.raft_info()
+    assert info['rqueue_reqs'] >= 2
+    for lane in ('consensus', 'read', 'write'):
+        assert info['rqueue_{}_len'.format(lane)] == 0
+
+
+def test_max_pending_entries(cluster):
+    """
+    Writes are rejected once too many entries are pending commit.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('max-pending-entries', '1')
+    assert cluster.node(1).client.set('key', 'value')
+
+    # Without a quorum the first write stays pending, and blocks the next
+    cluster.node(2).terminate()
+    cluster.node(3).terminate()
+    conn = cluster.node(1).client.connection_pool.get_connection(
+        'RAFT', socket_timeout=1)
+    conn.send_command('SET', 'key', 'value2')
+    assert not conn.can_read(timeout=1)
+
+    with raises(ResponseError, match='BUSY'):
+        cluster.node(1).client.set('key', 'value3')
+    assert cluster.node(1).raft_info()['rejected_pending_writes'] == 1
+
+    # Reads are not affected
+    cluster.node(1).raft_config_set('quorum-reads', 'no')
+    assert cluster.node(1).client.get('key') == b'value'
+
+
+def test_commit_latency_info(cluster):
+    """
+    RAFT.INFO reports the commit latency measured by the leader.
+    """
+
+    cluster.create(1)
+    node = cluster.node(1)
+    node.raft_config_set('commit-latency-target', '1000')
+    for i in range(10):
+        assert node.client.set('key', str(i))
+    time.sleep(1.5)
+
+    info = node.raft_info()
+    assert info['commit_latency_p99_usec'] > 0
+    assert info['commit_latency_shedding'] == 'no'
+    assert info['shed_writes'] == 0
+
+
+def test_proxy_batching(cluster):
+    """
+    Writes proxied together are sent to the leader in a single batch, and
+    every client receives its own reply.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(2).raft_config_set('follower-proxy', 'yes')
+
+    # Commands sent while node 2 is stalled are read and proxied together
+    conns = [cluster.node(2).client.connection_pool.get_connection('RAFT')
+             for _ in range(10)]
+    cluster.node(2).pause()
+    for i, conn in enumerate(conns):
+        conn.send_command('INCRBY', 'counter', i + 1)
+    cluster.node(2).resume()
+    replies = sorted([conn.read_response() for conn in conns])
+    for conn in conns:
+        cluster.node(2).client.connection_pool.release(conn)
+
+    assert replies[-1] == 55
+    assert len(set(replies)) == 10
+    assert cluster.leader_node().client.get('counter') == b'55'
+
+    # Errors go to the command that caused them only
+    assert cluster.node(2).client.sadd('myset', 'a') == 1
+    with raises(ResponseError, match='WRONGTYPE'):
+        cluster.node(2).client.incr('myset')
+
+    info = cluster.node(2).raft_info()
+    assert info['proxy_reqs'] >= 12
+    assert info['proxy_batches'] >= 1
+    assert info['proxy_batch_reqs'] >= 2
+
+
+def test_proxy_batch_error(cluster):
+    """
+    An error the leader returns for a whole batch is returned to every
+    client in it.
+    """
+
+    cluster.create(5)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('max-pending-entries', '1')
+    cluster.node(2).raft_config_set('follower-proxy', 'yes')
+    assert cluster.node(2).client.set('key', 'value')
+
+    # Without a quorum, a write stays pending on the leader and the next
+    # batch is rejected
+    cluster.node(3).terminate()
+    cluster.node(4).terminate()
+    cluster.node(5).terminate()
+    pending = cluster.node(1).client.connection_pool.get_connection(
+        'RAFT', socket_timeout=1)
+    pending.send_command('SET', 'key', 'value2')
+    assert not pending.can_read(timeout=1)
+
+    conns = [cluster.node(2).client.connection_pool.get_connection('RAFT')
+             for _ in range(5)]
+    cluster.node(2).pause()
+    for i, conn in enumerate(conns):
+        conn.send_command('SET', 'key{}'.format(i), 'value')
+    cluster.node(2).resume()
+    for conn in conns:
+        with raises(ResponseError, match='BUSY'):
+            conn.read_response()
+        cluster.node(2).client.connection_pool.release(conn)
+
+    info = cluster.node(2).raft_info()
+    assert info['proxy_batches'] >= 1
+    assert cluster.node(1).raft_info()['rejected_pending_writes'] >= 1
+
+
+def test_lease_reads_after_stall(cluster):
+    """
+    A leader stalled for longer than the election timeout does not serve
+    reads under its old lease once it resumes.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('lease-reads', 'yes')
+    assert cluster.node(1).client.set('key', 'old')
+    assert cluster.node(1).client.get('key') == b'old'
+
+    # Other nodes elect a new leader and write while node 1 is stalled
+    cluster.node(1).pause()
+    cluster.node(2).wait_for_election()
+    cluster.node(2).raft_config_set('follower-proxy', 'yes')
+    assert cluster.node(2).client.set('key', 'new')
+    cluster.node(1).resume()
+
+    try:
+        assert cluster.node(1).client.get('key') != b'old'
+    except ResponseError:
+        pass
@@ -14,6 +14,7 @@
 
 #include "cmocka.h"
 #include "raft.h"
+#include "../redismodule.h"
 
 extern struct CMUnitTest log_tests[];
 extern struct CMUnitTest util_tests[];
@@ -35,6 +36,10 @@ int tests_count(struct CMUnitTest *tests)
 
 extern FILE *redis_raft_logfile;
 
+static void __redis_module_log_stub(RedisModuleCtx *ctx, const char *level, const char *fmt, ...)
+{
+}
+
 static void *__raft_malloc_stub(size_t size)
 {
     return test_malloc(size);
@@ -59,6 +64,7 @@ int main(int argc, char *argv[])
 {
     raft_set_heap_functions(__raft_malloc_stub, __raft_calloc_stub,
             __raft_realloc_stub, __raft_free_stub);
+    RedisModule_Log = __redis_module_log_stub;
 
     return _cmocka_run_group_tests(
             "log", log_tests, tests_count(log_tests), NULL, NULL) ||
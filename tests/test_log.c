@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 
 #include "cmocka.h"
 
@@ -21,23 +22,34 @@
 #define LOGNAME "test.log.db"
 #define DBID "01234567890123456789012345678901"
 
-static int setup_create_log(void **state)
+/* Tests that start new segments create and close the log themselves, as
+ * cmocka reports memory allocated by a test and released in teardown as leaked.
+ */
+static RaftLog *__create_log(void)
 {
     RedisRaftConfig cfg = {
-        .id = 1
+        .id = 1,
+        .raft_log_fsync_policy = RAFT_LOG_FSYNC_NEVER
     };
 
-    *state = RaftLogCreate(LOGNAME, DBID, 1, 0, 1, -1, &cfg);
-    assert_non_null(*state);
+    RaftLog *log = RaftLogCreate(LOGNAME, DBID, 1, 0, 1, -1, &cfg);
+    assert_non_null(log);
+    return log;
+}
+
+static int setup_create_log(void **state)
+{
+    *state = __create_log();
     return 0;
 }
 
 static int teardown_log(void **state)
 {
     RaftLog *log = (RaftLog *) *state;
-    RaftLogClose(log);
-    unlink(LOGNAME);
-    unlink(LOGNAME ".idx");
+    if (log) {
+        RaftLogClose(log);
+    }
+    RaftLogRemoveFiles(LOGNAME);
     return 0;
 }
 
@@ -99,7 +111,7 @@ static void test_log_random_access(void **state)
 
 static void test_log_random_access_with_snapshot(void **state)
 {
-    RaftLog *log = (RaftLog *) *state;
+    RaftLog *log = __create_log();
 
     /* Reset log assuming last snapshot is 100 */
     RaftLogReset(log, 100, 1);
@@ -121,6 +133,94 @@ static void test_log_random_access_with_snapshot(void **state)
     e = RaftLogGet(log, 102);
     assert_int_equal(e->id, 30);
     raft_entry_release(e);
+
+    RaftLogClose(log);
+}
+
+static void test_log_group_sync(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    log->fsync_policy = RAFT_LOG_FSYNC_ALWAYS;
+
+    /* Appends are not synced individually */
+    __append_entry(log, 3);
+    __append_entry(log, 30);
+    __append_entry(log, 300);
+    assert_int_equal(log->unsynced_entries, 3);
+    assert_int_equal(log->fsync_count, 0);
+
+    /* A single sync covers all of them */
+    assert_int_equal(RaftLogSync(log), RR_OK);
+    assert_int_equal(log->unsynced_entries, 0);
+    assert_int_equal(log->fsync_count, 1);
+
+    /* Nothing to sync */
+    assert_int_equal(RaftLogSync(log), RR_OK);
+    assert_int_equal(log->fsync_count, 1);
+
+    raft_entry_t *e = RaftLogGet(log, 3);
+    assert_non_null(e);
+    assert_int_equal(e->id, 300);
+    raft_entry_release(e);
+}
+
+static void __notify_synced(void *arg)
+{
+    __atomic_add_fetch((int *) arg, 1, __ATOMIC_SEQ_CST);
+}
+
+static void test_log_writer(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    int notified = 0;
+    int i;
+
+    log->fsync_policy = RAFT_LOG_FSYNC_ALWAYS;
+    RaftLogWriter *w = RaftLogWriterNew(__notify_synced, &notified);
+
+    __append_entry(log, 3);
+    __append_entry(log, 30);
+    __append_entry(log, 300);
+    assert_int_equal(RaftLogWriterSync(w, log), RR_OK);
+    assert_int_equal(log->unsynced_entries, 0);
+
+    /* Wait for the writer thread */
+    for (i = 0; i < 1000 && !__atomic_load_n(&notified, __ATOMIC_SEQ_CST); i++) {
+        usleep(1000);
+    }
+    assert_int_equal(notified, 1);
+    assert_int_equal(RaftLogWriterSyncedIdx(w), 3);
+    assert_int_equal(w->fsync_count, 1);
+
+    /* Removed entries are no longer synced */
+    RaftLogWriterTruncate(w, 1);
+    assert_int_equal(RaftLogWriterSyncedIdx(w), 1);
+
+    /* With 'never', entries are synced once flushed */
+    log->fsync_policy = RAFT_LOG_FSYNC_NEVER;
+    __append_entry(log, 3000);
+    assert_int_equal(RaftLogWriterSync(w, log), RR_OK);
+    assert_int_equal(RaftLogWriterSyncedIdx(w), 4);
+    assert_int_equal(w->fsync_count, 1);
+    assert_int_equal(RaftLogWriterFlush(w, log), RR_OK);
+    assert_int_equal(notified, 1);
+
+    /* With 'everysec', entries are acknowledged at once and synced later */
+    log->fsync_policy = RAFT_LOG_FSYNC_EVERYSEC;
+    __append_entry(log, 30000);
+    assert_int_equal(RaftLogWriterSync(w, log), RR_OK);
+    assert_int_equal(RaftLogWriterSyncedIdx(w), 5);
+    assert_int_equal(log->unsynced_entries, 1);
+
+    assert_int_equal(RaftLogWriterFlush(w, log), RR_OK);
+    assert_int_equal(log->unsynced_entries, 0);
+    for (i = 0; i < 1000 && __atomic_load_n(&notified, __ATOMIC_SEQ_CST) < 2; i++) {
+        usleep(1000);
+    }
+    assert_int_equal(notified, 2);
+    assert_int_equal(w->fsync_count, 2);
+
+    RaftLogWriterFree(w);
 }
 
 static void test_log_load_entries(void **state)
@@ -143,14 +243,14 @@ static void test_log_load_entries(void **state)
 
 static void test_log_index_rebuild(void **state)
 {
-    RaftLog *log = (RaftLog *) *state;
+    RaftLog *log = __create_log();
     RaftLogReset(log, 100, 1);
 
     __append_entry(log, 3);
     __append_entry(log, 30);
 
     /* Delete index file */
-    unlink(LOGNAME ".idx");
+    unlink(LOGNAME ".101.idx");
 
     /* Reopen the log */
     RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
@@ -171,6 +271,344 @@ static void test_log_index_rebuild(void **state)
 
     /* Close the log */
     RaftLogClose(log2);
+    RaftLogClose(log);
+}
+
+static void test_log_index_grow(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    int i;
+
+    /* Append beyond the initially mapped index */
+    for (i = 1; i <= 3000; i++) {
+        __append_entry(log, i);
+    }
+
+    for (i = 1; i <= 3000; i += 999) {
+        raft_entry_t *e = RaftLogGet(log, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+    assert_null(RaftLogGet(log, 3001));
+
+    /* Reload keeping the existing index */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, RAFTLOG_KEEP_INDEX);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, NULL, NULL), 3000);
+
+    raft_entry_t *e = RaftLogGet(log2, 2999);
+    assert_non_null(e);
+    assert_int_equal(e->id, 2999);
+    raft_entry_release(e);
+
+    RaftLogClose(log2);
+}
+
+static void test_log_preallocate(void **state)
+{
+    RaftLog *log = __create_log();
+    int i;
+
+    /* Preallocation applies to new segments */
+    log->preallocate = true;
+    log->segment_size = 64 * 1024;
+    assert_int_equal(RaftLogReset(log, 0, 1), RR_OK);
+
+    for (i = 1; i <= 3; i++) {
+        __append_entry(log, i);
+    }
+    assert_int_equal(RaftLogSync(log), RR_OK);
+
+#ifdef __linux__
+    struct stat st;
+    assert_int_equal(stat(LOGNAME ".1", &st), 0);
+    assert_int_equal(st.st_size, 64 * 1024);
+#endif
+
+    /* Preallocated space is not taken for entries */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    log2->preallocate = true;
+    log2->segment_size = 64 * 1024;
+    assert_int_equal(RaftLogLoadEntries(log2, NULL, NULL), 3);
+    assert_int_equal(log2->file_size, log->file_size);
+
+    __append_entry(log2, 4);
+    RaftLogClose(log2);
+
+    log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, NULL, NULL), 4);
+
+    raft_entry_t *e = RaftLogGet(log2, 4);
+    assert_non_null(e);
+    assert_int_equal(e->id, 4);
+    raft_entry_release(e);
+
+    RaftLogClose(log2);
+    RaftLogClose(log);
+}
+
+static void test_log_torn_tail(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+
+    __append_entry(log, 3);
+    __append_entry(log, 30);
+    __append_entry(log, 300);
+    size_t full_size = log->file_size;
+
+    /* Simulate a torn write of the last entry */
+    assert_int_equal(truncate(LOGNAME ".1", full_size - 5), 0);
+
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, NULL, NULL), 2);
+    assert_true(log2->file_size < full_size - 5);
+
+    /* Appending after the truncated tail produces a valid log */
+    __append_entry(log2, 301);
+    RaftLogClose(log2);
+
+    RaftLog *log3 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log3);
+    assert_int_equal(RaftLogLoadEntries(log3, NULL, NULL), 3);
+
+    raft_entry_t *e = RaftLogGet(log3, 3);
+    assert_non_null(e);
+    assert_int_equal(e->id, 301);
+    raft_entry_release(e);
+
+    RaftLogClose(log3);
+}
+
+static void test_log_corrupt_entry(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+
+    __append_entry(log, 3);
+    __append_entry(log, 30);
+    __append_entry(log, 300);
+    size_t full_size = log->file_size;
+
+    /* Corrupt the last byte of an entry that is followed by a valid one */
+    RaftLogSegment *seg = log->segments[0];
+    off_t offset = seg->index[2] - 1;
+    char c;
+    assert_int_equal(pread(fileno(seg->file), &c, 1, offset), 1);
+    c ^= 0xff;
+    assert_int_equal(pwrite(fileno(seg->file), &c, 1, offset), 1);
+
+    /* Loading fails rather than dropping the valid entry */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    assert_true(RaftLogLoadEntries(log2, NULL, NULL) < 0);
+    RaftLogClose(log2);
+
+    struct stat st;
+    assert_int_equal(stat(LOGNAME ".1", &st), 0);
+    assert_true((size_t) st.st_size >= full_size);
+}
+
+static void __write_v1_entry(FILE *f, int id, const char *value)
+{
+    fprintf(f, "*5\r\n$5\r\nENTRY\r\n$1\r\n1\r\n$%d\r\n%d\r\n$1\r\n0\r\n$%zu\r\n%s\r\n",
+            snprintf(NULL, 0, "%d", id), id, strlen(value), value);
+}
+
+static void test_log_v1_compat(void **state)
+{
+    /* Write a version 1 log by hand */
+    FILE *f = fopen(LOGNAME, "w");
+    assert_non_null(f);
+    fprintf(f, "*8\r\n$7\r\nRAFTLOG\r\n$4\r\n0001\r\n$32\r\n%s\r\n"
+               "$1\r\n1\r\n$1\r\n0\r\n$1\r\n0\r\n$1\r\n2\r\n$1\r\n1\r\n", DBID);
+    __write_v1_entry(f, 3, "value3");
+    __write_v1_entry(f, 30, "value30");
+    fclose(f);
+
+    /* Opening it converts it to the current format */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    assert_int_equal(log2->version, RAFTLOG_VERSION);
+    assert_int_equal(log2->term, 2);
+    assert_int_equal(log2->vote, 1);
+    assert_int_equal(access(LOGNAME ".legacy", F_OK), -1);
+
+    will_return_always(log_entries_callback, 0);
+    expect_value(log_entries_callback, ety_id, 3);
+    expect_memory(log_entries_callback, value, "value3", 6);
+    expect_value(log_entries_callback, ety_id, 30);
+    expect_memory(log_entries_callback, value, "value30", 7);
+    assert_int_equal(RaftLogLoadEntries(log2, log_entries_callback, NULL), 2);
+
+    RaftLogClose(log2);
+}
+
+static void test_log_writer_segments(void **state)
+{
+    RaftLog *log = __create_log();
+    int notified = 0;
+    int i;
+
+    log->fsync_policy = RAFT_LOG_FSYNC_ALWAYS;
+    log->segment_size = 1;
+    RaftLogWriter *w = RaftLogWriterNew(__notify_synced, &notified);
+
+    /* Starting a segment leaves syncing the previous one for later, unless
+     * an earlier one is still waiting.
+     */
+    __append_entry(log, 1);
+    __append_entry(log, 2);
+    assert_int_equal(log->fsync_count, 0);
+    assert_int_not_equal(log->sealed_fd, -1);
+    __append_entry(log, 3);
+    assert_int_equal(log->fsync_count, 1);
+    assert_int_equal(log->num_segments, 3);
+
+    /* The writer syncs the previous segment along with the active one */
+    assert_int_equal(RaftLogWriterSync(w, log), RR_OK);
+    assert_int_equal(log->sealed_fd, -1);
+    for (i = 0; i < 1000 && !__atomic_load_n(&notified, __ATOMIC_SEQ_CST); i++) {
+        usleep(1000);
+    }
+    assert_int_equal(notified, 1);
+    assert_int_equal(RaftLogWriterSyncedIdx(w), 3);
+    assert_int_equal(RaftLogWriterFsyncCount(w), 2);
+
+    RaftLogWriterFree(w);
+    RaftLogClose(log);
+}
+
+static void test_log_segments(void **state)
+{
+    RaftLog *log = __create_log();
+    raft_entry_t *e;
+    int i;
+
+    /* Every entry goes into a segment of its own */
+    log->segment_size = 1;
+    for (i = 1; i <= 5; i++) {
+        __append_entry(log, i);
+    }
+    assert_int_equal(log->num_segments, 5);
+
+    /* Compaction unlinks segments that hold no live entries */
+    assert_int_equal(RaftLogCompact(log, 3, 1), RR_OK);
+    assert_int_equal(log->num_segments, 2);
+    assert_int_equal(RaftLogCount(log), 2);
+    assert_int_equal(access(LOGNAME ".1", F_OK), -1);
+    assert_int_equal(access(LOGNAME ".3", F_OK), -1);
+    assert_null(RaftLogGet(log, 3));
+
+    e = RaftLogGet(log, 4);
+    assert_non_null(e);
+    assert_int_equal(e->id, 4);
+    raft_entry_release(e);
+
+    /* Deleting from a segment boundary unlinks it */
+    assert_int_equal(RaftLogDelete(log, 5, NULL, NULL), RR_OK);
+    assert_int_equal(log->num_segments, 1);
+    assert_int_equal(access(LOGNAME ".5", F_OK), -1);
+    assert_int_equal(RaftLogCurrentIdx(log), 4);
+    __append_entry(log, 50);
+
+    /* Reload */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
+    assert_non_null(log2);
+    assert_int_equal(log2->snapshot_last_idx, 3);
+    assert_int_equal(log2->num_segments, 2);
+    assert_int_equal(RaftLogLoadEntries(log2, NULL, NULL), 2);
+
+    e = RaftLogGet(log2, 5);
+    assert_non_null(e);
+    assert_int_equal(e->id, 50);
+    raft_entry_release(e);
+
+    RaftLogClose(log2);
+    RaftLogClose(log);
+}
+
+static void test_log_get_batch(void **state)
+{
+    RaftLog *log = __create_log();
+    raft_entry_t *entries[200];
+    int i;
+
+    log->segment_size = 4096;
+    for (i = 1; i <= 100; i++) {
+        __append_entry(log, i);
+
+        /* An entry larger than a single read */
+        if (i == 60) {
+            raft_entry_t *e = raft_entry_new(2 * 1024 * 1024);
+            e->id = 1000;
+            memset(e->data, 'x', e->data_len);
+            assert_int_equal(RaftLogAppend(log, e), RR_OK);
+            raft_entry_release(e);
+        }
+    }
+    assert_true(log->num_segments > 2);
+
+    /* Reads across segments, up to the end of the log */
+    assert_int_equal(RaftLogGetBatch(log, 1, 200, entries), 101);
+    for (i = 0; i < 101; i++) {
+        if (i == 60) {
+            assert_int_equal(entries[i]->id, 1000);
+            assert_int_equal(entries[i]->data_len, 2 * 1024 * 1024);
+            assert_int_equal(entries[i]->data[entries[i]->data_len - 1], 'x');
+        } else {
+            assert_int_equal(entries[i]->id, i < 60 ? i + 1 : i);
+        }
+        raft_entry_release(entries[i]);
+    }
+
+    assert_int_equal(RaftLogGetBatch(log, 50, 5, entries), 5);
+    for (i = 0; i < 5; i++) {
+        assert_int_equal(entries[i]->id, 50 + i);
+        raft_entry_release(entries[i]);
+    }
+
+    assert_int_equal(RaftLogGetBatch(log, 102, 5, entries), 0);
+
+    RaftLogClose(log);
+}
+
+static void test_log_keep_index(void **state)
+{
+    RaftLog *log = __create_log();
+    int i;
+
+    log->segment_size = 1;
+    for (i = 1; i <= 4; i++) {
+        __append_entry(log, i);
+    }
+    assert_int_equal(log->num_segments, 4);
+    RaftLogClose(log);
+
+    /* Kept indexes of earlier segments are used as is */
+    log = RaftLogOpen(LOGNAME, NULL, RAFTLOG_KEEP_INDEX);
+    assert_non_null(log);
+    assert_int_equal(RaftLogLoadEntries(log, NULL, NULL), 4);
+    assert_int_equal(log->index_rebuilds, 1);
+    RaftLogClose(log);
+
+    /* An index that does not match is rebuilt */
+    assert_int_equal(truncate(LOGNAME ".2.idx", 0), 0);
+    log = RaftLogOpen(LOGNAME, NULL, RAFTLOG_KEEP_INDEX);
+    assert_non_null(log);
+    assert_int_equal(RaftLogLoadEntries(log, NULL, NULL), 4);
+    assert_int_equal(log->index_rebuilds, 2);
+
+    for (i = 1; i <= 4; i++) {
+        raft_entry_t *e = RaftLogGet(log, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+
+    RaftLogClose(log);
 }
 
 static void test_log_write_after_read(void **state)
@@ -196,7 +634,7 @@ static void test_log_fuzzer(void **state)
     int idx = 0, i;
     raft_term_t t = 1;
 
-    log->fsync = false;
+    log->fsync_policy = RAFT_LOG_FSYNC_NEVER;
 
     for (i = 0; i < 10000; i++) {
         int new_entries = random() % 10;
@@ -255,7 +693,7 @@ static void mock_notify_func(void *arg, raft_entry_t *ety, raft_index_t idx)
 
 static void test_log_delete(void **state)
 {
-    RaftLog *log = (RaftLog *) *state;
+    RaftLog *log = __create_log();
 
     char value1[] = "value1";
     raft_entry_t *entry1 = __make_entry_value(3, value1);
@@ -314,6 +752,8 @@ static void test_log_delete(void **state)
     raft_entry_release(entry1);
     raft_entry_release(entry2);
     raft_entry_release(entry3);
+
+    RaftLogClose(log);
 }
 
 static void test_entry_cache_sanity(void **state)
@@ -493,6 +933,41 @@ static void test_entry_cache_delete_tail(void **state)
     EntryCacheFree(cache);
 }
 
+static void test_entry_cache_compact(void **state)
+{
+    EntryCache *cache = EntryCacheNew(4);
+    size_t entry_size = sizeof(raft_entry_t) + 100;
+    raft_entry_t *ety;
+    int i;
+
+    for (i = 1; i <= 10; i++) {
+        ety = raft_entry_new(100);
+        ety->id = i;
+        EntryCacheAppend(cache, ety, i);
+        raft_entry_release(ety);
+    }
+
+    assert_int_equal(EntryCacheCountRange(cache, 0, 3), 2);
+    assert_int_equal(EntryCacheCountRange(cache, 9, 5), 2);
+    assert_int_equal(EntryCacheCountRange(cache, 11, 5), 0);
+
+    /* Entries from index 4 onwards are needed, so kept within max memory */
+    assert_int_equal(EntryCacheCompact(cache, 8 * entry_size, 2 * entry_size, 4), 3);
+    assert_int_equal(cache->start_idx, 4);
+    assert_int_equal(cache->len, 7);
+
+    /* Entries no longer needed are only kept within the tail size */
+    assert_int_equal(EntryCacheCompact(cache, 8 * entry_size, 2 * entry_size, 20), 5);
+    assert_int_equal(cache->start_idx, 9);
+
+    /* Max memory applies regardless */
+    assert_int_equal(EntryCacheCompact(cache, entry_size, 0, 0), 1);
+    assert_int_equal(cache->start_idx, 10);
+    assert_int_equal(EntryCacheCountRange(cache, 1, 10), 1);
+
+    EntryCacheFree(cache);
+}
+
 static void test_entry_cache_fuzzer(void **state)
 {
     EntryCache *cache = EntryCacheNew(4);
@@ -549,18 +1024,40 @@ const struct CMUnitTest log_tests[] = {
             test_log_load_entries, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_log_random_access, setup_create_log, teardown_log),
-    cmocka_unit_test_setup_teardown(
-            test_log_random_access_with_snapshot, setup_create_log, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_random_access_with_snapshot, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_log_write_after_read, setup_create_log, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_index_rebuild, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_index_grow, setup_create_log, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_get_batch, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_keep_index, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_preallocate, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_torn_tail, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
-            test_log_index_rebuild, setup_create_log, teardown_log),
+            test_log_corrupt_entry, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
-            test_log_delete, setup_create_log, teardown_log),
+            test_log_v1_compat, setup_create_log, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_segments, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_delete, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_log_voting_persistence, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_log_fuzzer, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_group_sync, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_writer, setup_create_log, teardown_log),
+    cmocka_unit_test_teardown(
+            test_log_writer_segments, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_entry_cache_sanity, NULL, NULL),
     cmocka_unit_test_setup_teardown(
@@ -569,6 +1066,8 @@ const struct CMUnitTest log_tests[] = {
             test_entry_cache_delete_head, NULL, NULL),
     cmocka_unit_test_setup_teardown(
             test_entry_cache_delete_tail, NULL, NULL),
+    cmocka_unit_test_setup_teardown(
+            test_entry_cache_compact, NULL, NULL),
     cmocka_unit_test_setup_teardown(
             test_entry_cache_fuzzer, NULL, NULL),
     { .test_func = NULL }
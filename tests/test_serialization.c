@@ -228,6 +228,68 @@ static void test_deserialize_shardgroup(void **state)
     assert_int_equal(ShardGroupDeserialize(s4, strlen(s5), &sg), RR_ERROR);
 }
 
+static void test_append_entries_encoding(void **state)
+{
+    const char *data[] = { "", "short", "a somewhat longer entry payload" };
+    raft_entry_t *entries[3];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        entries[i] = raft_entry_new(strlen(data[i]));
+        memcpy(entries[i]->data, data[i], strlen(data[i]));
+        entries[i]->term = 10 + i;
+        entries[i]->id = 100 + i;
+        entries[i]->type = RAFT_LOGTYPE_NORMAL;
+    }
+
+    msg_appendentries_t msg = {
+        .leader_id = 3, .term = 12, .prev_log_idx = 50, .prev_log_term = 9,
+        .leader_commit = 49, .msg_id = 7, .n_entries = 3
+    };
+    RaftAEHeader hdr;
+    size_t len;
+
+    RaftAEEncodeHeader(&hdr, &msg);
+    char *buf = RaftAEEncodeEntries(entries, 3, &len);
+    for (i = 0; i < 3; i++) {
+        raft_entry_release(entries[i]);
+    }
+
+    msg_appendentries_t out;
+    assert_int_equal(RaftAEDecode(&out, &hdr, sizeof(hdr), buf, len), RR_OK);
+    assert_int_equal(out.leader_id, 3);
+    assert_int_equal(out.term, 12);
+    assert_int_equal(out.prev_log_idx, 50);
+    assert_int_equal(out.prev_log_term, 9);
+    assert_int_equal(out.leader_commit, 49);
+    assert_int_equal(out.msg_id, 7);
+    assert_int_equal(out.n_entries, 3);
+
+    for (i = 0; i < 3; i++) {
+        raft_entry_t *e = out.entries[i];
+        assert_int_equal(e->term, 10 + i);
+        assert_int_equal(e->id, 100 + i);
+        assert_int_equal(e->type, RAFT_LOGTYPE_NORMAL);
+        assert_int_equal(e->data_len, strlen(data[i]));
+        assert_memory_equal(e->data, data[i], e->data_len);
+        assert_int_equal((uintptr_t) e->data % 8, 0);
+    }
+
+    /* Entries share the decoded buffer, which is freed with the last one */
+    raft_entry_release_list(out.entries, out.n_entries);
+    test_free(out.entries);
+
+    /* Truncated entries buffer */
+    assert_int_equal(RaftAEDecode(&out, &hdr, sizeof(hdr), buf, len - 1), RR_ERROR);
+
+    /* Short or corrupted header */
+    assert_int_equal(RaftAEDecode(&out, &hdr, sizeof(hdr) - 1, buf, len), RR_ERROR);
+    hdr.magic++;
+    assert_int_equal(RaftAEDecode(&out, &hdr, sizeof(hdr), buf, len), RR_ERROR);
+
+    test_free(buf);
+}
+
 const struct CMUnitTest serialization_tests[] = {
     cmocka_unit_test(test_serialize_redis_command),
     cmocka_unit_test(test_deserialize_redis_command),
@@ -235,5 +297,6 @@ const struct CMUnitTest serialization_tests[] = {
     cmocka_unit_test(test_deserialize_corrupted_data),
     cmocka_unit_test(test_serialize_shardgroup),
     cmocka_unit_test(test_deserialize_shardgroup),
+    cmocka_unit_test(test_append_entries_encoding),
     { .test_func = NULL }
 };
@@ -123,8 +123,288 @@ static void test_redis_info_iterate(void **state)
     assert_int_equal(RedisInfoIterate(&p, &info_len, &key, &keylen, &val, &vallen), -1);
 }
 
+static void test_object_pool(void **state)
+{
+    void *objs[100];
+    int i;
+
+    ObjectPoolsInit();
+
+    for (i = 0; i < 100; i++) {
+        objs[i] = ObjectPoolAlloc(&PendingResponsePool);
+        memset(objs[i], 0xff, PendingResponsePool.size);
+    }
+    assert_int_equal(PendingResponsePool.in_use, 100);
+    assert_int_equal(PendingResponsePool.allocated, 100);
+
+    /* Freed objects are kept and reused */
+    for (i = 0; i < 100; i++) {
+        ObjectPoolFree(&PendingResponsePool, objs[i]);
+    }
+    assert_int_equal(PendingResponsePool.in_use, 0);
+    assert_int_equal(PendingResponsePool.allocated, 100);
+
+    for (i = 0; i < 100; i++) {
+        objs[i] = ObjectPoolAlloc(&PendingResponsePool);
+    }
+    assert_int_equal(PendingResponsePool.allocated, 100);
+    for (i = 0; i < 100; i++) {
+        ObjectPoolFree(&PendingResponsePool, objs[i]);
+    }
+
+    ObjectPoolRelease(&PendingResponsePool);
+    assert_int_equal(PendingResponsePool.allocated, 0);
+}
+
+static void test_pool_heap(void **state)
+{
+    ObjectPoolsInit();
+
+    char *p = PoolHeapCalloc(1, 10);
+    assert_int_equal(p[9], 0);
+    memcpy(p, "0123456789", 10);
+
+    /* Grows in place within its size class, then moves */
+    assert_ptr_equal(PoolHeapRealloc(p, 20), p);
+    p = PoolHeapRealloc(p, 10000);
+    assert_memory_equal(p, "0123456789", 10);
+
+    p = PoolHeapRealloc(p, 100);
+    assert_memory_equal(p, "0123456789", 10);
+    PoolHeapFree(p);
+    PoolHeapFree(NULL);
+
+    ObjectPoolsRelease();
+}
+
+static void test_mpsc_queue(void **state)
+{
+    MPSCQueue q;
+    void *items[8];
+    long i;
+    int n;
+
+    MPSCQueueInit(&q, 4);
+    assert_int_equal(MPSCQueuePopBatch(&q, items, 8), 0);
+
+    /* Bounded ring */
+    for (i = 0; i < 4; i++) {
+        assert_true(MPSCQueuePush(&q, (void *) (i + 1)));
+    }
+    assert_int_equal(MPSCQueueLen(&q), 4);
+
+    /* Items come out in order, in batches of up to max */
+    assert_int_equal(MPSCQueuePopBatch(&q, items, 3), 3);
+    assert_ptr_equal(items[0], (void *) 1);
+    assert_ptr_equal(items[2], (void *) 3);
+
+    /* Wraps around */
+    assert_true(MPSCQueuePush(&q, (void *) 5));
+    assert_true(MPSCQueuePush(&q, (void *) 6));
+    assert_int_equal(MPSCQueuePopBatch(&q, items, 8), 3);
+    assert_ptr_equal(items[0], (void *) 4);
+    assert_ptr_equal(items[1], (void *) 5);
+    assert_ptr_equal(items[2], (void *) 6);
+    assert_int_equal(MPSCQueueLen(&q), 0);
+
+    /* Once full, items overflow, and keep overflowing until the overflow
+     * list is emptied, so they still come out in order.
+     */
+    for (i = 0; i < 4; i++) {
+        assert_true(MPSCQueuePush(&q, (void *) (i + 1)));
+    }
+    for (i = 4; i < 200; i++) {
+        assert_false(MPSCQueuePush(&q, (void *) (i + 1)));
+    }
+    assert_int_equal(MPSCQueueLen(&q), 200);
+
+    assert_int_equal(MPSCQueuePopBatch(&q, items, 2), 2);
+    assert_false(MPSCQueuePush(&q, (void *) 201));
+
+    long expected = 3;
+    while ((n = MPSCQueuePopBatch(&q, items, 8)) > 0) {
+        for (i = 0; i < n; i++) {
+            assert_ptr_equal(items[i], (void *) expected++);
+        }
+    }
+    assert_int_equal(expected, 202);
+    assert_int_equal(MPSCQueueLen(&q), 0);
+
+    /* Back to the ring */
+    assert_true(MPSCQueuePush(&q, (void *) 1));
+    assert_int_equal(MPSCQueuePopBatch(&q, items, 8), 1);
+
+    MPSCQueueFree(&q);
+}
+
+static RedisRaftCtx lanes_rr;
+
+static void __push_reqs(enum RaftReqLane lane, RaftReq *reqs, int n)
+{
+    for (int i = 0; i < n; i++) {
+        assert_true(MPSCQueuePush(&lanes_rr.rqueue[lane], &reqs[i]));
+    }
+}
+
+static void __pop_reqs(int *turn, RaftReq *first, int n)
+{
+    RaftReq *batch[REDIS_RAFT_RQUEUE_BATCH_SIZE];
+
+    assert_int_equal(RaftReqPopBatch(&lanes_rr, batch, turn), n);
+    for (int i = 0; i < n; i++) {
+        assert_ptr_equal(batch[i], &first[i]);
+    }
+}
+
+static void test_request_lanes(void **state)
+{
+    RaftReq consensus[2], reads[2 * REDIS_RAFT_RQUEUE_BATCH_SIZE + 1],
+            writes[2 * REDIS_RAFT_RQUEUE_BATCH_SIZE + 1];
+    const int batch = REDIS_RAFT_RQUEUE_BATCH_SIZE;
+    int turn = RR_LANE_READ;
+    int i;
+
+    memset(&lanes_rr, 0, sizeof(lanes_rr));
+    for (i = 0; i < RR_LANES; i++) {
+        MPSCQueueInit(&lanes_rr.rqueue[i], 1024);
+    }
+
+    /* The consensus lane goes first, then reads ahead of writes */
+    __push_reqs(RR_LANE_WRITE, writes, 2);
+    __push_reqs(RR_LANE_READ, reads, 2);
+    __push_reqs(RR_LANE_CONSENSUS, consensus, 1);
+    __pop_reqs(&turn, consensus, 1);
+    __pop_reqs(&turn, reads, 2);
+
+    /* Consensus messages still jump ahead when it's the write lane's turn */
+    __push_reqs(RR_LANE_CONSENSUS, &consensus[1], 1);
+    __pop_reqs(&turn, &consensus[1], 1);
+    __pop_reqs(&turn, writes, 2);
+    __pop_reqs(&turn, NULL, 0);
+
+    /* Under a backlog of both, reads and writes take turns batch by batch */
+    __push_reqs(RR_LANE_WRITE, writes, 2 * batch + 1);
+    __push_reqs(RR_LANE_READ, reads, 2 * batch + 1);
+    turn = RR_LANE_READ;
+    __pop_reqs(&turn, reads, batch);
+    __pop_reqs(&turn, writes, batch);
+    __pop_reqs(&turn, &reads[batch], batch);
+    __pop_reqs(&turn, &writes[batch], batch);
+    __pop_reqs(&turn, &reads[2 * batch], 1);
+    __pop_reqs(&turn, &writes[2 * batch], 1);
+
+    for (i = 0; i < RR_LANES; i++) {
+        MPSCQueueFree(&lanes_rr.rqueue[i]);
+    }
+}
+
+static void test_latency_histogram(void **state)
+{
+    LatencyHistogram h;
+    int i;
+
+    LatencyHistogramReset(&h);
+    assert_int_equal(LatencyHistogramPercentile(&h, 99), 0);
+
+    /* Small values are exact */
+    LatencyHistogramAdd(&h, 3);
+    assert_int_equal(LatencyHistogramPercentile(&h, 50), 3);
+
+    /* 1..1000, p99 is 990 rounded up to its bucket */
+    LatencyHistogramReset(&h);
+    for (i = 1; i <= 1000; i++) {
+        LatencyHistogramAdd(&h, i);
+    }
+    assert_int_equal(h.count, 1000);
+    assert_int_equal(LatencyHistogramPercentile(&h, 99), 1023);
+    assert_int_equal(LatencyHistogramPercentile(&h, 50), 511);
+    assert_int_equal(LatencyHistogramPercentile(&h, 100), 1023);
+
+    /* A few outliers are enough to move the tail */
+    LatencyHistogramReset(&h);
+    for (i = 0; i < 980; i++) {
+        LatencyHistogramAdd(&h, 100);
+    }
+    for (i = 0; i < 20; i++) {
+        LatencyHistogramAdd(&h, 50000);
+    }
+    assert_int_equal(LatencyHistogramPercentile(&h, 50), 111);
+    assert_true(LatencyHistogramPercentile(&h, 99) >= 50000);
+    assert_true(LatencyHistogramPercentile(&h, 99) < 50000 * 5 / 4);
+
+    /* Huge values don't overflow */
+    LatencyHistogramAdd(&h, UINT64_MAX);
+    assert_int_equal(LatencyHistogramPercentile(&h, 100), UINT64_MAX);
+}
+
+#define QUEUE_PRODUCERS         4
+#define QUEUE_PRODUCER_ITEMS    10000
+
+typedef struct QueueProducer {
+    MPSCQueue *q;
+    long id;
+} QueueProducer;
+
+static void queueProducer(void *arg)
+{
+    QueueProducer *p = arg;
+    long i;
+
+    for (i = 0; i < QUEUE_PRODUCER_ITEMS; i++) {
+        /* Producer id in the low bits, sequence in the rest */
+        void *item = (void *) ((i << 8) | p->id);
+        MPSCQueuePush(p->q, item);
+    }
+}
+
+static void test_mpsc_queue_producers(void **state)
+{
+    MPSCQueue q;
+    QueueProducer producers[QUEUE_PRODUCERS];
+    uv_thread_t threads[QUEUE_PRODUCERS];
+    long next[QUEUE_PRODUCERS] = {0};
+    void *items[64];
+    long total = 0;
+    int i, n;
+
+    /* A small ring, so producers also go through the overflow list */
+    MPSCQueueInit(&q, 16);
+    for (i = 0; i < QUEUE_PRODUCERS; i++) {
+        producers[i].q = &q;
+        producers[i].id = i;
+        uv_thread_create(&threads[i], queueProducer, &producers[i]);
+    }
+
+    /* Every item arrives once, and each producer's items in order */
+    while (total < QUEUE_PRODUCERS * QUEUE_PRODUCER_ITEMS) {
+        n = MPSCQueuePopBatch(&q, items, 64);
+        for (i = 0; i < n; i++) {
+            long val = (long) items[i];
+            long id = val & 0xff;
+
+            assert_true(id < QUEUE_PRODUCERS);
+            assert_int_equal(val >> 8, next[id]);
+            next[id]++;
+        }
+        total += n;
+    }
+
+    for (i = 0; i < QUEUE_PRODUCERS; i++) {
+        uv_thread_join(&threads[i]);
+    }
+    assert_int_equal(MPSCQueueLen(&q), 0);
+
+    MPSCQueueFree(&q);
+}
+
 const struct CMUnitTest util_tests[] = {
     cmocka_unit_test(test_redis_info_iterate),
     cmocka_unit_test(test_memory_conversion),
+    cmocka_unit_test(test_object_pool),
+    cmocka_unit_test(test_pool_heap),
+    cmocka_unit_test(test_mpsc_queue),
+    cmocka_unit_test(test_mpsc_queue_producers),
+    cmocka_unit_test(test_request_lanes),
+    cmocka_unit_test(test_latency_histogram),
     { .test_func = NULL }
 };
@@ -370,3 +370,64 @@ RRStatus formatExactMemorySize(unsigned long value, char *buf, size_t buf_size)
 
     return RR_OK;
 }
+
+/* Values below 4 get a bucket each; larger values are bucketed by their most
+ * significant bit and the two bits that follow it.
+ */
+static int latencyHistogramBucket(uint64_t value)
+{
+    if (value < 4) {
+        return (int) value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    return (msb - 1) * 4 + (int) ((value >> (msb - 2)) & 3);
+}
+
+/* Returns the largest value that falls in a bucket */
+static uint64_t latencyHistogramBucketMax(int bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+
+    int shift = bucket / 4 - 1;
+    uint64_t min = (uint64_t) (4 + bucket % 4) << shift;
+    return min + ((uint64_t) 1 << shift) - 1;
+}
+
+void LatencyHistogramAdd(LatencyHistogram *h, uint64_t value)
+{
+    h->buckets[latencyHistogramBucket(value)]++;
+    h->count++;
+}
+
+/* Returns an upper bound of the given percentile of the values added, or 0
+ * if the histogram is empty.
+ */
+uint64_t LatencyHistogramPercentile(LatencyHistogram *h, double percentile)
+{
+    unsigned long long rank = (unsigned long long) (h->count * percentile / 100);
+    unsigned long long seen = 0;
+
+    if (!h->count) {
+        return 0;
+    }
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            return latencyHistogramBucketMax(i);
+        }
+    }
+
+    return latencyHistogramBucketMax(LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+void LatencyHistogramReset(LatencyHistogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}